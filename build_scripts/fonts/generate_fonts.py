@@ -1,9 +1,16 @@
 from PIL import Image
 import bitarray
 import shutil
+import struct
 import os
 
 
+# see FONT_FileHeader in src/kernel/visual/font.h
+FONT_FILE_MAGIC = b"FONT"
+FONT_FILE_HEADER_FORMAT = "<4sHBBHH"  # magic, header size, width, height, glyph count, stride
+FONT_GLYPH_COUNT = 256  # the images are 16 by 16 glyphs
+
+
 def relative_directory(path: str) -> str:
     return os.path.join(os.path.dirname(__file__), path)
 
@@ -23,12 +30,18 @@ def png_to_bits(filepath: str) -> bytes:
     return output.tobytes()
 
 
+def font_stride(font_size: tuple[int, int]) -> int:
+    return (font_size[0] + 7) // 8
+
+
+# every glyph row is padded to whole bytes, so the kernel can expand them without splitting bytes between rows
 def convert_bits(bits: bytes, font_size: tuple[int, int]) -> bytes:
-    output = bitarray.bitarray(endian="big")
+    output = bytearray()
 
     for char_y in range(16):
         for char_x in range(16):
             for dy in range(font_size[1]):
+                row = bitarray.bitarray(endian="big")
                 for dx in range(font_size[0]):
                     bit_x = char_x * font_size[0] + dx
                     bit_y = char_y * font_size[1] + dy
@@ -38,11 +51,25 @@ def convert_bits(bits: bytes, font_size: tuple[int, int]) -> bytes:
 
                     is_set = (bits[byte_index] >> (7 - bit_offset)) & 1
                     if is_set:
-                        output.append(1)
+                        row.append(1)
                     else:
-                        output.append(0)
+                        row.append(0)
 
-    return output.tobytes()
+                output += row.tobytes()  # pads the row with zeros
+
+    return bytes(output)
+
+
+def font_header(font_size: tuple[int, int]) -> bytes:
+    return struct.pack(
+        FONT_FILE_HEADER_FORMAT,
+        FONT_FILE_MAGIC,
+        struct.calcsize(FONT_FILE_HEADER_FORMAT),
+        font_size[0],
+        font_size[1],
+        FONT_GLYPH_COUNT,
+        font_stride(font_size),
+    )
 
 
 def generate_font_files(output_directory: str) -> None:
@@ -58,13 +85,13 @@ def generate_font_files(output_directory: str) -> None:
         converted_bits = bytearray(convert_bits(png_bits, font_size))
 
         # custom stuff to make the null character always be empty, because it's used for clearing the screen
-        character_bits_size = font_size[0] * font_size[1]
-        for i in range((character_bits_size + 7) // 8):  # round up
+        for i in range(font_stride(font_size) * font_size[1]):
             converted_bits[i] = 0
 
         with open(
             f"{output_directory}/{'x'.join(str(x) for x in font_size)}.f", "wb"
         ) as f:
+            f.write(font_header(font_size))
             f.write(converted_bits)
 
 
@@ -6,7 +6,17 @@ import sys
 import os
 
 
-def make_gdbscript(kernel_path: str, image_path: str, memory_size: str) -> str:
+def drive_arguments(image_path: str, disk_interface: str) -> str:
+    if disk_interface == "ahci":
+        # the q35 machine has an ahci controller instead of the piix ide one
+        return f"-machine q35 -drive file={image_path},format=raw,if=ide"
+    elif disk_interface == "virtio":
+        return f"-drive file={image_path},format=raw,if=virtio"
+
+    return f"-drive file={image_path},format=raw,if=ide"
+
+
+def make_gdbscript(kernel_path: str, image_path: str, memory_size: str, disk_interface: str) -> str:
     path = tempfile.mkdtemp(prefix="magnusos") + "/gdbscript.gdb"
 
     with open(path, "w") as fd:
@@ -19,7 +29,7 @@ symbol-file {kernel_path}
 
 target remote | qemu-system-i386 -S -gdb stdio \
 -m {memory_size} \
--drive file={image_path},format=raw,if=ide \
+{drive_arguments(image_path, disk_interface)} \
 -debugcon file:E9.log \
 -serial null
 """
@@ -28,9 +38,9 @@ target remote | qemu-system-i386 -S -gdb stdio \
     return path
 
 
-def main(kernel_path: str, image_path: str, memory_size: str) -> None:
+def main(kernel_path: str, image_path: str, memory_size: str, disk_interface: str) -> None:
     # make script
-    gdbscript_path = make_gdbscript(kernel_path, image_path, memory_size)
+    gdbscript_path = make_gdbscript(kernel_path, image_path, memory_size, disk_interface)
 
     # run gdb (use this because i need stdio directly)
     os.system(" ".join(["gdb", "-tui", "-x", gdbscript_path]))
@@ -40,8 +50,8 @@ def main(kernel_path: str, image_path: str, memory_size: str) -> None:
 
 
 if __name__ == "__main__":
-    if len(sys.argv) != 4:
-        print("Usage: python3 gdb.py <kernel path> <image path> <memory size>")
+    if len(sys.argv) not in (4, 5):
+        print("Usage: python3 gdb.py <kernel path> <image path> <memory size> [ide|ahci|virtio]")
         sys.exit(1)
 
-    main(sys.argv[1], sys.argv[2], sys.argv[3])
+    main(sys.argv[1], sys.argv[2], sys.argv[3], sys.argv[4] if len(sys.argv) == 5 else "ide")
@@ -1,30 +1,108 @@
 #!/usr/bin/python3
 
+import datetime
+import json
+import os
 import sys
+import time
 import sh
 
+E9_LOG_PATH = "E9.log"
+BENCHMARK_RESULTS_PATH = "benchmark_results.jsonl"
+BENCHMARK_LINE_PREFIX = "BENCH: "
+
+
+def drive_arguments(image_path: str, disk_interface: str) -> list[str]:
+    if disk_interface == "ahci":
+        # the q35 machine has an ahci controller instead of the piix ide one
+        return ["-machine", "q35", "-drive", f"file={image_path},format=raw,if=ide"]
+    elif disk_interface == "virtio":
+        return ["-drive", f"file={image_path},format=raw,if=virtio"]
+
+    return ["-drive", f"file={image_path},format=raw,if=ide"]
+
+
+def parse_benchmark_results(e9_log_path: str) -> dict[str, dict[str, int]]:
+    # "BENCH: <phase> key=value key=value ...", one line per phase
+    phases: dict[str, dict[str, int]] = {}
+    with open(e9_log_path, "r", errors="replace") as fd:
+        for line in fd:
+            if not line.startswith(BENCHMARK_LINE_PREFIX):
+                continue
+
+            phase, *fields = line[len(BENCHMARK_LINE_PREFIX) :].split()
+            phases[phase] = {
+                key: int(value)
+                for key, value in (field.split("=", 1) for field in fields)
+            }
+
+    return phases
+
+
+def collect_benchmark_results(disk_interface: str, memory_size: str, start_time: float) -> None:
+    # if qemu failed before it opened the log, it's still the one of an earlier run
+    if not os.path.exists(E9_LOG_PATH) or os.path.getmtime(E9_LOG_PATH) < start_time:
+        print(f"{E9_LOG_PATH} wasn't written by this run, no benchmark results collected")
+        return
+
+    phases = parse_benchmark_results(E9_LOG_PATH)
+    if not phases:
+        return
+
+    # one run per line, so runs can be compared over time
+    with open(BENCHMARK_RESULTS_PATH, "a") as fd:
+        result = {
+            "time": datetime.datetime.now().isoformat(timespec="seconds"),
+            "disk_interface": disk_interface,
+            "memory_size": memory_size,
+            "phases": phases,
+        }
+        fd.write(json.dumps(result) + "\n")
+
+    for phase, fields in phases.items():
+        print(
+            f"{phase}: {fields.get('characters_per_s', 0)} characters/s, "
+            f"{fields.get('flushes_per_s', 0)} flushes/s, "
+            f"{fields.get('pushed_bytes', 0)} bytes pushed"
+        )
+    print(f"Benchmark results appended to {BENCHMARK_RESULTS_PATH}")
+
+
+def main(image_path: str, memory_size: str, disk_interface: str, console_benchmark: bool) -> None:
+    start_time = time.time()
 
-def main(image_path: str, memory_size: str) -> None:
     # run qemu
     sh.Command("qemu-system-i386")(
         "-m",
         memory_size,
         # "-hda",
         # image_path,
-        "-drive",
-        f"file={image_path},format=raw,if=ide",
+        *drive_arguments(image_path, disk_interface),
         "-debugcon",  # for the e9 port hack
-        "file:E9.log",  #
+        f"file:{E9_LOG_PATH}",  #
         "-serial",  # disable com1 serial port (also for e9 port hack)
         "null",  #
+        "-device",  # lets the kernel shut qemu down, the console benchmark does once it's done
+        "isa-debug-exit,iobase=0xf4,iosize=0x04",
         _out=sys.stdout,
         _err=sys.stderr,
+        # the benchmark shuts qemu down by writing 0 to the isa-debug-exit port, which exits with 1
+        # qemu failing to start exits with 1 too, so that is only accepted when the benchmark is expected
+        _ok_code=[0, 1] if console_benchmark else [0],
     )
 
+    if console_benchmark:
+        collect_benchmark_results(disk_interface, memory_size, start_time)
+
 
 if __name__ == "__main__":
-    if len(sys.argv) != 3:
-        print("Usage: python3 run.py <image path> <memory size>")
+    if len(sys.argv) not in (3, 4, 5):
+        print("Usage: python3 run.py <image path> <memory size> [ide|ahci|virtio] [console benchmark: yes|no]")
         sys.exit(1)
 
-    main(sys.argv[1], sys.argv[2])
+    main(
+        sys.argv[1],
+        sys.argv[2],
+        sys.argv[3] if len(sys.argv) >= 4 else "ide",
+        len(sys.argv) == 5 and sys.argv[4] == "yes",
+    )
@@ -7,6 +7,7 @@
 #include <lib/disk/disk.h>
 #include <lib/disk/fat.h>
 #include <lib/disk/mbr.h>
+#include <lib/disk/ramdisk.h>
 #include <lib/errors/errors.h>
 #include <lib/memory/allocator.h>
 #include <lib/memory/memdefs.h>
@@ -15,6 +16,7 @@
 #include <stdint.h>
 
 #define MEMORY_LOAD_KERNEL_CHUNK_SIZE 0x10000
+#define RAMDISK_IMAGE_PATH "/boot/ramdisk.img" // put it in image/root/boot to get a ram disk
 
 extern char __bss_start;
 extern char __bss_stop;
@@ -24,7 +26,9 @@ typedef void (*KernelStart)(uint8_t bootDrive,
                             uint32_t memoryRegionsCount,
                             uint32_t partitionLBA,
                             uint32_t partitionSize,
-                            VbeModeInfo *vbeModeInfo);
+                            VbeModeInfo *vbeModeInfo,
+                            void *ramdiskImage,
+                            uint32_t ramdiskSectorCount);
 
 void ASMCALL cstart(uint8_t bootDrive, uint32_t partitionLBA, uint32_t partitionSize) {
     memset(&__bss_start, '\0', (&__bss_stop) - (&__bss_start));
@@ -69,21 +73,21 @@ void ASMCALL cstart(uint8_t bootDrive, uint32_t partitionLBA, uint32_t partition
     puts("Initialized allocator!\n");
 
     // initialize disks
-    DISK masterDisk;
-    DISK slaveDisk;
-    DISK_InitializeResult diskInitializeResult;
-    if ((status = DISK_Initialize(&diskInitializeResult, &masterDisk, &slaveDisk)) != NO_ERROR) {
+    DISK disks[DISK_MAX_DISKS];
+    uint8_t diskCount;
+    if ((status = DISK_Initialize(disks, DISK_MAX_DISKS, &diskCount)) != NO_ERROR) {
         printf("Failed to initialize disks! Status: %d\n", status);
         return;
     }
-    if (!diskInitializeResult.initializedMasterDisk) {
-        puts("Failed to initialize master disk!\n");
+    // we boot from the first disk, the first ahci port or the primary master
+    if (diskCount == 0) {
+        puts("Failed to initialize boot disk!\n");
         return;
     }
-    puts("Initialized disks!\n");
+    printf("Initialized %hhu disk(s)!\n", diskCount);
 
     Partition bootPartition;
-    MBR_InitializePartition(&bootPartition, &masterDisk, partitionLBA, partitionSize);
+    MBR_InitializePartition(&bootPartition, &disks[0], partitionLBA, partitionSize);
     puts("Detected boot partition!\n");
 
     FAT_Filesystem *bootFilesystem = malloc(sizeof(FAT_Filesystem));
@@ -106,9 +110,23 @@ void ASMCALL cstart(uint8_t bootDrive, uint32_t partitionLBA, uint32_t partition
     }
     puts("Kernel loaded!\n");
 
+    // the ram disk image is optional, the kernel gets NULL if there is none
+    void *ramdiskImage = NULL;
+    uint32_t ramdiskSectorCount = 0;
+    if ((status = RAMDISK_LoadImage(bootFilesystem, RAMDISK_IMAGE_PATH, &ramdiskImage, &ramdiskSectorCount)) == NO_ERROR)
+        printf("Loaded ram disk image! (%lu sectors)\n", ramdiskSectorCount);
+    else if (status != FILESYSTEM_NOT_FOUND_ERROR)
+        printf("Failed to load ram disk image, continuing without it. Status: %d\n", status);
+
     // no longer need this, we have loaded kernel
     free(bootFilesystem);
 
+    // or the disks, this also stops the controllers from writing into memory that the kernel will reuse
+    for (uint8_t i = 0; i < diskCount; ++i) {
+        DISK_DumpStats(&disks[i], i);
+        DISK_DeInitialize(&disks[i]);
+    }
+
     // initialize vbe (graphics)
     VbeModeInfo *selectedVbeModeInfo = ALLOCATOR_Malloc(sizeof(VbeModeInfo), true, false);
     if (selectedVbeModeInfo == NULL || (size_t)selectedVbeModeInfo > (size_t)MEMORY_HIGHEST_BIOS_ADDRESS) {
@@ -121,7 +139,7 @@ void ASMCALL cstart(uint8_t bootDrive, uint32_t partitionLBA, uint32_t partition
     }
 
     // run kernel
-    kernelStart(bootDrive, memoryRegions, memoryRegionsCount, partitionLBA, partitionSize, selectedVbeModeInfo);
+    kernelStart(bootDrive, memoryRegions, memoryRegionsCount, partitionLBA, partitionSize, selectedVbeModeInfo, ramdiskImage, ramdiskSectorCount);
 
     // dont need to free stuff but ill do it anyways just for good measure
     free(memoryRegions);
@@ -77,8 +77,17 @@ int VBE_Initialize(VbeModeInfo *modeInfo) {
         goto free_controller_info;
     }
 
-    if ((status = VBE_SetVideoMode(pickedMode, NULL)) != NO_ERROR)
-        puts("Failed to set VBE mode!\n"); // no need to `goto`/jump, no logic to skip
+    if ((status = VBE_SetVideoMode(pickedMode, NULL)) != NO_ERROR) {
+        puts("Failed to set VBE mode!\n");
+        goto free_controller_info;
+    }
+
+    // video memory past the screen lets the kernel scroll and flip pages by moving the display start, the pitch stays the same
+    uint16_t maxScanLines;
+    if (x86_VBE_GetMaxScanLines(&maxScanLines) == 0 && maxScanLines > modeInfo->height)
+        modeInfo->virtualHeight = maxScanLines;
+    else
+        modeInfo->virtualHeight = modeInfo->height;
 
 free_controller_info:
     free(controllerInfo);
@@ -96,6 +96,50 @@ x86_VBE_SetVideoMode:
     pop ebp
     ret
 
+;
+; uint8_t ASMCALL x86_VBE_GetMaxScanLines(uint16_t *maxScanLinesOutput);
+;
+global x86_VBE_GetMaxScanLines
+x86_VBE_GetMaxScanLines:
+    push ebp
+    mov ebp, esp
+
+    x86_EnterRealMode
+
+    push bx
+    push cx
+    push dx
+    push ds
+    push esi
+
+    mov ax, 0x4F06
+    mov bl, 0x01 ;; get logical scan line length, dx is the most scan lines video memory fits
+    int 0x10
+
+    cmp al, 0x4F
+    je .supported
+    mov ah, 0x01 ;; function not supported, dx is garbage
+    jmp .done
+.supported:
+    ConvertLinearAddress [bp + 8], ds, esi, si
+    mov ds:[si], dx
+
+.done:
+    pop esi
+    pop ds
+    pop dx
+    pop cx
+    pop bx
+
+    push eax
+    x86_EnterProtectedMode
+    pop eax
+    mov al, ah ;; error code
+
+    mov esp, ebp
+    pop ebp
+    ret
+
 MEMDETECT_GetRegionSignature    equ 0x534D4150  ;; equals to "SMAP"
 ;
 ; uint8_t ASMCALL x86_MEMDETECT_GetRegion(MemoryRegion *regionOutput, uint32_t *offset);
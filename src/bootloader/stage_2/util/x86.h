@@ -8,6 +8,7 @@
 uint8_t ASMCALL x86_VBE_GetControllerInfo(void *infoOutput);
 uint8_t ASMCALL x86_VBE_GetModeInfo(uint16_t mode, void *infoOutput);
 uint8_t ASMCALL x86_VBE_SetVideoMode(uint16_t mode);
+uint8_t ASMCALL x86_VBE_GetMaxScanLines(uint16_t *maxScanLinesOutput);
 
 // return error codes are described in MEMDETECT_GetMemoryRegionsErrorCode
 uint8_t ASMCALL x86_MEMDETECT_GetRegion(MEMDETECT_MemoryRegion *regionOutput, uint32_t *offset);
@@ -1,6 +1,7 @@
 #include "stdio.h"
 #include "util/x86.h"
 #include "vga.h"
+#include <lib/algorithm/format.h>
 #include <lib/memory/memdefs.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -99,26 +100,19 @@ void clearScreen() {
 static const char g_HexChars[] = "0123456789abcdef";
 
 void printf_number_unsigned(uint64_t number, uint8_t radix) {
-    char outputBuffer[22]; // 20-22 characters number, and 1 for the null terminator
-    int8_t bufferPosition = 0;
+    char digits[FORMAT_MAX_DIGITS];
+    char *end = digits + sizeof(digits);
 
-    do {
-        uint64_t remainder = number % radix;
-        number /= radix;
-        outputBuffer[bufferPosition++] = g_HexChars[remainder];
-    } while (number > 0);
-
-    while (--bufferPosition >= 0)
-        putc(outputBuffer[bufferPosition]);
+    for (char *digit = formatUnsigned(end, number, radix, false); digit < end; ++digit)
+        putc(*digit);
 }
 
 void printf_number_signed(int64_t number, uint8_t radix) {
-    if (number < 0) {
-        putc('-');
-        printf_number_unsigned(-number, radix);
-    } else {
-        printf_number_unsigned(number, radix);
-    }
+    char digits[FORMAT_MAX_DIGITS + 1]; // 1 for the '-'
+    char *end = digits + sizeof(digits);
+
+    for (char *digit = formatSigned(end, number, radix, false); digit < end; ++digit)
+        putc(*digit);
 }
 
 #define PRINTF_STATE_NORMAL 0
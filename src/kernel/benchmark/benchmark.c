@@ -0,0 +1,124 @@
+// scons builds every source file, so the benchmark is only compiled into kernels built with console_benchmark
+#if CONSOLE_BENCHMARK == 1
+
+#include "benchmark.h"
+#include "visual/font.h"
+#include "visual/graphics.h"
+#include "visual/stdio.h"
+#include <lib/algorithm/arrays.h>
+#include <lib/algorithm/math.h>
+#include <lib/errors/errors.h>
+#include <lib/time/pit.h>
+#include <lib/x86/general.h>
+#include <stdint.h>
+
+#define E9_PORT 0xE9
+#define DEBUG_EXIT_PORT 0xF4 // qemu's isa-debug-exit device, scripts/run.py adds it
+
+typedef struct {
+    const char *name;
+    uint64_t operations; // lines, scrolls or font switches
+    uint64_t characters;
+    uint64_t startMs;
+    uint64_t startCycles;
+    GRAPHICS_Stats startStats;
+} Phase;
+
+// the fonts switched between, the ones that aren't on the disk are skipped
+static const int16_t g_FontSizes[][2] = {{8, 16}, {8, 8}, {9, 16}};
+
+static const char *g_Words[] = {"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog", "\t", "framebuffer", "glyph", "0123456789"};
+
+static void beginPhase(Phase *phase, const char *name) {
+    flushOutput(); // so nothing from before is counted
+    phase->name = name;
+    phase->operations = 0;
+    phase->characters = 0;
+    GRAPHICS_GetStats(&phase->startStats);
+    phase->startMs = PIT_GetTimeMs();
+    phase->startCycles = x86_ReadTsc();
+}
+
+static uint64_t perSecond(uint64_t count, uint64_t milliseconds) {
+    return milliseconds > 0 ? count * 1000 / milliseconds : 0;
+}
+
+// the results go straight to the e9 port as a "BENCH: " line, so they don't end up on the screen and work in release builds too
+static void endPhase(Phase *phase) {
+    flushOutput(); // everything printed has to be on the screen before the clock stops
+
+    uint64_t cycles = x86_ReadTsc() - phase->startCycles;
+    uint64_t milliseconds = PIT_GetTimeMs() - phase->startMs;
+    GRAPHICS_Stats stats;
+    GRAPHICS_GetStats(&stats);
+    uint64_t flushes = stats.flushes - phase->startStats.flushes;
+    uint64_t pushedBytes = stats.pushedBytes - phase->startStats.pushedBytes;
+
+    char line[384];
+    int length = snprintf(line, sizeof(line),
+                          "BENCH: %s operations=%llu characters=%llu ms=%llu cycles=%llu flushes=%llu pushed_bytes=%llu "
+                          "operations_per_s=%llu characters_per_s=%llu flushes_per_s=%llu pushed_bytes_per_s=%llu\n",
+                          phase->name, phase->operations, phase->characters, milliseconds, cycles, flushes, pushedBytes,
+                          perSecond(phase->operations, milliseconds), perSecond(phase->characters, milliseconds),
+                          perSecond(flushes, milliseconds), perSecond(pushedBytes, milliseconds));
+    x86_OutBytes(E9_PORT, (const uint8_t *)line, min(length, sizeof(line) - 1));
+}
+
+// lines of mixed length with numbers and tabs in them, enough to scroll many times
+static void printLines(Phase *phase) {
+    char line[128];
+
+    for (uint32_t i = 0; i < BENCHMARK_CONSOLE_LINES; ++i) {
+        int length = snprintf(line, sizeof(line), "%u: %x %d", i, i * 2654435761u, -(int32_t)i);
+        for (uint32_t word = 0; word < i % 9; ++word)
+            length += snprintf(line + length, sizeof(line) - length, " %s", g_Words[(i + word) % ARRAY_SIZE(g_Words)]);
+        length += snprintf(line + length, sizeof(line) - length, "\n");
+
+        puts(line);
+        ++phase->operations;
+        phase->characters += length;
+    }
+}
+
+// one line at a time, each flushed on its own, which is what a slow trickle of log messages looks like
+static void scrollLines(Phase *phase) {
+    for (uint32_t i = 0; i < BENCHMARK_CONSOLE_SCROLLS; ++i) {
+        puts("\n");
+        flushOutput();
+        ++phase->operations;
+        ++phase->characters;
+    }
+}
+
+static void switchFonts(Phase *phase, FAT_Filesystem *fontsFilesystem) {
+    for (uint32_t i = 0; i < BENCHMARK_CONSOLE_FONT_SWITCHES; ++i) {
+        const int16_t *size = g_FontSizes[i % ARRAY_SIZE(g_FontSizes)];
+        const FONT_FontInfo *fontInfo = FONT_FindFontInfo(NULL, size[0], size[1]);
+        if (fontInfo == NULL || setFont(fontsFilesystem, fontInfo) != NO_ERROR)
+            continue;
+
+        ++phase->operations;
+    }
+}
+
+// prints, scrolls and switches fonts, reporting how long each took and what went to the framebuffer
+// meant for boots built with console_benchmark=yes, qemu is shut down once it's done, elsewhere the boot just goes on
+void BENCHMARK_RunConsole(FAT_Filesystem *fontsFilesystem) {
+    Phase phase;
+
+    beginPhase(&phase, "lines");
+    printLines(&phase);
+    endPhase(&phase);
+
+    beginPhase(&phase, "scroll");
+    scrollLines(&phase);
+    endPhase(&phase);
+
+    beginPhase(&phase, "fonts");
+    switchFonts(&phase, fontsFilesystem);
+    endPhase(&phase);
+
+    x86_OutDword(DEBUG_EXIT_PORT, 0); // qemu exits with status 1
+}
+
+#endif
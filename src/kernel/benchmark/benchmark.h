@@ -0,0 +1,9 @@
+#pragma once
+
+#include <lib/disk/fat.h>
+
+#define BENCHMARK_CONSOLE_LINES 2000
+#define BENCHMARK_CONSOLE_SCROLLS 500
+#define BENCHMARK_CONSOLE_FONT_SWITCHES 30
+
+void BENCHMARK_RunConsole(FAT_Filesystem *fontsFilesystem);
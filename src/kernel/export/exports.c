@@ -10,6 +10,8 @@ const FunctionExport g_ExportList[] = {
     {"putc", (void *)putc},
     {"puts", (void *)puts},
     {"printf", (void *)printf},
+    {"snprintf", (void *)snprintf},
+    {"flushOutput", (void *)flushOutput},
 };
 
 const FunctionExport *getExports() {
@@ -0,0 +1,218 @@
+#include "mtrr.h"
+#include <lib/errors/errors.h>
+#include <lib/x86/general.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MTRR_CPUID_FEATURES 0x00000001
+#define MTRR_CPUID_FEATURES_EDX_MTRR (1 << 12)
+#define MTRR_CPUID_MAX_EXTENDED 0x80000000
+#define MTRR_CPUID_ADDRESS_SIZES 0x80000008
+#define MTRR_DEFAULT_PHYSICAL_ADDRESS_BITS 36 // if the cpu doesn't say
+
+#define MTRR_MSR_CAPABILITIES 0xFE
+#define MTRR_MSR_DEFAULT_TYPE 0x2FF
+#define MTRR_MSR_PHYSICAL_BASE(n) (0x200 + 2 * (n))
+#define MTRR_MSR_PHYSICAL_MASK(n) (0x201 + 2 * (n))
+
+#define MTRR_CAPABILITIES_VARIABLE_COUNT 0xFF
+#define MTRR_CAPABILITIES_WRITE_COMBINING (1 << 10)
+#define MTRR_DEFAULT_TYPE_TYPE 0xFF
+#define MTRR_DEFAULT_TYPE_ENABLE (1 << 11)
+#define MTRR_BASE_TYPE 0xFF
+#define MTRR_MASK_VALID (1 << 11)
+
+typedef struct {
+    uint64_t base;
+    uint64_t size; // a power of 2, `base` is aligned to it
+    MTRR_MemoryType type;
+} MTRR_Range;
+
+static bool isSupported() {
+    uint32_t registers[4];
+    x86_Cpuid(MTRR_CPUID_FEATURES, 0, registers);
+    return (registers[3] & MTRR_CPUID_FEATURES_EDX_MTRR) != 0;
+}
+
+// the address bits a mask has, above the page offset
+static uint64_t addressMask() {
+    uint32_t registers[4];
+    uint8_t bits = MTRR_DEFAULT_PHYSICAL_ADDRESS_BITS;
+
+    x86_Cpuid(MTRR_CPUID_MAX_EXTENDED, 0, registers);
+    if (registers[0] >= MTRR_CPUID_ADDRESS_SIZES) {
+        x86_Cpuid(MTRR_CPUID_ADDRESS_SIZES, 0, registers);
+        bits = registers[0] & 0xFF;
+    }
+
+    return ((1ull << bits) - 1) & ~(uint64_t)(MTRR_PAGE_SIZE - 1);
+}
+
+static uint8_t variableRangeCount() {
+    uint8_t count = x86_ReadMsr(MTRR_MSR_CAPABILITIES) & MTRR_CAPABILITIES_VARIABLE_COUNT;
+    return count < MTRR_MAX_VARIABLE_RANGES ? count : MTRR_MAX_VARIABLE_RANGES;
+}
+
+// the enabled variable ranges, masks that don't describe one power of 2 sized range are legal, but not handled
+static int readRanges(MTRR_Range *rangesOutput, uint8_t *countOutput) {
+    uint64_t mask = addressMask();
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < variableRangeCount(); ++i) {
+        uint64_t rangeMask = x86_ReadMsr(MTRR_MSR_PHYSICAL_MASK(i));
+        if ((rangeMask & MTRR_MASK_VALID) == 0)
+            continue;
+
+        uint64_t rangeBase = x86_ReadMsr(MTRR_MSR_PHYSICAL_BASE(i));
+        uint64_t size = (~rangeMask & mask) + MTRR_PAGE_SIZE;
+        if ((size & (size - 1)) != 0 || (rangeMask & mask) != (mask & ~(size - 1)))
+            return MTRR_NOT_SUPPORTED_ERROR;
+
+        rangesOutput[count].base = rangeBase & mask & ~(size - 1);
+        rangesOutput[count].size = size;
+        rangesOutput[count].type = rangeBase & MTRR_BASE_TYPE;
+        ++count;
+    }
+
+    *countOutput = count;
+    return NO_ERROR;
+}
+
+// splits [base, end) into power of 2 sized ranges aligned to their size, biggest first, as many as needed
+static bool appendRanges(MTRR_Range *ranges, uint8_t *count, uint64_t base, uint64_t end, MTRR_MemoryType type) {
+    while (base < end) {
+        uint64_t size = MTRR_PAGE_SIZE;
+        while ((base & (size * 2 - 1)) == 0 && base + size * 2 <= end)
+            size *= 2;
+
+        if (*count == MTRR_MAX_VARIABLE_RANGES)
+            return false;
+        ranges[(*count)++] = (MTRR_Range){.base = base, .size = size, .type = type};
+        base += size;
+    }
+
+    return true;
+}
+
+// follows the sequence in the intel manual, with a single cpu there's nobody else to stop
+static void writeRanges(const MTRR_Range *ranges, uint8_t count) {
+    uint64_t mask = addressMask();
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    x86_DisableCaches();
+
+    uint64_t defaultType = x86_ReadMsr(MTRR_MSR_DEFAULT_TYPE);
+    x86_WriteMsr(MTRR_MSR_DEFAULT_TYPE, defaultType & ~(uint64_t)MTRR_DEFAULT_TYPE_ENABLE);
+
+    for (uint8_t i = 0; i < variableRangeCount(); ++i) {
+        if (i < count) {
+            x86_WriteMsr(MTRR_MSR_PHYSICAL_BASE(i), ranges[i].base | ranges[i].type);
+            x86_WriteMsr(MTRR_MSR_PHYSICAL_MASK(i), (mask & ~(ranges[i].size - 1)) | MTRR_MASK_VALID);
+        } else {
+            x86_WriteMsr(MTRR_MSR_PHYSICAL_MASK(i), 0);
+            x86_WriteMsr(MTRR_MSR_PHYSICAL_BASE(i), 0);
+        }
+    }
+
+    x86_WriteMsr(MTRR_MSR_DEFAULT_TYPE, defaultType | MTRR_DEFAULT_TYPE_ENABLE);
+
+    x86_EnableCaches();
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+// gives [base, base + size) the memory type, `base` and `size` are rounded out to whole pages
+// ranges that overlap it are split around it, because where ranges overlap uncacheable wins, and most other combinations are undefined
+// fails without changing anything if there aren't enough variable ranges for that
+int MTRR_SetMemoryType(uint64_t base, uint64_t size, MTRR_MemoryType type) {
+    if (size == 0)
+        return NO_ERROR;
+
+    if (!isSupported())
+        return MTRR_NOT_SUPPORTED_ERROR;
+    if (type == MTRR_TYPE_WRITE_COMBINING && (x86_ReadMsr(MTRR_MSR_CAPABILITIES) & MTRR_CAPABILITIES_WRITE_COMBINING) == 0)
+        return MTRR_NOT_SUPPORTED_ERROR;
+
+    uint64_t end = (base + size + MTRR_PAGE_SIZE - 1) & ~(uint64_t)(MTRR_PAGE_SIZE - 1);
+    base &= ~(uint64_t)(MTRR_PAGE_SIZE - 1);
+
+    MTRR_Range existing[MTRR_MAX_VARIABLE_RANGES];
+    uint8_t existingCount;
+    int status;
+    if ((status = readRanges(existing, &existingCount)) != NO_ERROR)
+        return status;
+
+    MTRR_Range ranges[MTRR_MAX_VARIABLE_RANGES];
+    uint8_t count = 0;
+    bool fits = true;
+    for (uint8_t i = 0; i < existingCount && fits; ++i) {
+        uint64_t existingEnd = existing[i].base + existing[i].size;
+        if (existingEnd <= base || existing[i].base >= end) {
+            fits = appendRanges(ranges, &count, existing[i].base, existingEnd, existing[i].type);
+            continue;
+        }
+
+        // the parts before and after the new range
+        if (existing[i].base < base)
+            fits = appendRanges(ranges, &count, existing[i].base, base, existing[i].type);
+        if (fits && existingEnd > end)
+            fits = appendRanges(ranges, &count, end, existingEnd, existing[i].type);
+    }
+    if (fits)
+        fits = appendRanges(ranges, &count, base, end, type);
+
+    if (!fits || count > variableRangeCount())
+        return MTRR_NO_FREE_RANGE_ERROR;
+
+    writeRanges(ranges, count);
+    return NO_ERROR;
+}
+
+// what the mtrrs make the memory at `address`, the fixed ranges for the first 1 MiB aren't looked at
+int MTRR_GetMemoryType(uint64_t address, MTRR_MemoryType *typeOutput) {
+    if (!isSupported())
+        return MTRR_NOT_SUPPORTED_ERROR;
+
+    uint64_t defaultType = x86_ReadMsr(MTRR_MSR_DEFAULT_TYPE);
+    if ((defaultType & MTRR_DEFAULT_TYPE_ENABLE) == 0) {
+        *typeOutput = MTRR_TYPE_UNCACHEABLE;
+        return NO_ERROR;
+    }
+
+    MTRR_Range ranges[MTRR_MAX_VARIABLE_RANGES];
+    uint8_t count;
+    int status;
+    if ((status = readRanges(ranges, &count)) != NO_ERROR)
+        return status;
+
+    bool matched = false;
+    MTRR_MemoryType type = defaultType & MTRR_DEFAULT_TYPE_TYPE;
+    for (uint8_t i = 0; i < count; ++i) {
+        if (address < ranges[i].base || address >= ranges[i].base + ranges[i].size)
+            continue;
+
+        // uncacheable wins over everything, write-through over write-back
+        if (!matched || ranges[i].type == MTRR_TYPE_UNCACHEABLE || (ranges[i].type == MTRR_TYPE_WRITE_THROUGH && type == MTRR_TYPE_WRITE_BACK))
+            type = ranges[i].type;
+        matched = true;
+    }
+
+    *typeOutput = type;
+    return NO_ERROR;
+}
+
+const char *MTRR_MemoryTypeName(MTRR_MemoryType type) {
+    switch (type) {
+    case MTRR_TYPE_UNCACHEABLE:
+        return "uncacheable";
+    case MTRR_TYPE_WRITE_COMBINING:
+        return "write-combining";
+    case MTRR_TYPE_WRITE_THROUGH:
+        return "write-through";
+    case MTRR_TYPE_WRITE_PROTECTED:
+        return "write-protected";
+    case MTRR_TYPE_WRITE_BACK:
+        return "write-back";
+    default:
+        return "unknown";
+    }
+}
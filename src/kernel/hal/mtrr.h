@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#define MTRR_PAGE_SIZE 0x1000      // mtrr ranges are made of whole pages
+#define MTRR_MAX_VARIABLE_RANGES 16 // more than any cpu has, the ones past this are left alone
+
+// as encoded in the mtrrs
+typedef enum {
+    MTRR_TYPE_UNCACHEABLE = 0,
+    MTRR_TYPE_WRITE_COMBINING = 1,
+    MTRR_TYPE_WRITE_THROUGH = 4,
+    MTRR_TYPE_WRITE_PROTECTED = 5,
+    MTRR_TYPE_WRITE_BACK = 6,
+} MTRR_MemoryType;
+
+int MTRR_SetMemoryType(uint64_t base, uint64_t size, MTRR_MemoryType type);
+int MTRR_GetMemoryType(uint64_t address, MTRR_MemoryType *typeOutput);
+const char *MTRR_MemoryTypeName(MTRR_MemoryType type);
@@ -0,0 +1,103 @@
+#include "log.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LOG_MASK (LOG_BUFFER_SIZE - 1)
+
+// the kernel runs on one cpu, so writers never run side by side, but one can interrupt another (printf in an irq handler)
+// every writer reserves its bytes by moving `g_Reserved`, copies them in, and the outermost writer to finish commits
+// everything reserved so far, readers only look at bytes before `g_Committed`
+static char g_Buffer[LOG_BUFFER_SIZE];
+static volatile uint32_t g_Reserved = 0;
+static volatile uint32_t g_Committed = 0;
+static volatile uint32_t g_Writers = 0; // writers that have reserved bytes but haven't finished copying them
+
+// the first position that hasn't been overwritten (or isn't being overwritten) yet
+static uint32_t oldestPosition(uint32_t reserved) {
+    return reserved - LOG_BUFFER_SIZE;
+}
+
+// true if `position` comes before `other`
+static bool isBefore(uint32_t position, uint32_t other) {
+    return (int32_t)(position - other) < 0;
+}
+
+static void commit() {
+    if (__atomic_sub_fetch(&g_Writers, 1, __ATOMIC_RELEASE) != 0)
+        return; // an interrupted writer is still copying, it commits once it's done
+
+    // a writer interrupting us here finishes before we continue, so everything reserved by now is written
+    uint32_t reserved = __atomic_load_n(&g_Reserved, __ATOMIC_ACQUIRE);
+    uint32_t committed = __atomic_load_n(&g_Committed, __ATOMIC_RELAXED);
+    while (isBefore(committed, reserved) && !__atomic_compare_exchange_n(&g_Committed, &committed, reserved, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+}
+
+// appends to the log without waiting for anything, safe to call from irq handlers
+void LOG_Write(const char *data, uint32_t length) {
+    if (length == 0)
+        return;
+    if (length > LOG_BUFFER_SIZE) {
+        // only the end would be left anyway
+        data += length - LOG_BUFFER_SIZE;
+        length = LOG_BUFFER_SIZE;
+    }
+
+    __atomic_add_fetch(&g_Writers, 1, __ATOMIC_ACQUIRE);
+    uint32_t start = __atomic_fetch_add(&g_Reserved, length, __ATOMIC_ACQ_REL);
+    for (uint32_t i = 0; i < length; ++i)
+        g_Buffer[(start + i) & LOG_MASK] = data[i];
+    commit();
+}
+
+// copies up to `size` committed bytes from `*position` on into `buffer`, and moves `*position` past them
+// if the bytes at `*position` were overwritten in the meantime, it skips ahead to the oldest ones that are left
+// returns how many bytes were copied, 0 once `*position` has caught up with the log
+uint32_t LOG_Read(uint32_t *position, char *buffer, uint32_t size) {
+    while (true) {
+        uint32_t committed = __atomic_load_n(&g_Committed, __ATOMIC_ACQUIRE);
+        uint32_t oldest = oldestPosition(__atomic_load_n(&g_Reserved, __ATOMIC_ACQUIRE));
+        if (isBefore(*position, oldest))
+            *position = oldest;
+        if (!isBefore(*position, committed))
+            return 0;
+
+        uint32_t count = committed - *position;
+        if (count > size)
+            count = size;
+        for (uint32_t i = 0; i < count; ++i)
+            buffer[i] = g_Buffer[(*position + i) & LOG_MASK];
+
+        // a writer may have wrapped around onto what we just copied, drop those bytes
+        oldest = oldestPosition(__atomic_load_n(&g_Reserved, __ATOMIC_ACQUIRE));
+        if (!isBefore(*position, oldest)) {
+            *position += count;
+            return count;
+        }
+
+        uint32_t overwritten = oldest - *position;
+        if (overwritten >= count) {
+            *position = oldest;
+            continue;
+        }
+
+        count -= overwritten;
+        for (uint32_t i = 0; i < count; ++i)
+            buffer[i] = buffer[i + overwritten];
+        *position = oldest + count;
+        return count;
+    }
+}
+
+// the end of everything committed so far
+uint32_t LOG_Position() {
+    return __atomic_load_n(&g_Committed, __ATOMIC_ACQUIRE);
+}
+
+// the start of what is still in the log, reading from here gives the early boot messages if nothing has pushed them out yet
+uint32_t LOG_OldestPosition() {
+    uint32_t reserved = __atomic_load_n(&g_Reserved, __ATOMIC_ACQUIRE);
+    if (reserved < LOG_BUFFER_SIZE)
+        return 0; // nothing has been overwritten yet
+    return oldestPosition(reserved);
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+#define LOG_BUFFER_SIZE (16 * 1024) // must be a power of 2, the oldest bytes are overwritten once it's full
+
+// positions count every byte ever logged and wrap around at 2^32, compare them with differences
+void LOG_Write(const char *data, uint32_t length);
+uint32_t LOG_Read(uint32_t *position, char *buffer, uint32_t size);
+uint32_t LOG_Position();
+uint32_t LOG_OldestPosition();
@@ -1,4 +1,5 @@
 #include "hal/hal.h"
+#include "hal/mtrr.h"
 #include "ps2/ps2.h"
 #include "visual/font.h"
 #include "visual/graphics.h"
@@ -7,14 +8,21 @@
 #include <lib/disk/ata.h>
 #include <lib/disk/disk.h>
 #include <lib/disk/fat.h>
+#include <lib/disk/mbr.h>
+#include <lib/disk/ramdisk.h>
 #include <lib/errors/errors.h>
 #include <lib/memory/allocator.h>
 #include <lib/memory/memdefs.h>
 #include <lib/memory/memdetect.h>
 #include <lib/memory/memory.h>
 #include <lib/time/pit.h>
+#include <lib/time/tsc.h>
 #include <stdint.h>
 
+#if CONSOLE_BENCHMARK == 1
+#include "benchmark/benchmark.h"
+#endif
+
 extern char __bss_start;
 extern char __bss_stop;
 
@@ -23,7 +31,9 @@ void start(uint8_t bootDrive,
            uint32_t memoryRegionsCount,
            uint32_t partitionLBA,
            uint32_t partitionSize,
-           VbeModeInfo *vbeModeInfo) {
+           VbeModeInfo *vbeModeInfo,
+           void *ramdiskImage,
+           uint32_t ramdiskSectorCount) {
     memset(&__bss_start, '\0', (&__bss_stop) - (&__bss_start));
 
     // in use bits already initialized by stage 2
@@ -41,11 +51,12 @@ void start(uint8_t bootDrive,
     }
 
     // initialize the font
-    if ((status = FONT_Initialize(vbeModeInfo, videoBuffer)) != NO_ERROR) {
+    if ((status = FONT_Initialize(vbeModeInfo)) != NO_ERROR) {
         printf("Failed to initialize the font! Status: %d\n", status); // the fallback font might still work, so it's worth a try to log the error
         return;
     }
     FONT_SetPixelScale(2);
+    setOutputBufferMode(OUTPUT_LINE_BUFFERED);
 
     if ((status = HAL_Initialize()) != NO_ERROR) {
         printf("Failed to initialize the HAL! Status: %d\n", status);
@@ -53,9 +64,26 @@ void start(uint8_t bootDrive,
     }
     puts("Initialized the HAL! (gdt, idt, isr, irq)\n");
 
+    // the framebuffer is usually uncacheable, which makes every push to it slow
+    // it's in a pci bar, which is a power of 2 aligned to its size, so rounding up to that still only covers video memory and takes fewer mtrrs
+    uint64_t framebufferSize = (uint64_t)vbeModeInfo->pitch * vbeModeInfo->virtualHeight;
+    uint64_t framebufferRangeSize = MTRR_PAGE_SIZE;
+    while (framebufferRangeSize < framebufferSize)
+        framebufferRangeSize *= 2;
+    if (vbeModeInfo->framebuffer % framebufferRangeSize != 0)
+        framebufferRangeSize = framebufferSize;
+    if ((status = MTRR_SetMemoryType(vbeModeInfo->framebuffer, framebufferRangeSize, MTRR_TYPE_WRITE_COMBINING)) != NO_ERROR)
+        printf("Failed to make the framebuffer write-combining! Status: %d\n", status);
+
+    MTRR_MemoryType framebufferType;
+    if (MTRR_GetMemoryType(vbeModeInfo->framebuffer, &framebufferType) == NO_ERROR)
+        printf("Framebuffer memory type: %s\n", MTRR_MemoryTypeName(framebufferType));
+
     PIT_Initialize();
     puts("Initialized the PIT driver!\n");
 
+    TSC_Initialize(); // the disk drivers time out with it, calibrating it now keeps the first disk access from taking longer
+
     if ((status = PS2_Initialize()) != NO_ERROR) {
         printf("Failed to initialize the PS2 driver! Status: %d\n", status);
         return;
@@ -63,21 +91,21 @@ void start(uint8_t bootDrive,
     puts("Initialized the PS2 driver!\n");
 
     // initialize disks
-    DISK masterDisk;
-    DISK slaveDisk;
-    DISK_InitializeResult diskInitializeResult;
-    if ((status = DISK_Initialize(&diskInitializeResult, &masterDisk, &slaveDisk)) != NO_ERROR) {
+    DISK disks[DISK_MAX_DISKS];
+    uint8_t diskCount;
+    if ((status = DISK_Initialize(disks, DISK_MAX_DISKS, &diskCount)) != NO_ERROR) {
         printf("Failed to initialize disks! Status: %d\n", status);
         return;
     }
-    if (!diskInitializeResult.initializedMasterDisk) {
-        puts("Failed to initialize master disk!\n");
+    // we boot from the first disk, the first ahci port or the primary master
+    if (diskCount == 0) {
+        puts("Failed to initialize boot disk!\n");
         return;
     }
-    puts("Initialized disks!\n");
+    printf("Initialized %hhu disk(s)!\n", diskCount);
 
     Partition bootPartition;
-    MBR_InitializePartition(&bootPartition, &masterDisk, partitionLBA, partitionSize);
+    MBR_InitializePartition(&bootPartition, &disks[0], partitionLBA, partitionSize);
     puts("Detected boot partition!\n");
 
     FAT_Filesystem *bootFilesystem = malloc(sizeof(FAT_Filesystem));
@@ -92,12 +120,47 @@ void start(uint8_t bootDrive,
     }
     puts("Initialized FAT!\n");
 
+    // the ram disk image was loaded by stage 2, it holds a fat filesystem without a partition table
+    FAT_Filesystem *ramdiskFilesystem = NULL;
+    Partition ramdiskPartition;
+    if (ramdiskImage != NULL && diskCount < DISK_MAX_DISKS) {
+        DISK *ramdisk = &disks[diskCount];
+        if ((status = RAMDISK_Initialize(ramdisk, ramdiskImage, ramdiskSectorCount)) != NO_ERROR) {
+            printf("Failed to initialize the ram disk! Status: %d\n", status);
+            return;
+        }
+        ++diskCount;
+
+        MBR_InitializePartition(&ramdiskPartition, ramdisk, 0, ramdiskSectorCount);
+        ramdiskFilesystem = malloc(sizeof(FAT_Filesystem));
+        if (ramdiskFilesystem == NULL) {
+            puts("Failed to allocate memory for the ram disk filesystem!\n");
+            return;
+        }
+        ramdiskFilesystem->partition = &ramdiskPartition;
+        if ((status = FAT_Initialize(ramdiskFilesystem)) != NO_ERROR) {
+            printf("Failed to mount the ram disk. Status: %d\n", status);
+            return;
+        }
+        puts("Mounted the ram disk!\n");
+    }
+
     // everything is now initialized
     clearScreen();
 
+#if CONSOLE_BENCHMARK == 1
+    BENCHMARK_RunConsole(bootFilesystem);
+#endif
+
     puts("Hello from kernel!\n");
 
     // deinitialize/free everything, technically not needed, but ill do it anyway for good measure
+    flushOutput();
     GRAPHICS_DeInitialize();
     FONT_DeInitialize();
+    free(ramdiskFilesystem);
+    for (uint8_t i = 0; i < diskCount; ++i) {
+        DISK_DumpStats(&disks[i], i);
+        DISK_DeInitialize(&disks[i]);
+    }
 }
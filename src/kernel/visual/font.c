@@ -1,5 +1,6 @@
 #include "font.h"
 #include "fallback_font.h"
+#include "glyphcache.h"
 #include "graphics.h"
 #include "rasterfont_sizes.h"
 #include "stdio.h"
@@ -12,16 +13,18 @@
 #include <lib/memory/allocator.h>
 #include <lib/memory/memdefs.h>
 #include <lib/memory/memory.h>
+#include <lib/x86/general.h>
 #include <stdbool.h>
 #include <stdint.h>
 
-#define FONT_READ_CHUNK_SIZE 0x1000
-#define FONT_MAX_CHARACTERS 0xFF
-
-static FONT_Character *g_ScreenCharacterBuffer = NULL;
-static void *g_VideoBuffer = NULL;
+static FONT_Character *g_ScreenCharacterBuffer = NULL; // what should be on the screen
+static FONT_Character *g_ShownCharacterBuffer = NULL;  // what is drawn in the video buffer, the cells that differ are drawn by the next render
+static bool *g_DamagedRows = NULL;                     // rows that may have cells that differ, the others aren't compared
 static VbeModeInfo *g_VbeModeInfo = NULL;
-static uint8_t *g_FontBits = NULL;
+static uint8_t *g_FontFile = NULL; // the loaded font file, NULL for the fallback font
+static uint8_t *g_FontBits = NULL; // `g_FontGlyphCount` glyphs, each `height` rows of `g_FontStride` bytes
+static uint16_t g_FontGlyphCount = 0;
+static uint16_t g_FontStride = 0;
 static const FONT_FontInfo *g_FontInfo = NULL;
 static uint16_t g_FontPixelScale = 1;
 
@@ -32,28 +35,165 @@ void ensureFontInfoSet() {
     // no font loaded
     g_FontInfo = &FALLBACK_FONT_INFO;
     g_FontBits = FALLBACK_FONT_8x8;
+    g_FontStride = 1;
+    g_FontGlyphCount = sizeof(FALLBACK_FONT_8x8) / FALLBACK_FONT_INFO.height;
 }
 
 void FONT_DeInitialize() {
-    if (g_ScreenCharacterBuffer != NULL) {
-        free(g_ScreenCharacterBuffer);
-        g_ScreenCharacterBuffer = NULL;
+    GLYPHCACHE_DeInitialize();
+
+    GRAPHICS_SetRenderHandler(NULL);
+
+    free(g_ScreenCharacterBuffer);
+    free(g_ShownCharacterBuffer);
+    free(g_DamagedRows);
+    g_ScreenCharacterBuffer = NULL;
+    g_ShownCharacterBuffer = NULL;
+    g_DamagedRows = NULL;
+
+    // the fallback font is set again if anything is drawn after this
+    free(g_FontFile);
+    g_FontFile = NULL;
+    g_FontBits = NULL;
+    g_FontInfo = NULL;
+}
+
+static uint16_t gridWidth(const FONT_FontInfo *fontInfo) {
+    return (g_VbeModeInfo->width / fontInfo->width) / g_FontPixelScale;
+}
+
+static uint16_t gridHeight(const FONT_FontInfo *fontInfo) {
+    return (g_VbeModeInfo->height / fontInfo->height) / g_FontPixelScale;
+}
+
+// every cell starts out empty, which is what a cleared screen shows
+static int allocateGrids(uint16_t width, uint16_t height, FONT_Character **screenOutput, FONT_Character **shownOutput, bool **damagedRowsOutput) {
+    *screenOutput = calloc(width * height, sizeof(FONT_Character));
+    *shownOutput = calloc(width * height, sizeof(FONT_Character));
+    *damagedRowsOutput = calloc(height, sizeof(bool));
+    if (*screenOutput == NULL || *shownOutput == NULL || *damagedRowsOutput == NULL) {
+        free(*screenOutput);
+        free(*shownOutput);
+        free(*damagedRowsOutput);
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
     }
 
-    if (g_FontBits != NULL) {
-        free(g_FontBits);
-        g_FontBits = NULL;
+    return NO_ERROR;
+}
+
+static inline bool isBlank(FONT_Character character) {
+    return character.typed.character == '\0' || character.typed.character == ' ';
+}
+
+// blank cells are just background whatever their color is
+static inline bool cellsLookSame(FONT_Character a, FONT_Character b) {
+    return a.data == b.data || (isBlank(a) && isBlank(b));
+}
+
+// bytes of a glyph expanded with the current font and scale
+static uint32_t glyphBytes() {
+    return (uint32_t)g_FontInfo->width * g_FontPixelScale * g_FontInfo->height * g_FontPixelScale * GRAPHICS_BytesPerPixel();
+}
+
+// sets the glyph cache up for the current font and scale, the cached glyphs are dropped either way
+// this allocates, so it's done whenever the font or the scale changes rather than by the render handler, which may run after any irq
+// must be called with interrupts disabled, so no render sees the cache half set up
+static void setUpGlyphCache() {
+    if (GLYPHCACHE_GlyphBytes() == glyphBytes())
+        GLYPHCACHE_Clear();
+    else
+        GLYPHCACHE_Initialize(glyphBytes()); // without a cache every glyph is just expanded straight to the screen
+}
+
+static void drawCell(uint16_t x, uint16_t y, FONT_Character character) {
+    uint16_t pixelX = x * g_FontInfo->width * g_FontPixelScale;
+    uint16_t pixelY = y * g_FontInfo->height * g_FontPixelScale;
+    uint16_t pixelWidth = g_FontInfo->width * g_FontPixelScale;
+    uint16_t pixelHeight = g_FontInfo->height * g_FontPixelScale;
+    uint8_t glyphIndex = (uint8_t)character.typed.character < g_FontGlyphCount ? (uint8_t)character.typed.character : 0; // glyph 0 is always empty
+    const uint8_t *glyph = g_FontBits + (uint32_t)glyphIndex * g_FontStride * g_FontInfo->height;
+    uint32_t foreground = GRAPHICS_PackColor(character.typed.r, character.typed.g, character.typed.b);
+    uint32_t background = GRAPHICS_PackColor(0, 0, 0);
+
+    // the background is always black, so it isn't part of the key
+    // the cache is only used if it could be set up for this glyph size
+    bool hit;
+    uint8_t *pixels = NULL;
+    if (GLYPHCACHE_GlyphBytes() == glyphBytes())
+        pixels = GLYPHCACHE_Find(character.typed.character, foreground, g_FontPixelScale, &hit);
+    if (pixels == NULL) {
+        GRAPHICS_BlitGlyph(pixelX, pixelY, glyph, g_FontStride, g_FontInfo->width, g_FontInfo->height, g_FontPixelScale, foreground, background);
+    } else {
+        if (!hit)
+            GRAPHICS_ExpandGlyph(pixels, glyph, g_FontStride, g_FontInfo->width, g_FontInfo->height, g_FontPixelScale, foreground, background);
+        GRAPHICS_BlitImage(pixelX, pixelY, pixels, pixelWidth, pixelHeight);
     }
 }
 
-int FONT_Initialize(VbeModeInfo *vbeModeInfo, void *videoBuffer) {
+// the render handler, draws the cells of the damaged rows that differ from what is shown
+// each run of changed cells in a row is marked as one dirty rectangle, so it's pushed to the screen in one go
+// it's only called by GRAPHICS_Flush, which never runs it twice at once, but a flush may run after any irq, in the middle of anything that has interrupts enabled
+// so it must not allocate or free anything
+static void renderCells() {
+    if (g_ScreenCharacterBuffer == NULL)
+        return;
+
+    uint16_t width = FONT_ScreenCharacterWidth();
+    uint16_t height = FONT_ScreenCharacterHeight();
+
+    for (uint16_t y = 0; y < height; ++y) {
+        if (!g_DamagedRows[y])
+            continue;
+        g_DamagedRows[y] = false;
+
+        FONT_Character *screenRow = &g_ScreenCharacterBuffer[y * width];
+        FONT_Character *shownRow = &g_ShownCharacterBuffer[y * width];
+        for (uint16_t x = 0; x < width;) {
+            if (cellsLookSame(screenRow[x], shownRow[x])) {
+                ++x;
+                continue;
+            }
+
+            uint16_t runStart = x;
+            for (; x < width && !cellsLookSame(screenRow[x], shownRow[x]); ++x) {
+                FONT_Character character = screenRow[x];
+                drawCell(x, y, character);
+                shownRow[x] = character;
+            }
+
+            GRAPHICS_MarkDirtyRectangleScale(runStart * g_FontInfo->width, y * g_FontInfo->height, (x - runStart) * g_FontInfo->width, g_FontInfo->height, g_FontPixelScale);
+        }
+    }
+}
+
+// must be called with interrupts disabled
+static void damageAllRows() {
+    for (uint16_t y = 0; y < FONT_ScreenCharacterHeight(); ++y)
+        g_DamagedRows[y] = true;
+    GRAPHICS_RequestRender();
+}
+
+// clears the video buffer, so every cell that isn't blank is drawn by the next render, must be called with interrupts disabled
+static void redrawAllCells() {
+    GRAPHICS_ClearScreen();
+    memset(g_ShownCharacterBuffer, 0, FONT_ScreenCharacterWidth() * FONT_ScreenCharacterHeight() * sizeof(FONT_Character));
+    damageAllRows();
+}
+
+int FONT_Initialize(VbeModeInfo *vbeModeInfo) {
     g_VbeModeInfo = vbeModeInfo;
-    g_VideoBuffer = videoBuffer;
 
     ensureFontInfoSet();
 
-    if ((g_ScreenCharacterBuffer = calloc(FONT_ScreenCharacterWidth() * FONT_ScreenCharacterHeight(), sizeof(FONT_Character))) == NULL)
-        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+    int status;
+    if ((status = allocateGrids(FONT_ScreenCharacterWidth(), FONT_ScreenCharacterHeight(), &g_ScreenCharacterBuffer, &g_ShownCharacterBuffer, &g_DamagedRows)) != NO_ERROR)
+        return status;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    setUpGlyphCache();
+    x86_RestoreInterrupts(interruptsEnabled);
+
+    GRAPHICS_SetRenderHandler(renderCells);
 
     return NO_ERROR;
 }
@@ -71,11 +211,18 @@ const FONT_FontInfo *FONT_FindFontInfo(const char *filename, int16_t width, int1
     return NULL;
 }
 
-int readFont(FAT_Filesystem *fontsFilesystem) {
+static bool isValidFontFile(const FONT_FileHeader *header, const FONT_FontInfo *fontInfo, uint32_t fileSize) {
+    return header->magic == FONT_FILE_MAGIC && header->headerSize >= sizeof(FONT_FileHeader) && header->width == fontInfo->width && header->height == fontInfo->height && header->glyphCount > 0 &&
+           header->stride >= DIV_ROUND_UP(header->width, 8) && header->headerSize + (uint32_t)header->glyphCount * header->stride * header->height <= fileSize;
+}
+
+// reads the whole font file in one go, and checks that its header matches `fontInfo`
+// !!! YOU ARE RESPONSIBLE FOR FREEING `fileOutput` !!!
+int readFont(FAT_Filesystem *fontsFilesystem, const FONT_FontInfo *fontInfo, uint8_t **fileOutput) {
     char fontPath[6 + 10 + 1] = {0}; // 6 for "fonts/", 10 for filename, 1 for null terminator = 17
     strcpy(fontPath, "fonts/");
-    strcpy(fontPath + strlen("fonts/"), g_FontInfo->filename);
-    fontPath[strlen("fonts/") + strlen(g_FontInfo->filename)] = '\0';
+    strcpy(fontPath + strlen("fonts/"), fontInfo->filename);
+    fontPath[strlen("fonts/") + strlen(fontInfo->filename)] = '\0';
 
     FAT_File *fontFd;
     int status;
@@ -83,19 +230,37 @@ int readFont(FAT_Filesystem *fontsFilesystem) {
     if ((status = FAT_Open(fontsFilesystem, fontPath, &fontFd)) != NO_ERROR)
         return status;
 
-    uint8_t *fontBuffer = g_FontBits;
+    uint8_t *file = NULL;
     uint32_t readCount;
-    while ((status = FAT_Read(fontsFilesystem, fontFd, FONT_READ_CHUNK_SIZE, &readCount, fontBuffer)) == NO_ERROR && readCount == FONT_READ_CHUNK_SIZE)
-        fontBuffer += readCount;
+    if (fontFd->size < sizeof(FONT_FileHeader)) {
+        status = FONT_INVALID_FILE_ERROR;
+        goto close_file;
+    }
+    if ((file = malloc(fontFd->size)) == NULL) {
+        status = FAILED_TO_ALLOCATE_MEMORY_ERROR;
+        goto close_file;
+    }
+    if ((status = FAT_Read(fontsFilesystem, fontFd, fontFd->size, &readCount, file)) != NO_ERROR)
+        goto close_file;
 
-    if (status != NO_ERROR)
-        return status;
+    if (readCount != fontFd->size || !isValidFontFile((const FONT_FileHeader *)file, fontInfo, readCount))
+        status = FONT_INVALID_FILE_ERROR;
 
+close_file:
     FAT_Close(fontsFilesystem, fontFd); // we'll ignore errors here
 
+    if (status != NO_ERROR) {
+        free(file);
+        return status;
+    }
+
+    *fileOutput = file;
     return NO_ERROR;
 }
 
+// the font is loaded before anything is switched over, so the screen keeps working if that fails
+// the text is kept, if the screen fits less of it the bottom lines are kept
+// the old grid is copied with interrupts enabled, so nothing may write to it meanwhile, the console switches through setFont for that
 int FONT_SetFont(FAT_Filesystem *fontsFilesystem, const FONT_FontInfo *fontInfo, bool reDraw) {
     if (fontInfo == g_FontInfo)
         return NO_ERROR;
@@ -103,69 +268,87 @@ int FONT_SetFont(FAT_Filesystem *fontsFilesystem, const FONT_FontInfo *fontInfo,
     if (fontsFilesystem == NULL || fontInfo == NULL)
         return NULL_ERROR;
 
-    // backup old fontinfo
-    size_t oldScreenCharacterBufferSize = FONT_ScreenCharacterWidth() * FONT_ScreenCharacterHeight() * sizeof(FONT_Character);
-    const FONT_FontInfo *oldFontInfo = g_FontInfo;
-    uint8_t *oldFontBits = g_FontBits;
-    FONT_Character *oldScreenCharacterBuffer = g_ScreenCharacterBuffer;
-
-    g_FontInfo = fontInfo;
-
-    if ((g_FontBits = malloc(DIV_ROUND_UP(g_FontInfo->height * g_FontInfo->width, 8) * FONT_MAX_CHARACTERS)) == NULL) {
-        g_FontInfo = oldFontInfo;
-        g_FontBits = oldFontBits;
-        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
-    }
-
-    // possibly restore old fontinfo
+    uint8_t *fontFile;
     int status;
-    if ((status = readFont(fontsFilesystem)) != NO_ERROR) {
-        g_FontInfo = oldFontInfo;
-        g_FontBits = oldFontBits;
+    if ((status = readFont(fontsFilesystem, fontInfo, &fontFile)) != NO_ERROR)
         return status;
-    }
+    const FONT_FileHeader *header = (const FONT_FileHeader *)fontFile;
 
-    if (oldFontBits != FALLBACK_FONT_8x8)
-        free(oldFontBits);
+    uint16_t oldWidth = FONT_ScreenCharacterWidth();
+    uint16_t oldHeight = FONT_ScreenCharacterHeight();
+    uint16_t width = gridWidth(fontInfo);
+    uint16_t height = gridHeight(fontInfo);
 
-    if (reDraw) {
-        GRAPHICS_ClearScreen();
-        for (uint16_t y = 0; y < FONT_ScreenCharacterHeight(); ++y)
-            for (uint16_t x = 0; x < FONT_ScreenCharacterWidth(); ++x)
-                FONT_DrawCharacter(x, y, g_ScreenCharacterBuffer[(y * FONT_ScreenCharacterWidth()) + x]);
+    FONT_Character *screenCharacterBuffer, *shownCharacterBuffer;
+    bool *damagedRows;
+    if ((status = allocateGrids(width, height, &screenCharacterBuffer, &shownCharacterBuffer, &damagedRows)) != NO_ERROR) {
+        free(fontFile);
+        return status;
     }
 
-    size_t screenCharacterBufferEntries = FONT_ScreenCharacterWidth() * FONT_ScreenCharacterHeight();
-    size_t screenCharacterBufferSize = screenCharacterBufferEntries * sizeof(FONT_Character);
-    g_ScreenCharacterBuffer = calloc(screenCharacterBufferEntries, sizeof(FONT_Character));
-    if (g_ScreenCharacterBuffer == NULL) {
-        g_FontInfo = oldFontInfo;
-        g_FontBits = oldFontBits;
-        g_ScreenCharacterBuffer = oldScreenCharacterBuffer;
-        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
-    }
+    uint16_t copiedWidth = min(oldWidth, width);
+    uint16_t copiedHeight = min(oldHeight, height);
+    for (uint16_t y = 0; y < copiedHeight; ++y)
+        memcpy(&screenCharacterBuffer[y * width], &g_ScreenCharacterBuffer[(oldHeight - copiedHeight + y) * oldWidth], copiedWidth * sizeof(FONT_Character));
 
-    if (oldScreenCharacterBufferSize > screenCharacterBufferSize)
-        memcpy(g_ScreenCharacterBuffer, ((void *)oldScreenCharacterBuffer) + (oldScreenCharacterBufferSize - screenCharacterBufferSize), min(oldScreenCharacterBufferSize, screenCharacterBufferSize));
+    uint8_t *oldFontFile = g_FontFile;
+    FONT_Character *oldScreenCharacterBuffer = g_ScreenCharacterBuffer;
+    FONT_Character *oldShownCharacterBuffer = g_ShownCharacterBuffer;
+    bool *oldDamagedRows = g_DamagedRows;
+
+    // so the timer doesn't render with half of it switched
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    g_FontInfo = fontInfo;
+    g_FontFile = fontFile;
+    g_FontBits = fontFile + header->headerSize;
+    g_FontGlyphCount = header->glyphCount;
+    g_FontStride = header->stride;
+    g_ScreenCharacterBuffer = screenCharacterBuffer;
+    g_ShownCharacterBuffer = shownCharacterBuffer;
+    g_DamagedRows = damagedRows;
+
+    // the cached glyphs were drawn with the old font
+    setUpGlyphCache();
+
+    if (reDraw)
+        redrawAllCells();
     else
-        memcpy(g_ScreenCharacterBuffer, oldScreenCharacterBuffer, min(oldScreenCharacterBufferSize, screenCharacterBufferSize));
+        memcpy(g_ShownCharacterBuffer, g_ScreenCharacterBuffer, width * height * sizeof(FONT_Character)); // the screen is left as it is
+    x86_RestoreInterrupts(interruptsEnabled);
+
+    free(oldFontFile);
     free(oldScreenCharacterBuffer);
+    free(oldShownCharacterBuffer);
+    free(oldDamagedRows);
+
+    if (reDraw)
+        GRAPHICS_Flush();
 
     return NO_ERROR;
 }
 
 // next 2 functions are because i dont really understand variable sharing across files in c
+// the cells move with the scale, so the screen is cleared and drawn again
 void FONT_SetPixelScale(uint16_t scale) {
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
     g_FontPixelScale = scale;
+    if (g_ScreenCharacterBuffer != NULL) {
+        setUpGlyphCache();
+        redrawAllCells();
+    }
+    x86_RestoreInterrupts(interruptsEnabled);
 }
 
 uint16_t FONT_GetPixelScale() {
     return g_FontPixelScale;
 }
 
+// the cell is drawn by the next flush, only if it looks different from what is shown there
 void FONT_SetCharacter(uint16_t x, uint16_t y, FONT_Character character) {
     ensureFontInfoSet();
     g_ScreenCharacterBuffer[(y * FONT_ScreenCharacterWidth()) + x] = character;
+    g_DamagedRows[y] = true;
+    GRAPHICS_RequestRender();
 }
 
 FONT_Character FONT_GetCharacter(uint16_t x, uint16_t y) {
@@ -173,52 +356,64 @@ FONT_Character FONT_GetCharacter(uint16_t x, uint16_t y) {
     return g_ScreenCharacterBuffer[(y * FONT_ScreenCharacterWidth()) + x];
 }
 
+// both grids move up with the pixels, so the lines that are still on the screen aren't drawn again
 void FONT_ScrollBack(uint16_t lineCount) {
     if (lineCount == 0)
         return;
 
-    size_t offset = g_VbeModeInfo->pitch * g_FontInfo->height * lineCount * g_FontPixelScale;
-    size_t memoryToCopy = g_VbeModeInfo->pitch * g_VbeModeInfo->height - offset;
+    uint16_t width = FONT_ScreenCharacterWidth();
+    uint16_t height = FONT_ScreenCharacterHeight();
+    lineCount = min(lineCount, height);
+    size_t rowSize = width * sizeof(FONT_Character);
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // so the timer doesn't render between moving the grids and the pixels
+
+    // a row at a time, so the copies don't overlap
+    for (uint16_t y = 0; y < height - lineCount; ++y) {
+        memcpy(&g_ScreenCharacterBuffer[y * width], &g_ScreenCharacterBuffer[(y + lineCount) * width], rowSize);
+        memcpy(&g_ShownCharacterBuffer[y * width], &g_ShownCharacterBuffer[(y + lineCount) * width], rowSize);
+        g_DamagedRows[y] = g_DamagedRows[y + lineCount];
+    }
+    for (uint16_t y = height - lineCount; y < height; ++y) {
+        memset(&g_ScreenCharacterBuffer[y * width], 0, rowSize);
+        memset(&g_ShownCharacterBuffer[y * width], 0, rowSize);
+        g_DamagedRows[y] = false;
+    }
 
-    memcpy(g_VideoBuffer, g_VideoBuffer + offset, memoryToCopy);
-    memset(g_VideoBuffer + (FONT_ScreenCharacterHeight() * g_FontInfo->height * g_FontPixelScale * g_VbeModeInfo->pitch) - offset, 0, offset);
+    // the video buffer is a ring, so this only moves its origin
+    GRAPHICS_Scroll(g_FontInfo->height * g_FontPixelScale * lineCount);
 
-    GRAPHICS_PushBuffer();
+    x86_RestoreInterrupts(interruptsEnabled);
 }
 
-void FONT_DrawCharacter(uint16_t x, uint16_t y, FONT_Character character) {
+// empties every cell and the video buffer, nothing has to be drawn afterwards
+void FONT_ClearScreen() {
     ensureFontInfoSet();
 
-    FONT_SetCharacter(x, y, character);
+    size_t gridSize = FONT_ScreenCharacterWidth() * FONT_ScreenCharacterHeight() * sizeof(FONT_Character);
 
-    uint32_t characterBitIndex = character.typed.character * g_FontInfo->width * g_FontInfo->height;
-    for (uint8_t img_x = 0; img_x < g_FontInfo->width; ++img_x) {
-        for (uint8_t img_y = 0; img_y < g_FontInfo->height; ++img_y) {
-            uint32_t relativeBitIndex = img_y * g_FontInfo->width + img_x;
-            uint32_t absoluteBitIndex = characterBitIndex + relativeBitIndex;
-            uint32_t absoluteByteIndex = absoluteBitIndex / 8;
-            uint32_t byteBitIndex = 7 - absoluteBitIndex % 8;
-
-            if (g_FontBits[absoluteByteIndex] & (1 << byteBitIndex))
-                GRAPHICS_WriteScalePixel((x * g_FontInfo->width) + img_x, (y * g_FontInfo->height) + img_y, character.typed.r, character.typed.g, character.typed.b, g_FontPixelScale);
-            else
-                GRAPHICS_WriteScalePixel((x * g_FontInfo->width) + img_x, (y * g_FontInfo->height) + img_y, 0, 0, 0, g_FontPixelScale);
-        }
-    }
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    memset(g_ScreenCharacterBuffer, 0, gridSize);
+    memset(g_ShownCharacterBuffer, 0, gridSize);
+    memset(g_DamagedRows, 0, FONT_ScreenCharacterHeight() * sizeof(bool));
+    GRAPHICS_ClearScreen();
+    x86_RestoreInterrupts(interruptsEnabled);
+}
 
-    GRAPHICS_PushBufferRectangleScale(x * g_FontInfo->width, y * g_FontInfo->height, g_FontInfo->width, g_FontInfo->height, g_FontPixelScale);
+void FONT_DrawCharacter(uint16_t x, uint16_t y, FONT_Character character) {
+    FONT_SetCharacter(x, y, character);
 }
 
 // returns the number of characters that can fit on the screen horizontally
 uint16_t FONT_ScreenCharacterWidth() {
     ensureFontInfoSet();
 
-    return (g_VbeModeInfo->width / g_FontInfo->width) / g_FontPixelScale;
+    return gridWidth(g_FontInfo);
 }
 
 // returns the number of characters that can fit on the screen vertically
 uint16_t FONT_ScreenCharacterHeight() {
     ensureFontInfoSet();
 
-    return (g_VbeModeInfo->height / g_FontInfo->height) / g_FontPixelScale;
+    return gridHeight(g_FontInfo);
 }
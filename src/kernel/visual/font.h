@@ -19,6 +19,19 @@ typedef union {
     } typed;
 } FONT_Character;
 
+#define FONT_FILE_MAGIC 0x544E4F46 // "FONT"
+
+// at the start of every font file, the glyphs follow it, glyph n is `height` rows of `stride` bytes at headerSize + n * stride * height
+// every row starts on a byte boundary, the bits are msb first and past `width` they're padding
+typedef struct {
+    uint32_t magic;
+    uint16_t headerSize; // the glyphs start here, so fields can be added
+    uint8_t width;
+    uint8_t height;
+    uint16_t glyphCount;
+    uint16_t stride; // bytes per glyph row
+} __attribute__((packed)) FONT_FileHeader;
+
 typedef struct {
     const char filename[11];
     uint8_t width;
@@ -26,10 +39,11 @@ typedef struct {
 } FONT_FontInfo;
 
 void FONT_DeInitialize();
-int FONT_Initialize(VbeModeInfo *vbeModeInfo, void *videoBuffer);
+int FONT_Initialize(VbeModeInfo *vbeModeInfo);
 const FONT_FontInfo *FONT_FindFontInfo(const char *filename, int16_t width, int16_t height);
 int FONT_SetFont(FAT_Filesystem *fontsFilesystem, const FONT_FontInfo *fontInfo, bool reDraw);
 void FONT_DrawCharacter(uint16_t x, uint16_t y, FONT_Character character);
+void FONT_ClearScreen();
 void FONT_ScrollBack(uint16_t lineCount);
 uint16_t FONT_ScreenCharacterWidth();
 uint16_t FONT_ScreenCharacterHeight();
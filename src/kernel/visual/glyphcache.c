@@ -0,0 +1,153 @@
+#include "glyphcache.h"
+#include <lib/algorithm/math.h>
+#include <lib/errors/errors.h>
+#include <lib/memory/allocator.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct GLYPHCACHE_Entry {
+    // the key, the pixel format is the same for every entry since it's fixed once the graphics are initialized
+    uint8_t character;
+    uint32_t foreground;
+    uint16_t scale;
+
+    bool used;
+    uint8_t *pixels;
+    struct GLYPHCACHE_Entry *hashNext;
+    struct GLYPHCACHE_Entry *lruPrevious; // towards the most recently used entry
+    struct GLYPHCACHE_Entry *lruNext;     // towards the least recently used entry
+} GLYPHCACHE_Entry;
+
+static GLYPHCACHE_Entry *g_Entries = NULL;
+static uint8_t *g_Pixels = NULL;
+static uint32_t g_EntryCount = 0;
+static uint32_t g_GlyphBytes = 0;
+static GLYPHCACHE_Entry *g_Buckets[GLYPHCACHE_BUCKETS];
+static GLYPHCACHE_Entry *g_MostRecentlyUsed = NULL;
+static GLYPHCACHE_Entry *g_LeastRecentlyUsed = NULL;
+
+static uint32_t hashKey(uint8_t character, uint32_t foreground, uint16_t scale) {
+    uint32_t hash = character * 0x9E3779B1u ^ foreground * 0x85EBCA77u ^ scale;
+    return (hash ^ (hash >> 16)) & (GLYPHCACHE_BUCKETS - 1);
+}
+
+static void unlinkLru(GLYPHCACHE_Entry *entry) {
+    if (entry->lruPrevious != NULL)
+        entry->lruPrevious->lruNext = entry->lruNext;
+    else
+        g_MostRecentlyUsed = entry->lruNext;
+
+    if (entry->lruNext != NULL)
+        entry->lruNext->lruPrevious = entry->lruPrevious;
+    else
+        g_LeastRecentlyUsed = entry->lruPrevious;
+}
+
+static void pushLru(GLYPHCACHE_Entry *entry) {
+    entry->lruPrevious = NULL;
+    entry->lruNext = g_MostRecentlyUsed;
+    if (g_MostRecentlyUsed != NULL)
+        g_MostRecentlyUsed->lruPrevious = entry;
+    g_MostRecentlyUsed = entry;
+
+    if (g_LeastRecentlyUsed == NULL)
+        g_LeastRecentlyUsed = entry;
+}
+
+static void unlinkHash(GLYPHCACHE_Entry *entry) {
+    GLYPHCACHE_Entry **link = &g_Buckets[hashKey(entry->character, entry->foreground, entry->scale)];
+    while (*link != entry)
+        link = &(*link)->hashNext;
+    *link = entry->hashNext;
+}
+
+// forgets every glyph, the memory stays allocated
+void GLYPHCACHE_Clear() {
+    for (uint32_t i = 0; i < GLYPHCACHE_BUCKETS; ++i)
+        g_Buckets[i] = NULL;
+
+    // every entry starts out unused on the lru list, so the unused ones are evicted first
+    g_MostRecentlyUsed = NULL;
+    g_LeastRecentlyUsed = NULL;
+    for (uint32_t i = 0; i < g_EntryCount; ++i) {
+        g_Entries[i].used = false;
+        pushLru(&g_Entries[i]);
+    }
+}
+
+void GLYPHCACHE_DeInitialize() {
+    free(g_Entries);
+    free(g_Pixels);
+    g_Entries = NULL;
+    g_Pixels = NULL;
+    g_EntryCount = 0;
+    g_GlyphBytes = 0;
+    GLYPHCACHE_Clear();
+}
+
+// allocates as many entries of `glyphBytes` as fit in the budget, any old entries are dropped
+int GLYPHCACHE_Initialize(uint32_t glyphBytes) {
+    GLYPHCACHE_DeInitialize();
+
+    if (glyphBytes == 0)
+        return NULL_ERROR;
+
+    uint32_t entryCount = min(GLYPHCACHE_MEMORY_BUDGET / glyphBytes, GLYPHCACHE_MAX_ENTRIES);
+    if (entryCount == 0)
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR; // a single glyph is over the budget
+
+    g_Entries = calloc(entryCount, sizeof(GLYPHCACHE_Entry));
+    g_Pixels = malloc(entryCount * glyphBytes);
+    if (g_Entries == NULL || g_Pixels == NULL) {
+        GLYPHCACHE_DeInitialize();
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+    }
+
+    for (uint32_t i = 0; i < entryCount; ++i)
+        g_Entries[i].pixels = g_Pixels + i * glyphBytes;
+    g_EntryCount = entryCount;
+    g_GlyphBytes = glyphBytes;
+    GLYPHCACHE_Clear();
+
+    return NO_ERROR;
+}
+
+// 0 if the cache isn't set up
+uint32_t GLYPHCACHE_GlyphBytes() {
+    return g_GlyphBytes;
+}
+
+// returns the pixels of the glyph, `*hitOutput` is false if they have to be drawn first
+// on a miss the least recently used glyph is evicted to make room, NULL is only returned if the cache isn't set up
+uint8_t *GLYPHCACHE_Find(uint8_t character, uint32_t foreground, uint16_t scale, bool *hitOutput) {
+    if (g_EntryCount == 0)
+        return NULL;
+
+    GLYPHCACHE_Entry **bucket = &g_Buckets[hashKey(character, foreground, scale)];
+    for (GLYPHCACHE_Entry *entry = *bucket; entry != NULL; entry = entry->hashNext) {
+        if (entry->character != character || entry->foreground != foreground || entry->scale != scale)
+            continue;
+
+        unlinkLru(entry);
+        pushLru(entry);
+        *hitOutput = true;
+        return entry->pixels;
+    }
+
+    GLYPHCACHE_Entry *entry = g_LeastRecentlyUsed;
+    unlinkLru(entry);
+    if (entry->used)
+        unlinkHash(entry);
+
+    entry->character = character;
+    entry->foreground = foreground;
+    entry->scale = scale;
+    entry->used = true;
+    entry->hashNext = *bucket;
+    *bucket = entry;
+    pushLru(entry);
+
+    *hitOutput = false;
+    return entry->pixels;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GLYPHCACHE_MEMORY_BUDGET (512 * 1024) // bytes of expanded glyph pixels kept around at most
+#define GLYPHCACHE_MAX_ENTRIES 512
+#define GLYPHCACHE_BUCKETS 128 // must be a power of 2
+
+// expanded glyphs in the pixel format of the mode, rows right after each other, ready for GRAPHICS_BlitImage
+// every entry has the same size, the cache is set up again whenever that changes (new font or pixel scale)
+int GLYPHCACHE_Initialize(uint32_t glyphBytes);
+void GLYPHCACHE_DeInitialize();
+void GLYPHCACHE_Clear();
+uint32_t GLYPHCACHE_GlyphBytes();
+uint8_t *GLYPHCACHE_Find(uint8_t character, uint32_t foreground, uint16_t scale, bool *hitOutput);
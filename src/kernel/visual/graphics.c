@@ -1,40 +1,471 @@
 #include "graphics.h"
 #include "vbe.h"
+#include <lib/algorithm/math.h>
 #include <lib/errors/errors.h>
+#include <lib/interrupt/irq/irq.h>
 #include <lib/memory/allocator.h>
 #include <lib/memory/memdefs.h>
 #include <lib/memory/memory.h>
+#include <lib/time/pit.h>
+#include <lib/x86/general.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+// routines for one pixel format, picked by GRAPHICS_Initialize so nothing has to look at the mode info per pixel
+typedef struct {
+    uint8_t bytesPerPixel;
+    void (*fillSpan)(uint8_t *destination, uint32_t color, uint16_t count);
+    void (*copySpan)(uint8_t *destination, const uint8_t *source, uint16_t count);
+    // expands the first `width` bits (msb first) of the glyph row `bits` to `width` * `scale` pixels
+    void (*glyphSpan)(uint8_t *destination, const uint8_t *bits, uint8_t width, uint16_t scale, uint32_t foreground, uint32_t background);
+    // nearest neighbour, pixel i is source pixel (`position` + i * `step`) >> 16, so both are 16.16 fixed point
+    void (*scaleSpan)(uint8_t *destination, const uint8_t *source, uint16_t count, uint32_t position, uint32_t step);
+} GRAPHICS_Blitter;
 
 static VbeModeInfo *g_VbeModeInfo = NULL;
 static void *g_VideoBuffer = NULL;
+static uint16_t g_OriginY = 0; // the video buffer is circular in y, this is the buffer row shown at the top of the screen
+static const GRAPHICS_Blitter *g_Blitter = NULL;
+static GRAPHICS_Surface g_ScreenSurface; // the video buffer, drawing to it marks the screen dirty
+
+// the framebuffer is `g_VirtualHeight` rows tall, the display shows `height` of them from its display start
+// with hardware scrolling that is moved around instead of copying pixels, see GRAPHICS_Scroll and hiddenPageStart
+static bool g_HardwareScrolling = false;
+static uint16_t g_VirtualHeight = 0;
+static uint16_t g_DisplayStart = 0;      // where pushes go, the display is moved here once they are done
+static uint16_t g_ShownDisplayStart = 0; // what the display currently shows
+static volatile bool g_Flushing = false;
+static GRAPHICS_RenderHandler g_RenderHandler = NULL;
+static volatile bool g_RenderRequested = false;
+static volatile bool g_FlushDue = false; // set by the timer, the flush itself is deferred until the irq handler has returned
+static GRAPHICS_Stats g_Stats; // only changed by flushes and pushes, which don't run twice at once
+
+// the bochs/qemu display interface, the vbe bios of those sets modes through it, and it can move the display start without the bios
+#define DISPI_INDEX_PORT 0x1CE
+#define DISPI_DATA_PORT 0x1CF
+#define DISPI_INDEX_ID 0x0
+#define DISPI_INDEX_XRES 0x1
+#define DISPI_INDEX_YRES 0x2
+#define DISPI_INDEX_BPP 0x3
+#define DISPI_INDEX_VIRT_WIDTH 0x6
+#define DISPI_INDEX_VIRT_HEIGHT 0x7
+#define DISPI_INDEX_X_OFFSET 0x8
+#define DISPI_INDEX_Y_OFFSET 0x9
+#define DISPI_ID_MIN 0xB0C0
+#define DISPI_ID_MAX 0xB0CF
+
+// mask size and position of each channel, copied from the mode info
+static uint8_t g_RedSize, g_RedPosition, g_GreenSize, g_GreenPosition, g_BlueSize, g_BluePosition;
+
+// parts of the video buffer that differ from the framebuffer, no two of them touch
+static GRAPHICS_Rectangle g_DirtyRectangles[GRAPHICS_MAX_DIRTY_RECTANGLES];
+static uint8_t g_DirtyRectangleCount = 0;
+static volatile uint64_t g_LastFlushMs = 0;
+
+// copies 4 bytes at a time, memcpy goes byte by byte
+static void copyBytes(uint8_t *destination, const uint8_t *source, uint32_t count) {
+    uint32_t *destinationDword = (uint32_t *)destination;
+    const uint32_t *sourceDword = (const uint32_t *)source;
+
+    for (uint32_t i = 0; i < count / 4; ++i)
+        destinationDword[i] = sourceDword[i];
+
+    for (uint32_t i = count & ~3u; i < count; ++i)
+        destination[i] = source[i];
+}
+
+// 8, 16 and 32 bpp store a pixel in one integer, so they only differ in its type
+#define GRAPHICS_DEFINE_BLITTER(depth, type)                                                                                                                             \
+    static void fillSpan##depth(uint8_t *destination, uint32_t color, uint16_t count) {                                                                                   \
+        type *pixel = (type *)destination;                                                                                                                               \
+        while (count--)                                                                                                                                                  \
+            *pixel++ = (type)color;                                                                                                                                      \
+    }                                                                                                                                                                    \
+                                                                                                                                                                         \
+    static void copySpan##depth(uint8_t *destination, const uint8_t *source, uint16_t count) {                                                                            \
+        copyBytes(destination, source, count * sizeof(type));                                                                                                            \
+    }                                                                                                                                                                    \
+                                                                                                                                                                         \
+    static void glyphSpan##depth(uint8_t *destination, const uint8_t *bits, uint8_t width, uint16_t scale, uint32_t foreground, uint32_t background) {                   \
+        type *pixel = (type *)destination;                                                                                                                               \
+        for (uint16_t x = 0; x < width; x += 8) {                                                                                                                        \
+            uint8_t byte = *bits++;                                                                                                                                      \
+            uint8_t count = width - x < 8 ? width - x : 8;                                                                                                               \
+            for (uint8_t i = 0; i < count; ++i, byte <<= 1) {                                                                                                            \
+                type color = (type)(byte & 0x80 ? foreground : background);                                                                                              \
+                for (uint16_t j = 0; j < scale; ++j)                                                                                                                     \
+                    *pixel++ = color;                                                                                                                                    \
+            }                                                                                                                                                            \
+        }                                                                                                                                                                \
+    }                                                                                                                                                                    \
+                                                                                                                                                                         \
+    static void scaleSpan##depth(uint8_t *destination, const uint8_t *source, uint16_t count, uint32_t position, uint32_t step) {                                         \
+        type *pixel = (type *)destination;                                                                                                                               \
+        const type *sourcePixel = (const type *)source;                                                                                                                  \
+        for (; count > 0; --count, position += step)                                                                                                                     \
+            *pixel++ = sourcePixel[position >> 16];                                                                                                                      \
+    }                                                                                                                                                                    \
+                                                                                                                                                                         \
+    static const GRAPHICS_Blitter g_Blitter##depth = {                                                                                                                    \
+        .bytesPerPixel = sizeof(type),                                                                                                                                   \
+        .fillSpan = fillSpan##depth,                                                                                                                                      \
+        .copySpan = copySpan##depth,                                                                                                                                      \
+        .glyphSpan = glyphSpan##depth,                                                                                                                                    \
+        .scaleSpan = scaleSpan##depth,                                                                                                                                    \
+    };
+
+GRAPHICS_DEFINE_BLITTER(8, uint8_t)
+GRAPHICS_DEFINE_BLITTER(16, uint16_t)
+GRAPHICS_DEFINE_BLITTER(32, uint32_t)
+
+// 24 bpp has no integer type, the color is written a byte at a time
+static inline void writePixel24(uint8_t *pixel, uint32_t color) {
+    pixel[0] = color;
+    pixel[1] = color >> 8;
+    pixel[2] = color >> 16;
+}
+
+static void fillSpan24(uint8_t *destination, uint32_t color, uint16_t count) {
+    for (uint16_t i = 0; i < count; ++i, destination += 3)
+        writePixel24(destination, color);
+}
+
+static void copySpan24(uint8_t *destination, const uint8_t *source, uint16_t count) {
+    copyBytes(destination, source, count * 3);
+}
+
+static void glyphSpan24(uint8_t *destination, const uint8_t *bits, uint8_t width, uint16_t scale, uint32_t foreground, uint32_t background) {
+    for (uint16_t x = 0; x < width; x += 8) {
+        uint8_t byte = *bits++;
+        uint8_t count = width - x < 8 ? width - x : 8;
+        for (uint8_t i = 0; i < count; ++i, byte <<= 1) {
+            uint32_t color = byte & 0x80 ? foreground : background;
+            for (uint16_t j = 0; j < scale; ++j, destination += 3)
+                writePixel24(destination, color);
+        }
+    }
+}
+
+static void scaleSpan24(uint8_t *destination, const uint8_t *source, uint16_t count, uint32_t position, uint32_t step) {
+    for (; count > 0; --count, position += step, destination += 3) {
+        const uint8_t *sourcePixel = source + (position >> 16) * 3;
+        destination[0] = sourcePixel[0];
+        destination[1] = sourcePixel[1];
+        destination[2] = sourcePixel[2];
+    }
+}
+
+static const GRAPHICS_Blitter g_Blitter24 = {
+    .bytesPerPixel = 3,
+    .fillSpan = fillSpan24,
+    .copySpan = copySpan24,
+    .glyphSpan = glyphSpan24,
+    .scaleSpan = scaleSpan24,
+};
+
+static inline uint32_t bufferRow(uint16_t y) {
+    uint32_t row = (uint32_t)g_OriginY + y;
+    return row >= g_VbeModeInfo->height ? row - g_VbeModeInfo->height : row;
+}
+
+static inline uint8_t *videoBufferPixel(uint16_t x, uint16_t y) {
+    return (uint8_t *)g_VideoBuffer + bufferRow(y) * g_VbeModeInfo->pitch + x * g_Blitter->bytesPerPixel;
+}
+
+// moves `row` down by `rows` rows of `pitch`, wrapping around the bottom of the video buffer if `wrap` is set
+static inline uint8_t *advanceRow(uint8_t *row, uint32_t pitch, uint32_t rows, bool wrap) {
+    row += rows * pitch;
+
+    uint8_t *bufferEnd = (uint8_t *)g_VideoBuffer + g_VbeModeInfo->pitch * g_VbeModeInfo->height;
+    if (wrap && row >= bufferEnd)
+        row -= g_VbeModeInfo->pitch * g_VbeModeInfo->height;
+
+    return row;
+}
+
+static uint32_t packChannel(uint8_t value, uint8_t size, uint8_t position) {
+    return ((uint32_t)value >> (8 - size)) << position;
+}
+
+// converts a color to the pixel format of the mode, so it can be passed to the drawing functions
+uint32_t GRAPHICS_PackColor(uint8_t r, uint8_t g, uint8_t b) {
+    return packChannel(r, g_RedSize, g_RedPosition) | packChannel(g, g_GreenSize, g_GreenPosition) | packChannel(b, g_BlueSize, g_BluePosition);
+}
+
+// the span is clipped to the screen
+void GRAPHICS_FillSpan(uint16_t x, uint16_t y, uint16_t width, uint32_t color) {
+    if (x >= g_VbeModeInfo->width || y >= g_VbeModeInfo->height)
+        return;
+
+    g_Blitter->fillSpan(videoBufferPixel(x, y), color, min(width, g_VbeModeInfo->width - x));
+}
+
+// the rectangle is clipped to the screen
+void GRAPHICS_FillRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint32_t color) {
+    if (x >= g_VbeModeInfo->width || y >= g_VbeModeInfo->height)
+        return;
+
+    width = min(width, g_VbeModeInfo->width - x);
+    height = min(height, g_VbeModeInfo->height - y);
+
+    // the first row is filled, the rest are copies of it
+    uint8_t *firstRow = videoBufferPixel(x, y);
+    g_Blitter->fillSpan(firstRow, color, width);
+    for (uint16_t row = 1; row < height; ++row)
+        g_Blitter->copySpan(advanceRow(firstRow, g_VbeModeInfo->pitch, row, true), firstRow, width);
+}
+
+// `wrap` is set when drawing to the video buffer
+static void expandGlyph(uint8_t *row, uint32_t pitch, bool wrap, const uint8_t *glyph, uint16_t stride, uint8_t width, uint8_t height, uint16_t scale, uint32_t foreground, uint32_t background) {
+    uint16_t pixelWidth = width * scale;
+
+    for (uint8_t glyphY = 0; glyphY < height; ++glyphY, glyph += stride) {
+        g_Blitter->glyphSpan(row, glyph, width, scale, foreground, background);
+        for (uint16_t i = 1; i < scale; ++i)
+            g_Blitter->copySpan(advanceRow(row, pitch, i, wrap), row, pixelWidth);
+
+        row = advanceRow(row, pitch, scale, wrap);
+    }
+}
+
+// draws a 1 bit per pixel image, like a font glyph, with every bit scaled to a `scale` by `scale` square
+// each row of `glyph` starts on a byte boundary, `stride` bytes after the one above it, the bits are msb first
+// `x` and `y` are in pixels, the glyph has to be on the screen
+void GRAPHICS_BlitGlyph(uint16_t x, uint16_t y, const uint8_t *glyph, uint16_t stride, uint8_t width, uint8_t height, uint16_t scale, uint32_t foreground, uint32_t background) {
+    expandGlyph(videoBufferPixel(x, y), g_VbeModeInfo->pitch, true, glyph, stride, width, height, scale, foreground, background);
+}
+
+// like GRAPHICS_BlitGlyph, but into `destination` instead of the screen, with the rows right after each other
+// `destination` has to hold width * scale * height * scale pixels, it can be drawn with GRAPHICS_BlitImage
+void GRAPHICS_ExpandGlyph(uint8_t *destination, const uint8_t *glyph, uint16_t stride, uint8_t width, uint8_t height, uint16_t scale, uint32_t foreground, uint32_t background) {
+    expandGlyph(destination, width * scale * g_Blitter->bytesPerPixel, false, glyph, stride, width, height, scale, foreground, background);
+}
+
+// copies an image in the pixel format of the mode, with the rows right after each other, to the screen
+// `x` and `y` are in pixels, the image has to be on the screen
+void GRAPHICS_BlitImage(uint16_t x, uint16_t y, const uint8_t *pixels, uint16_t width, uint16_t height) {
+    uint8_t *row = videoBufferPixel(x, y);
+    uint32_t imagePitch = width * g_Blitter->bytesPerPixel;
+
+    for (uint16_t imageY = 0; imageY < height; ++imageY, row = advanceRow(row, g_VbeModeInfo->pitch, 1, true), pixels += imagePitch)
+        g_Blitter->copySpan(row, pixels, width);
+}
+
+uint8_t GRAPHICS_BytesPerPixel() {
+    return g_Blitter->bytesPerPixel;
+}
 
 void GRAPHICS_WriteScalePixel(uint16_t x, uint16_t y, uint8_t r, uint8_t g, uint8_t b, uint16_t scale) {
-    x *= scale;
-    y *= scale;
-    for (uint16_t relx = 0; relx < scale; ++relx)
-        for (uint16_t rely = 0; rely < scale; ++rely)
-            GRAPHICS_WritePixel(x + relx, y + rely, r, g, b);
+    GRAPHICS_FillRectangle(x * scale, y * scale, scale, scale, GRAPHICS_PackColor(r, g, b));
 }
 
 void GRAPHICS_WritePixel(uint16_t x, uint16_t y, uint8_t r, uint8_t g, uint8_t b) {
-    uint8_t *pixelPointer = (uint8_t *)(g_VideoBuffer + (y * g_VbeModeInfo->pitch + x * (g_VbeModeInfo->bitsPerPixel / 8)));
-    // assuming 8x3 (24bit) (RGB888) color
-    pixelPointer[g_VbeModeInfo->redPosition / 8] = r;
-    pixelPointer[g_VbeModeInfo->greenPosition / 8] = g;
-    pixelPointer[g_VbeModeInfo->bluePosition / 8] = b;
+    GRAPHICS_FillSpan(x, y, 1, GRAPHICS_PackColor(r, g, b));
+}
+
+// every surface has the pixel format of the mode, the rows are padded to whole dwords for copyBytes
+// !!! YOU ARE RESPONSIBLE FOR FREEING `surfaceOutput` WITH `GRAPHICS_DestroySurface` !!!
+int GRAPHICS_CreateSurface(uint16_t width, uint16_t height, GRAPHICS_Surface **surfaceOutput) {
+    if (g_Blitter == NULL)
+        return NULL_ERROR;
+
+    uint32_t pitch = (width * g_Blitter->bytesPerPixel + 3) & ~3u;
+
+    // the pixels are right after the surface, and start out black
+    GRAPHICS_Surface *surface = calloc(1, sizeof(GRAPHICS_Surface) + pitch * height);
+    if (surface == NULL)
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+
+    surface->width = width;
+    surface->height = height;
+    surface->pitch = pitch;
+    surface->bytesPerPixel = g_Blitter->bytesPerPixel;
+    surface->pixels = (uint8_t *)(surface + 1);
+
+    *surfaceOutput = surface;
+    return NO_ERROR;
+}
+
+void GRAPHICS_DestroySurface(GRAPHICS_Surface *surface) {
+    if (surface != &g_ScreenSurface)
+        free(surface);
+}
+
+// the video buffer as a surface, so surfaces can be blitted to it and back, the flush pushes whatever was drawn to it
+GRAPHICS_Surface *GRAPHICS_ScreenSurface() {
+    return &g_ScreenSurface;
+}
+
+static inline bool isScreenSurface(const GRAPHICS_Surface *surface) {
+    return surface == &g_ScreenSurface;
+}
+
+static inline uint8_t *surfacePixel(const GRAPHICS_Surface *surface, uint16_t x, uint16_t y) {
+    if (isScreenSurface(surface))
+        return videoBufferPixel(x, y);
+
+    return surface->pixels + y * surface->pitch + x * surface->bytesPerPixel;
+}
+
+static inline uint8_t *nextSurfaceRow(const GRAPHICS_Surface *surface, uint8_t *row, uint32_t rows) {
+    return advanceRow(row, surface->pitch, rows, isScreenSurface(surface));
+}
+
+static inline GRAPHICS_Rectangle surfaceBounds(const GRAPHICS_Surface *surface) {
+    return (GRAPHICS_Rectangle){.x0 = 0, .y0 = 0, .x1 = surface->width, .y1 = surface->height};
+}
+
+// shrinks `rectangle` to the part of it inside `clip`, returns false if nothing is left, a NULL `clip` doesn't clip anything
+static bool clipRectangle(GRAPHICS_Rectangle *rectangle, const GRAPHICS_Rectangle *clip) {
+    if (clip != NULL) {
+        rectangle->x0 = max(rectangle->x0, clip->x0);
+        rectangle->y0 = max(rectangle->y0, clip->y0);
+        rectangle->x1 = min(rectangle->x1, clip->x1);
+        rectangle->y1 = min(rectangle->y1, clip->y1);
+    }
+
+    return rectangle->x0 < rectangle->x1 && rectangle->y0 < rectangle->y1;
+}
+
+static void surfaceDrawn(const GRAPHICS_Surface *surface, const GRAPHICS_Rectangle *rectangle) {
+    if (isScreenSurface(surface))
+        GRAPHICS_MarkDirtyRectangle(rectangle->x0, rectangle->y0, rectangle->x1 - rectangle->x0, rectangle->y1 - rectangle->y0);
+}
+
+// fills `rectangle` (the whole surface if it's NULL), clipped to the surface
+void GRAPHICS_SurfaceFill(GRAPHICS_Surface *surface, const GRAPHICS_Rectangle *rectangle, uint32_t color) {
+    GRAPHICS_Rectangle area = surfaceBounds(surface);
+    if (!clipRectangle(&area, rectangle))
+        return;
+
+    uint16_t width = area.x1 - area.x0;
+    uint16_t height = area.y1 - area.y0;
+
+    // the first row is filled, the rest are copies of it
+    uint8_t *firstRow = surfacePixel(surface, area.x0, area.y0);
+    g_Blitter->fillSpan(firstRow, color, width);
+    for (uint16_t row = 1; row < height; ++row)
+        g_Blitter->copySpan(nextSurfaceRow(surface, firstRow, row), firstRow, width);
+
+    surfaceDrawn(surface, &area);
+}
+
+// copies `sourceRectangle` of `source` (all of it if it's NULL) so its top left corner lands on `x`, `y` of `destination`
+// the copy is clipped to both surfaces, and to `clip` if it isn't NULL, `x` and `y` can be negative
+// if `source` and `destination` are the same surface the two areas mustn't overlap
+void GRAPHICS_SurfaceBlit(GRAPHICS_Surface *destination, int32_t x, int32_t y, const GRAPHICS_Surface *source, const GRAPHICS_Rectangle *sourceRectangle, const GRAPHICS_Rectangle *clip) {
+    GRAPHICS_Rectangle from = surfaceBounds(source);
+    if (!clipRectangle(&from, sourceRectangle))
+        return;
+
+    GRAPHICS_Rectangle to = surfaceBounds(destination);
+    if (!clipRectangle(&to, clip))
+        return;
+
+    int32_t left = x > to.x0 ? x : to.x0;
+    int32_t top = y > to.y0 ? y : to.y0;
+    int32_t right = x + (from.x1 - from.x0) < to.x1 ? x + (from.x1 - from.x0) : to.x1;
+    int32_t bottom = y + (from.y1 - from.y0) < to.y1 ? y + (from.y1 - from.y0) : to.y1;
+    if (left >= right || top >= bottom)
+        return;
+
+    uint16_t width = right - left;
+    uint16_t height = bottom - top;
+    const uint8_t *sourceRow = surfacePixel(source, from.x0 + (left - x), from.y0 + (top - y));
+    uint8_t *destinationRow = surfacePixel(destination, left, top);
+
+    // whole rows of two surfaces with the same layout are one block
+    if (!isScreenSurface(source) && !isScreenSurface(destination) && width == source->width && width == destination->width && source->pitch == destination->pitch) {
+        copyBytes(destinationRow, sourceRow, height * destination->pitch);
+    } else {
+        for (uint16_t row = 0; row < height; ++row) {
+            g_Blitter->copySpan(destinationRow, sourceRow, width);
+            sourceRow = nextSurfaceRow(source, (uint8_t *)sourceRow, 1);
+            destinationRow = nextSurfaceRow(destination, destinationRow, 1);
+        }
+    }
+
+    surfaceDrawn(destination, &(GRAPHICS_Rectangle){.x0 = left, .y0 = top, .x1 = right, .y1 = bottom});
+}
+
+// copies all of `source` to the top left of `destination`, clipped if they aren't the same size
+void GRAPHICS_SurfaceCopy(GRAPHICS_Surface *destination, const GRAPHICS_Surface *source) {
+    GRAPHICS_SurfaceBlit(destination, 0, 0, source, NULL, NULL);
+}
+
+// stretches `sourceRectangle` of `source` (all of it if it's NULL) over `destinationRectangle` of `destination`, nearest neighbour
+// clipping, to `destination` and to `clip` if it isn't NULL, cuts off part of the stretched image instead of changing the scale
+// destination rows that come from the same source row, which is every row but one of each when scaling up, are copied from the row above
+void GRAPHICS_SurfaceBlitScaled(GRAPHICS_Surface *destination, const GRAPHICS_Rectangle *destinationRectangle, const GRAPHICS_Surface *source, const GRAPHICS_Rectangle *sourceRectangle, const GRAPHICS_Rectangle *clip) {
+    GRAPHICS_Rectangle from = surfaceBounds(source);
+    if (!clipRectangle(&from, sourceRectangle))
+        return;
+
+    GRAPHICS_Rectangle to = *destinationRectangle;
+    if (to.x0 >= to.x1 || to.y0 >= to.y1)
+        return;
+
+    GRAPHICS_Rectangle visible = surfaceBounds(destination);
+    if (!clipRectangle(&visible, &to) || !clipRectangle(&visible, clip))
+        return;
+
+    uint32_t stepX = ((uint32_t)(from.x1 - from.x0) << 16) / (to.x1 - to.x0);
+    uint32_t stepY = ((uint32_t)(from.y1 - from.y0) << 16) / (to.y1 - to.y0);
+    uint32_t positionX = (visible.x0 - to.x0) * stepX; // below the source width << 16, so it fits
+    uint16_t width = visible.x1 - visible.x0;
+
+    uint8_t *destinationRow = surfacePixel(destination, visible.x0, visible.y0);
+    uint8_t *previousRow = NULL;
+    uint32_t previousSourceY = 0;
+    for (uint16_t y = visible.y0; y < visible.y1; ++y, destinationRow = nextSurfaceRow(destination, destinationRow, 1)) {
+        uint32_t sourceY = from.y0 + (uint32_t)(((uint64_t)(y - to.y0) * stepY) >> 16);
+
+        if (previousRow != NULL && sourceY == previousSourceY)
+            g_Blitter->copySpan(destinationRow, previousRow, width);
+        else if (stepX == 0x10000)
+            g_Blitter->copySpan(destinationRow, surfacePixel(source, from.x0 + (positionX >> 16), sourceY), width);
+        else
+            g_Blitter->scaleSpan(destinationRow, surfacePixel(source, from.x0, sourceY), width, positionX, stepX);
+
+        previousRow = destinationRow;
+        previousSourceY = sourceY;
+    }
+
+    surfaceDrawn(destination, &visible);
+}
+
+// copies screen rows [y, y + height) whole, that's at most two contiguous copies, one on each side of where the video buffer wraps
+static inline uint8_t *framebufferRow(uint16_t y) {
+    return (uint8_t *)g_VbeModeInfo->framebuffer + ((uint32_t)g_DisplayStart + y) * g_VbeModeInfo->pitch;
+}
+
+static void pushRows(uint16_t y, uint16_t height) {
+    uint8_t *framebuffer = framebufferRow(y);
+    uint32_t firstRow = bufferRow(y);
+    uint32_t rowsBeforeWrap = min(height, g_VbeModeInfo->height - firstRow);
+
+    copyBytes(framebuffer, (uint8_t *)g_VideoBuffer + firstRow * g_VbeModeInfo->pitch, rowsBeforeWrap * g_VbeModeInfo->pitch);
+    copyBytes(framebuffer + rowsBeforeWrap * g_VbeModeInfo->pitch, (uint8_t *)g_VideoBuffer, (height - rowsBeforeWrap) * g_VbeModeInfo->pitch);
+    g_Stats.pushedBytes += height * g_VbeModeInfo->pitch;
 }
 
 void GRAPHICS_PushBufferRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
-    uint8_t *videoBufferStartLine, *frameBufferStartLine;
-    uint8_t bytesPerPixel = g_VbeModeInfo->bitsPerPixel / 8;
+    if (x == 0 && width == g_VbeModeInfo->width) {
+        pushRows(y, height);
+        return;
+    }
+
+    uint8_t *framebuffer = framebufferRow(y) + x * g_Blitter->bytesPerPixel;
+    uint8_t *videoBufferRow = videoBufferPixel(x, y);
 
     // copy 1 line at a time
-    for (uint16_t currentY = y; currentY < y + height; ++currentY) {
-        videoBufferStartLine = (uint8_t *)(g_VideoBuffer + (currentY * g_VbeModeInfo->pitch + (x * bytesPerPixel)));
-        frameBufferStartLine = (uint8_t *)(g_VbeModeInfo->framebuffer + (currentY * g_VbeModeInfo->pitch + (x * bytesPerPixel)));
-        memcpy(frameBufferStartLine, videoBufferStartLine, width * bytesPerPixel);
+    for (uint16_t currentY = 0; currentY < height; ++currentY) {
+        g_Blitter->copySpan(framebuffer, videoBufferRow, width);
+        framebuffer += g_VbeModeInfo->pitch;
+        videoBufferRow = advanceRow(videoBufferRow, g_VbeModeInfo->pitch, 1, true);
     }
+    g_Stats.pushedBytes += (uint32_t)width * height * g_Blitter->bytesPerPixel;
 }
 
 void GRAPHICS_PushBufferRectangleScale(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t scale) {
@@ -42,31 +473,376 @@ void GRAPHICS_PushBufferRectangleScale(uint16_t x, uint16_t y, uint16_t width, u
 }
 
 void GRAPHICS_PushBuffer() {
-    memcpy((void *)g_VbeModeInfo->framebuffer, (void *)g_VideoBuffer, g_VbeModeInfo->pitch * g_VbeModeInfo->height);
+    pushRows(0, g_VbeModeInfo->height);
 }
 
 void GRAPHICS_ClearScreen() {
     memset((void *)g_VideoBuffer, 0, g_VbeModeInfo->pitch * g_VbeModeInfo->height);
+    g_OriginY = 0;
+    GRAPHICS_MarkDirty();
+}
+
+// overlapping, or sharing an edge, so the union doesn't cover anything that neither of them do
+// rectangles only touching at a corner don't count, their union would be mostly clean pixels
+static bool rectanglesTouch(const GRAPHICS_Rectangle *a, const GRAPHICS_Rectangle *b) {
+    bool xOverlap = a->x0 < b->x1 && b->x0 < a->x1;
+    bool yOverlap = a->y0 < b->y1 && b->y0 < a->y1;
+    bool xTouch = a->x0 <= b->x1 && b->x0 <= a->x1;
+    bool yTouch = a->y0 <= b->y1 && b->y0 <= a->y1;
+
+    return (xOverlap && yTouch) || (yOverlap && xTouch);
 }
 
+static GRAPHICS_Rectangle rectangleUnion(const GRAPHICS_Rectangle *a, const GRAPHICS_Rectangle *b) {
+    return (GRAPHICS_Rectangle){
+        .x0 = min(a->x0, b->x0),
+        .y0 = min(a->y0, b->y0),
+        .x1 = max(a->x1, b->x1),
+        .y1 = max(a->y1, b->y1),
+    };
+}
+
+static uint32_t rectangleArea(const GRAPHICS_Rectangle *rectangle) {
+    return (uint32_t)(rectangle->x1 - rectangle->x0) * (rectangle->y1 - rectangle->y0);
+}
+
+static void removeDirtyRectangle(uint8_t index) {
+    g_DirtyRectangles[index] = g_DirtyRectangles[--g_DirtyRectangleCount];
+}
+
+// must be called with interrupts disabled, the timer flushes from its irq handler
+static void addDirtyRectangle(GRAPHICS_Rectangle rectangle) {
+    for (;;) {
+        // a grown rectangle may touch ones it didn't before, so start over after every merge
+        bool merged = false;
+        for (uint8_t i = 0; i < g_DirtyRectangleCount && !merged; ++i) {
+            if (!rectanglesTouch(&rectangle, &g_DirtyRectangles[i]))
+                continue;
+
+            rectangle = rectangleUnion(&rectangle, &g_DirtyRectangles[i]);
+            removeDirtyRectangle(i);
+            merged = true;
+        }
+
+        if (merged)
+            continue;
+        if (g_DirtyRectangleCount < GRAPHICS_MAX_DIRTY_RECTANGLES)
+            break;
+
+        // no room left, so it's merged with whichever rectangle grows the least
+        uint8_t closest = 0;
+        uint32_t closestGrowth = UINT32_MAX;
+        for (uint8_t i = 0; i < g_DirtyRectangleCount; ++i) {
+            GRAPHICS_Rectangle candidate = rectangleUnion(&rectangle, &g_DirtyRectangles[i]);
+            uint32_t growth = rectangleArea(&candidate) - rectangleArea(&g_DirtyRectangles[i]);
+            if (growth < closestGrowth) {
+                closest = i;
+                closestGrowth = growth;
+            }
+        }
+
+        rectangle = rectangleUnion(&rectangle, &g_DirtyRectangles[closest]);
+        removeDirtyRectangle(closest);
+    }
+
+    g_DirtyRectangles[g_DirtyRectangleCount++] = rectangle;
+}
+
+// the rectangle is pushed to the framebuffer by the next flush, instead of right away
+void GRAPHICS_MarkDirtyRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+    if (g_VbeModeInfo == NULL || x >= g_VbeModeInfo->width || y >= g_VbeModeInfo->height || width == 0 || height == 0)
+        return;
+
+    GRAPHICS_Rectangle rectangle = {
+        .x0 = x,
+        .y0 = y,
+        .x1 = min((uint32_t)x + width, g_VbeModeInfo->width),
+        .y1 = min((uint32_t)y + height, g_VbeModeInfo->height),
+    };
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    addDirtyRectangle(rectangle);
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+void GRAPHICS_MarkDirtyRectangleScale(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t scale) {
+    GRAPHICS_MarkDirtyRectangle(x * scale, y * scale, width * scale, height * scale);
+}
+
+// where a whole new screen can be pushed without overlapping the one being shown, so it doesn't tear, and the display is flipped to it
+// if the video memory has no room for that, the screen is pushed in place
+static uint16_t hiddenPageStart() {
+    uint16_t height = g_VbeModeInfo->height;
+
+    if (g_ShownDisplayStart >= height)
+        return 0;
+    if ((uint32_t)g_ShownDisplayStart + 2 * height <= g_VirtualHeight)
+        return g_ShownDisplayStart + height;
+
+    return g_ShownDisplayStart;
+}
+
+// must be called with interrupts disabled
+static void markScreenDirty() {
+    GRAPHICS_Rectangle screen = {.x0 = 0, .y0 = 0, .x1 = g_VbeModeInfo->width, .y1 = g_VbeModeInfo->height};
+
+    if (g_HardwareScrolling)
+        g_DisplayStart = hiddenPageStart();
+
+    g_DirtyRectangleCount = 0;
+    addDirtyRectangle(screen);
+}
+
+void GRAPHICS_MarkDirty() {
+    if (g_VbeModeInfo == NULL)
+        return;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    markScreenDirty();
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+// the content moved up by `rows`, so the damage that wasn't pushed yet did too, must be called with interrupts disabled
+static void scrollDirtyRectangles(uint16_t rows) {
+    for (uint8_t i = 0; i < g_DirtyRectangleCount;) {
+        GRAPHICS_Rectangle *rectangle = &g_DirtyRectangles[i];
+        if (rectangle->y1 <= rows) {
+            removeDirtyRectangle(i);
+            continue;
+        }
+
+        rectangle->y0 = rectangle->y0 > rows ? rectangle->y0 - rows : 0;
+        rectangle->y1 -= rows;
+        ++i;
+    }
+}
+
+// moves everything on the screen up by `rows` pixels and clears the rows that come in at the bottom
+// only the origin of the video buffer moves, nothing is copied in it
+// with hardware scrolling the display start moves down too, and only the new rows are pushed, otherwise the whole screen is
+void GRAPHICS_Scroll(uint16_t rows) {
+    if (rows == 0)
+        return;
+    if (rows >= g_VbeModeInfo->height) {
+        GRAPHICS_ClearScreen();
+        return;
+    }
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // so the timer doesn't flush halfway through
+
+    // the rows at the old top become the bottom rows
+    g_OriginY = bufferRow(rows);
+    for (uint16_t y = g_VbeModeInfo->height - rows; y < g_VbeModeInfo->height; ++y)
+        memset(videoBufferPixel(0, y), 0, g_VbeModeInfo->pitch);
+
+    if (g_HardwareScrolling && (uint32_t)g_DisplayStart + rows + g_VbeModeInfo->height <= g_VirtualHeight) {
+        g_DisplayStart += rows;
+        scrollDirtyRectangles(rows);
+        addDirtyRectangle((GRAPHICS_Rectangle){.x0 = 0, .y0 = g_VbeModeInfo->height - rows, .x1 = g_VbeModeInfo->width, .y1 = g_VbeModeInfo->height});
+    } else {
+        // the end of video memory was reached, the screen is pushed to a hidden page and flipped to
+        markScreenDirty();
+    }
+
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+static void dispiWrite(uint16_t index, uint16_t value) {
+    x86_OutWord(DISPI_INDEX_PORT, index);
+    x86_OutWord(DISPI_DATA_PORT, value);
+}
+
+static uint16_t dispiRead(uint16_t index) {
+    x86_OutWord(DISPI_INDEX_PORT, index);
+    return x86_InWord(DISPI_DATA_PORT);
+}
+
+void GRAPHICS_SetRenderHandler(GRAPHICS_RenderHandler handler) {
+    g_RenderHandler = handler;
+}
+
+// the render handler is called by the next flush, if nobody else flushes that is done once the timer finds it due
+void GRAPHICS_RequestRender() {
+    g_RenderRequested = true;
+}
+
+// renders if that was requested, pushes every dirty rectangle to the framebuffer, then moves the display to the new display start if it changed
+// the rectangles are taken off the list first, so the copying is done with interrupts enabled, and whatever is marked meanwhile is left for the next flush
+// a deferred flush doesn't run while another flush is running, so the display isn't moved before everything is pushed, and the render handler never runs twice at once
+// never called from irq handlers, the render handler and the copying take far too long for that
+void GRAPHICS_Flush() {
+    if (g_VideoBuffer == NULL)
+        return;
+
+    GRAPHICS_Rectangle rectangles[GRAPHICS_MAX_DIRTY_RECTANGLES];
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    if (g_Flushing) {
+        x86_RestoreInterrupts(interruptsEnabled);
+        return;
+    }
+    g_Flushing = true;
+    x86_RestoreInterrupts(interruptsEnabled);
+
+    // a request made while rendering is left for the next flush
+    if (g_RenderRequested && g_RenderHandler != NULL) {
+        g_RenderRequested = false;
+        g_RenderHandler();
+    }
+
+    interruptsEnabled = x86_SaveAndDisableInterrupts();
+    uint8_t count = g_DirtyRectangleCount;
+    memcpy(rectangles, g_DirtyRectangles, count * sizeof(GRAPHICS_Rectangle));
+    g_DirtyRectangleCount = 0;
+    g_LastFlushMs = PIT_GetTimeMs();
+    x86_RestoreInterrupts(interruptsEnabled);
+
+    for (uint8_t i = 0; i < count; ++i)
+        GRAPHICS_PushBufferRectangle(rectangles[i].x0, rectangles[i].y0, rectangles[i].x1 - rectangles[i].x0, rectangles[i].y1 - rectangles[i].y0);
+
+    // a scroll or a page flip is just this register write
+    bool moveDisplay = g_HardwareScrolling && g_ShownDisplayStart != g_DisplayStart;
+    if (moveDisplay) {
+        dispiWrite(DISPI_INDEX_Y_OFFSET, g_DisplayStart);
+        g_ShownDisplayStart = g_DisplayStart;
+    }
+
+    if (count > 0 || moveDisplay)
+        ++g_Stats.flushes;
+    g_Flushing = false;
+}
+
+// true while a flush renders or pushes, whatever interrupted it must not scroll or change the cells until it's done
+bool GRAPHICS_IsFlushing() {
+    return g_Flushing;
+}
+
+void GRAPHICS_GetStats(GRAPHICS_Stats *statsOutput) {
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // a deferred flush may be running
+    *statsOutput = g_Stats;
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+// catches damage and render requests nobody flushed, a lone putc for example
+// it only notices them, the flush runs once the irq handler has returned, see flushIfDue
+static void tickHandler(uint64_t timeMs) {
+    if ((g_DirtyRectangleCount > 0 || g_RenderRequested) && timeMs - g_LastFlushMs >= GRAPHICS_FLUSH_INTERVAL_MS)
+        g_FlushDue = true;
+}
+
+// a deferred irq handler, it runs with interrupts enabled, so the timer keeps ticking while this pushes
+static void flushIfDue() {
+    if (!g_FlushDue)
+        return;
+
+    g_FlushDue = false;
+    GRAPHICS_Flush();
+}
+
+// picks the blitter and channel layout for the mode, 15 bpp modes store their pixels in 16 bits
+static int selectPixelFormat(VbeModeInfo *vbeModeInfo) {
+    switch (vbeModeInfo->bitsPerPixel) {
+    case 32:
+        g_Blitter = &g_Blitter32;
+        break;
+    case 24:
+        g_Blitter = &g_Blitter24;
+        break;
+    case 16:
+    case 15:
+        g_Blitter = &g_Blitter16;
+        break;
+    case 8:
+        g_Blitter = &g_Blitter8;
+        break;
+    default:
+        return GRAPHICS_UNSUPPORTED_PIXEL_FORMAT_ERROR;
+    }
+
+    g_RedSize = vbeModeInfo->redMask;
+    g_RedPosition = vbeModeInfo->redPosition;
+    g_GreenSize = vbeModeInfo->greenMask;
+    g_GreenPosition = vbeModeInfo->greenPosition;
+    g_BlueSize = vbeModeInfo->blueMask;
+    g_BluePosition = vbeModeInfo->bluePosition;
+
+    // palette modes have no masks, colors are packed as rgb 332 then, which only looks right if the palette was set up like that
+    if (g_RedSize == 0 && g_GreenSize == 0 && g_BlueSize == 0) {
+        if (vbeModeInfo->bitsPerPixel != 8)
+            return GRAPHICS_UNSUPPORTED_PIXEL_FORMAT_ERROR;
+
+        g_RedSize = 3;
+        g_RedPosition = 5;
+        g_GreenSize = 3;
+        g_GreenPosition = 2;
+        g_BlueSize = 2;
+        g_BluePosition = 0;
+    }
+
+    return NO_ERROR;
+}
+
+// hardware scrolling needs the bochs display interface to be running the mode stage 2 set, and video memory past the screen
+static bool initializeHardwareScrolling(VbeModeInfo *vbeModeInfo) {
+    uint16_t id = dispiRead(DISPI_INDEX_ID);
+    if (id < DISPI_ID_MIN || id > DISPI_ID_MAX)
+        return false;
+
+    if (dispiRead(DISPI_INDEX_XRES) != vbeModeInfo->width || dispiRead(DISPI_INDEX_YRES) != vbeModeInfo->height || dispiRead(DISPI_INDEX_BPP) != vbeModeInfo->bitsPerPixel ||
+        dispiRead(DISPI_INDEX_VIRT_WIDTH) * g_Blitter->bytesPerPixel != vbeModeInfo->pitch)
+        return false;
+
+    g_VirtualHeight = min(dispiRead(DISPI_INDEX_VIRT_HEIGHT), vbeModeInfo->virtualHeight);
+    if (g_VirtualHeight <= vbeModeInfo->height)
+        return false;
+
+    dispiWrite(DISPI_INDEX_X_OFFSET, 0);
+    dispiWrite(DISPI_INDEX_Y_OFFSET, 0);
+    return true;
+}
+
+// the video buffer is circular because of GRAPHICS_Scroll, so draw with the GRAPHICS_ functions instead of writing to it directly
 // !!! YOU ARE RESPONSIBLE FOR FREEING `videoBufferOutput` WITH `GRAPHICS_DeInitialize` !!!
 int GRAPHICS_Initialize(VbeModeInfo *vbeModeInfo, void **videoBufferOutput) {
     if (vbeModeInfo == NULL)
         return NULL_ERROR;
 
+    int status;
+    if ((status = selectPixelFormat(vbeModeInfo)) != NO_ERROR)
+        return status;
+
     g_VbeModeInfo = vbeModeInfo;
+    g_Stats = (GRAPHICS_Stats){0};
+    g_DisplayStart = 0;
+    g_ShownDisplayStart = 0;
+    g_VirtualHeight = vbeModeInfo->height;
+    g_HardwareScrolling = initializeHardwareScrolling(vbeModeInfo);
 
     g_VideoBuffer = malloc(g_VbeModeInfo->pitch * g_VbeModeInfo->height);
+    g_OriginY = 0;
     if (g_VideoBuffer == NULL)
         return FAILED_TO_ALLOCATE_MEMORY_ERROR;
     *videoBufferOutput = g_VideoBuffer;
 
+    g_ScreenSurface.width = vbeModeInfo->width;
+    g_ScreenSurface.height = vbeModeInfo->height;
+    g_ScreenSurface.pitch = vbeModeInfo->pitch;
+    g_ScreenSurface.bytesPerPixel = g_Blitter->bytesPerPixel;
+    g_ScreenSurface.pixels = g_VideoBuffer;
+
     GRAPHICS_ClearScreen();
-    GRAPHICS_PushBuffer();
+    GRAPHICS_Flush();
 
-    return NO_ERROR;
+    if ((status = i686_IRQ_AddDeferredHandler(flushIfDue)) != NO_ERROR)
+        return status;
+    return PIT_AddTickHandler(tickHandler);
 }
 
 void GRAPHICS_DeInitialize() {
+    PIT_RemoveTickHandler(tickHandler);
+    i686_IRQ_RemoveDeferredHandler(flushIfDue);
+    GRAPHICS_Flush();
+
     free(g_VideoBuffer);
+    g_VideoBuffer = NULL;
 }
@@ -1,13 +1,66 @@
 #pragma once
 
 #include "vbe.h"
+#include <stdbool.h>
 #include <stdint.h>
 
+#define GRAPHICS_MAX_DIRTY_RECTANGLES 16 // once there are more, the closest ones are merged
+#define GRAPHICS_FLUSH_INTERVAL_MS 20    // damage that wasn't flushed explicitly is pushed after an irq at least this often
+
+// in pixels, `x1` and `y1` are exclusive
+typedef struct {
+    uint16_t x0;
+    uint16_t y0;
+    uint16_t x1;
+    uint16_t y1;
+} GRAPHICS_Rectangle;
+
+// an off-screen image in the pixel format of the mode, composed with the GRAPHICS_Surface... functions and blitted to the screen surface once done
+typedef struct {
+    uint16_t width;
+    uint16_t height;
+    uint32_t pitch; // bytes per row
+    uint8_t bytesPerPixel;
+    uint8_t *pixels;
+} GRAPHICS_Surface;
+
+// what went to the framebuffer since the graphics were initialized
+typedef struct {
+    uint64_t flushes;     // flushes that pushed anything or moved the display
+    uint64_t pushedBytes; // copied from the video buffer to the framebuffer
+} GRAPHICS_Stats;
+
+// called by GRAPHICS_Flush before anything is pushed, so whatever draws lazily (the text console) can draw what changed
+typedef void (*GRAPHICS_RenderHandler)();
+
 int GRAPHICS_Initialize(VbeModeInfo *vbeModeInfo, void **videoBufferOutput);
 void GRAPHICS_DeInitialize();
+uint32_t GRAPHICS_PackColor(uint8_t r, uint8_t g, uint8_t b);
+void GRAPHICS_FillSpan(uint16_t x, uint16_t y, uint16_t width, uint32_t color);
+void GRAPHICS_FillRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint32_t color);
+void GRAPHICS_BlitGlyph(uint16_t x, uint16_t y, const uint8_t *glyph, uint16_t stride, uint8_t width, uint8_t height, uint16_t scale, uint32_t foreground, uint32_t background);
+void GRAPHICS_ExpandGlyph(uint8_t *destination, const uint8_t *glyph, uint16_t stride, uint8_t width, uint8_t height, uint16_t scale, uint32_t foreground, uint32_t background);
+void GRAPHICS_BlitImage(uint16_t x, uint16_t y, const uint8_t *pixels, uint16_t width, uint16_t height);
+uint8_t GRAPHICS_BytesPerPixel();
 void GRAPHICS_WriteScalePixel(uint16_t x, uint16_t y, uint8_t r, uint8_t g, uint8_t b, uint16_t scale);
 void GRAPHICS_WritePixel(uint16_t x, uint16_t y, uint8_t r, uint8_t g, uint8_t b);
 void GRAPHICS_ClearScreen();
+void GRAPHICS_Scroll(uint16_t rows);
 void GRAPHICS_PushBufferRectangleScale(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t scale);
 void GRAPHICS_PushBufferRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height);
 void GRAPHICS_PushBuffer();
+void GRAPHICS_MarkDirtyRectangleScale(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint16_t scale);
+void GRAPHICS_MarkDirtyRectangle(uint16_t x, uint16_t y, uint16_t width, uint16_t height);
+void GRAPHICS_MarkDirty();
+int GRAPHICS_CreateSurface(uint16_t width, uint16_t height, GRAPHICS_Surface **surfaceOutput);
+void GRAPHICS_DestroySurface(GRAPHICS_Surface *surface);
+GRAPHICS_Surface *GRAPHICS_ScreenSurface();
+void GRAPHICS_SurfaceFill(GRAPHICS_Surface *surface, const GRAPHICS_Rectangle *rectangle, uint32_t color);
+void GRAPHICS_SurfaceBlit(GRAPHICS_Surface *destination, int32_t x, int32_t y, const GRAPHICS_Surface *source, const GRAPHICS_Rectangle *sourceRectangle, const GRAPHICS_Rectangle *clip);
+void GRAPHICS_SurfaceCopy(GRAPHICS_Surface *destination, const GRAPHICS_Surface *source);
+void GRAPHICS_SurfaceBlitScaled(GRAPHICS_Surface *destination, const GRAPHICS_Rectangle *destinationRectangle, const GRAPHICS_Surface *source, const GRAPHICS_Rectangle *sourceRectangle, const GRAPHICS_Rectangle *clip);
+void GRAPHICS_SetRenderHandler(GRAPHICS_RenderHandler handler);
+void GRAPHICS_RequestRender();
+void GRAPHICS_Flush();
+bool GRAPHICS_IsFlushing();
+void GRAPHICS_GetStats(GRAPHICS_Stats *statsOutput);
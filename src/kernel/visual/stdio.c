@@ -1,36 +1,38 @@
 #include "stdio.h"
 #include "font.h"
 #include "graphics.h"
+#include "log/log.h"
 #include "vbe.h"
+#include <lib/algorithm/format.h>
+#include <lib/algorithm/math.h>
+#include <lib/algorithm/string.h>
+#include <lib/errors/errors.h>
+#include <lib/interrupt/irq/irq.h>
 #include <lib/memory/memdefs.h>
+#include <lib/time/pit.h>
+#include <lib/x86/general.h>
 #include <lib/x86/misc.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define TAB_SIZE 4
+#define DRAIN_CHUNK_SIZE 64    // bytes taken out of the log at once
+#define PRINTF_BUFFER_SIZE 128 // printf writes to the log in pieces of at most this many bytes
 
 static uint16_t g_CursorPosition[2] = {0, 0};
 
-#if DEBUG_BUILD == 1
-#include <lib/x86/general.h> // for x86_OutByte
-
-// the e9 port is unused and can be used to output debug messages
-void E9putc(char c) {
-    x86_OutByte(0xE9, c);
-}
-#endif
-
-void setCursorPosition(uint16_t x, uint16_t y) {
-    g_CursorPosition[0] = x;
-    g_CursorPosition[1] = y;
-}
-
-void putc(char character) {
-#if DEBUG_BUILD == 1
-    E9putc(character);
-#endif
+// everything printed goes to the kernel log first, draining the log puts it in the character grid (and the e9 port)
+// irq handlers only append to the log, the buffer mode decides when the rest drain it and flush the screen
+static OutputBufferMode g_OutputBufferMode = OUTPUT_UNBUFFERED;
+static uint32_t g_DrainPosition = 0; // log position up to which everything is on the console
+static volatile bool g_Draining = false;
+static uint64_t g_LastDrainMs = 0;
+static volatile bool g_DrainDue = false; // set by the timer, the drain itself is deferred until the irq handler has returned
+static bool g_PendingNewline = false; // since the last flush
 
+static void drawCharacter(char character) {
     FONT_Character fontCharacter = EMPTY_GRAY_CHARACTER;
     uint16_t screenWidth, screenHeight;
 
@@ -48,7 +50,7 @@ void putc(char character) {
         break;
     case '\t':
         for (uint8_t i = 0; i < TAB_SIZE - (g_CursorPosition[0] % TAB_SIZE); ++i)
-            putc(' ');
+            drawCharacter(' ');
         break;
     case '\b':
         if (g_CursorPosition[0] == 0) {
@@ -74,53 +76,185 @@ void putc(char character) {
     }
 }
 
-void puts(const char *buf) {
-    while (*buf) {
-        putc(*buf);
-        ++buf;
+void setCursorPosition(uint16_t x, uint16_t y) {
+    g_CursorPosition[0] = x;
+    g_CursorPosition[1] = y;
+}
+
+// moves up to `limit` bytes of what was logged since the last drain onto the console
+// does nothing if it interrupted another drain, the grid is only touched by one at a time
+static void drainLog(uint32_t limit) {
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    bool draining = g_Draining;
+    g_Draining = true;
+    x86_RestoreInterrupts(interruptsEnabled);
+    if (draining)
+        return;
+
+    char chunk[DRAIN_CHUNK_SIZE];
+    uint32_t count;
+    while (limit > 0 && (count = LOG_Read(&g_DrainPosition, chunk, min(limit, sizeof(chunk)))) > 0) {
+#if DEBUG_BUILD == 1
+        // the e9 port is unused and can be used to output debug messages
+        x86_OutBytes(0xE9, (const uint8_t *)chunk, count);
+#endif
+        for (uint32_t i = 0; i < count; ++i)
+            drawCharacter(chunk[i]);
+        limit -= count;
+    }
+
+    g_LastDrainMs = PIT_GetTimeMs();
+    g_Draining = false;
+}
+
+// drains the log and pushes whatever changed to the screen, irq handlers leave that to whoever runs after them
+void flushOutput() {
+    if (i686_IRQ_InHandler())
+        return;
+
+    drainLog(UINT32_MAX);
+    g_PendingNewline = false;
+    GRAPHICS_Flush();
+}
+
+// output logged by irq handlers, or left behind by fully buffered mode, is drained once the timer finds it due
+// the timer only notices it, the drain runs once the irq handler has returned, see drainIfDue
+static void tickHandler(uint64_t timeMs) {
+    if (timeMs - g_LastDrainMs >= OUTPUT_FLUSH_INTERVAL_MS && LOG_Position() != g_DrainPosition)
+        g_DrainDue = true;
+}
+
+// a deferred irq handler, it runs with interrupts enabled but in the middle of whatever was interrupted
+// if that is a flush, a scroll would move the grids and the origin under it, so the drain is left due until a later irq
+// bounded, so a flood of output doesn't stall that for long, the deferred graphics flush draws it later on
+static void drainIfDue() {
+    if (!g_DrainDue || g_Draining || GRAPHICS_IsFlushing())
+        return;
+
+    g_DrainDue = false;
+    drainLog(OUTPUT_BUFFER_SIZE);
+}
+
+// unbuffered flushes after every character, line buffered after every newline, fully buffered leaves it to the timer
+// every mode flushes once OUTPUT_BUFFER_SIZE characters are pending
+void setOutputBufferMode(OutputBufferMode mode) {
+    static bool handlersAdded = false;
+    if (!handlersAdded) {
+        handlersAdded = i686_IRQ_AddDeferredHandler(drainIfDue) == NO_ERROR;
+        if (handlersAdded && PIT_AddTickHandler(tickHandler) != NO_ERROR) {
+            i686_IRQ_RemoveDeferredHandler(drainIfDue);
+            handlersAdded = false;
+        }
     }
+
+    g_OutputBufferMode = mode;
+    flushOutput();
+}
+
+static void applyOutputBufferMode() {
+    if (i686_IRQ_InHandler())
+        return;
+
+    if (g_OutputBufferMode == OUTPUT_UNBUFFERED || (g_OutputBufferMode == OUTPUT_LINE_BUFFERED && g_PendingNewline) ||
+        LOG_Position() - g_DrainPosition >= OUTPUT_BUFFER_SIZE)
+        flushOutput();
+}
+
+// appends to the kernel log in one piece, so output from irq handlers doesn't end up in the middle of it
+// when it's drawn and flushed to the screen depends on the buffer mode
+static void writeOutput(const char *data, uint32_t length) {
+    LOG_Write(data, length);
+
+    if (!i686_IRQ_InHandler())
+        for (uint32_t i = 0; i < length && !g_PendingNewline; ++i)
+            g_PendingNewline = data[i] == '\n';
+    applyOutputBufferMode();
+}
+
+void putc(char character) {
+    writeOutput(&character, 1);
+}
+
+void puts(const char *buf) {
+    writeOutput(buf, strlen(buf));
 }
 
 void clearScreen() {
+    flushOutput(); // so nothing logged before ends up on the cleared screen
+
+    g_Draining = true;
     g_CursorPosition[0] = 0;
     g_CursorPosition[1] = 0;
+    FONT_ClearScreen();
+    g_Draining = false;
 
-    GRAPHICS_ClearScreen();
-    GRAPHICS_PushBuffer();
+    GRAPHICS_Flush();
 }
 
-static const char g_HexChars[] = "0123456789abcdef";
-static const char g_CapitalHexChars[] = "0123456789ABCDEF";
-
-void printf_number_unsigned(uint64_t number, uint8_t radix, bool capital) {
-    char outputBuffer[22]; // 20-22 characters number, and 1 for the null terminator
-    int8_t bufferPosition = 0;
-    const char *selectedHexChars;
-
-    if (capital)
-        selectedHexChars = g_CapitalHexChars;
-    else
-        selectedHexChars = g_HexChars;
-
-    do {
-        uint64_t remainder = number % radix;
-        number /= radix;
-        outputBuffer[bufferPosition++] = selectedHexChars[remainder];
-    } while (number > 0);
-
-    while (--bufferPosition >= 0)
-        putc(outputBuffer[bufferPosition]);
+// switches the console to another font, the text is kept and the cursor stays on the same line of it
+// no drain may run from the copy of the old grid until the cursor is on the new one, it would be lost or written past the grid
+int setFont(FAT_Filesystem *fontsFilesystem, const FONT_FontInfo *fontInfo) {
+    flushOutput(); // so everything logged before is on the old grid and comes along
+
+    uint16_t oldHeight = FONT_ScreenCharacterHeight();
+    g_Draining = true;
+
+    int status = FONT_SetFont(fontsFilesystem, fontInfo, true);
+    if (status == NO_ERROR) {
+        // if fewer lines fit, the top ones were dropped
+        uint16_t height = FONT_ScreenCharacterHeight();
+        uint16_t droppedLines = oldHeight > height ? oldHeight - height : 0;
+        g_CursorPosition[0] = min(g_CursorPosition[0], FONT_ScreenCharacterWidth() - 1);
+        g_CursorPosition[1] = g_CursorPosition[1] > droppedLines ? g_CursorPosition[1] - droppedLines : 0;
+    }
+
+    g_Draining = false;
+    flushOutput(); // whatever was logged meanwhile
+    return status;
 }
 
-void printf_number_signed(int64_t number, uint8_t radix, bool capital) {
-    if (number < 0) {
-        putc('-');
-        printf_number_unsigned(-number, radix, capital);
-    } else {
-        printf_number_unsigned(number, radix, capital);
+static const char g_HexChars[] = "0123456789abcdef";
+
+// where formatted text goes, a buffer that is either written out once it's full (printf) or cut off (snprintf)
+typedef struct {
+    char *buffer;
+    uint32_t size;
+    uint32_t position;                                   // in `buffer`
+    uint32_t length;                                     // of all the formatted text, including what didn't fit
+    void (*writeOut)(const char *data, uint32_t length); // NULL to cut off the text instead
+} FormatOutput;
+
+static void formatCharacters(FormatOutput *output, const char *characters, uint32_t count) {
+    output->length += count;
+
+    while (count > 0) {
+        if (output->position == output->size) {
+            if (output->writeOut == NULL)
+                return;
+            output->writeOut(output->buffer, output->position);
+            output->position = 0;
+        }
+
+        uint32_t copyCount = min(count, output->size - output->position);
+        for (uint32_t i = 0; i < copyCount; ++i)
+            output->buffer[output->position + i] = characters[i];
+        output->position += copyCount;
+        characters += copyCount;
+        count -= copyCount;
     }
 }
 
+static void formatCharacter(FormatOutput *output, char character) {
+    formatCharacters(output, &character, 1);
+}
+
+static void formatNumber(FormatOutput *output, uint64_t number, bool sign, uint8_t radix, bool capital) {
+    char digits[FORMAT_MAX_DIGITS + 1]; // 1 for the sign
+    char *end = digits + sizeof(digits);
+    char *start = sign ? formatSigned(end, (int64_t)number, radix, capital) : formatUnsigned(end, number, radix, capital);
+    formatCharacters(output, start, end - start);
+}
+
 #define PRINTF_STATE_NORMAL 0
 #define PRINTF_STATE_LENGTH 1
 #define PRINTF_STATE_LENGTH_SHORT 2
@@ -137,10 +271,7 @@ void printf_number_signed(int64_t number, uint8_t radix, bool capital) {
 #define PRINTF_SIGN_DEFAULT false
 #define PRINTF_CAPITAL_DEFAULT false
 
-void ASMCALL printf(const char *format, ...) {
-    va_list args;
-    va_start(args, format);
-
+static void formatText(FormatOutput *output, const char *format, va_list args) {
     uint8_t state = PRINTF_STATE_NORMAL;
     uint8_t length = PRINTF_LENGTH_DEFAULT;
     uint8_t radix = PRINTF_RADIX_DEFAULT;
@@ -156,7 +287,7 @@ void ASMCALL printf(const char *format, ...) {
                 state = PRINTF_STATE_LENGTH;
                 break;
             default:
-                putc(*format);
+                formatCharacter(output, *format);
                 break;
             }
             break;
@@ -198,13 +329,15 @@ void ASMCALL printf(const char *format, ...) {
         PRINTF_STATE_SPECIFIER_:
             switch (*format) {
             case 'c':
-                putc((char)va_arg(args, int));
+                formatCharacter(output, (char)va_arg(args, int));
                 break;
-            case 's':
-                puts(va_arg(args, const char *));
+            case 's': {
+                const char *string = va_arg(args, const char *);
+                formatCharacters(output, string, strlen(string));
                 break;
+            }
             case '%':
-                putc('%');
+                formatCharacter(output, '%');
                 break;
             case 'd':
             case 'i':
@@ -231,21 +364,22 @@ void ASMCALL printf(const char *format, ...) {
                 break;
             }
 
+            // everything up to long is 32 bits, those are formatted without ever touching 64-bit numbers
             if (number) {
                 if (sign)
                     switch (length) {
                     case PRINTF_LENGTH_SHORT_SHORT:
                     case PRINTF_LENGTH_SHORT:
                     case PRINTF_LENGTH_DEFAULT:
-                        printf_number_signed(va_arg(args, int), radix, capital);
+                        formatNumber(output, va_arg(args, int), true, radix, capital);
                         break;
 
                     case PRINTF_LENGTH_LONG:
-                        printf_number_signed(va_arg(args, long), radix, capital);
+                        formatNumber(output, va_arg(args, long), true, radix, capital);
                         break;
 
                     case PRINTF_LENGTH_LONG_LONG:
-                        printf_number_signed(va_arg(args, long long), radix, capital);
+                        formatNumber(output, va_arg(args, long long), true, radix, capital);
                         break;
                     }
                 else
@@ -253,15 +387,15 @@ void ASMCALL printf(const char *format, ...) {
                     case PRINTF_LENGTH_SHORT_SHORT:
                     case PRINTF_LENGTH_SHORT:
                     case PRINTF_LENGTH_DEFAULT:
-                        printf_number_unsigned(va_arg(args, unsigned), radix, capital);
+                        formatNumber(output, va_arg(args, unsigned), false, radix, capital);
                         break;
 
                     case PRINTF_LENGTH_LONG:
-                        printf_number_unsigned(va_arg(args, unsigned long), radix, capital);
+                        formatNumber(output, va_arg(args, unsigned long), false, radix, capital);
                         break;
 
                     case PRINTF_LENGTH_LONG_LONG:
-                        printf_number_unsigned(va_arg(args, unsigned long long), radix, capital);
+                        formatNumber(output, va_arg(args, unsigned long long), false, radix, capital);
                         break;
                     }
             }
@@ -277,15 +411,52 @@ void ASMCALL printf(const char *format, ...) {
 
         ++format;
     }
+}
+
+void ASMCALL printf(const char *format, ...) {
+    char buffer[PRINTF_BUFFER_SIZE];
+    FormatOutput output = {buffer, sizeof(buffer), 0, 0, writeOutput};
+
+    va_list args;
+    va_start(args, format);
+    formatText(&output, format, args);
+    va_end(args);
+
+    writeOutput(buffer, output.position);
+}
+
+// formats into `buffer` instead of printing, what doesn't fit in `size` (including the null terminator) is cut off
+// returns the length the whole text would have had
+int vsnprintf(char *buffer, size_t size, const char *format, va_list args) {
+    FormatOutput output = {buffer, size > 0 ? size - 1 : 0, 0, 0, NULL};
+    formatText(&output, format, args);
+
+    if (size > 0)
+        buffer[output.position] = '\0';
+    return output.length;
+}
 
+int snprintf(char *buffer, size_t size, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, size, format, args);
     va_end(args);
+    return length;
 }
 
 void printBuffer(const void *buffer, uint32_t count) {
-    const char *charBuffer = (const char *)buffer;
+    const uint8_t *byteBuffer = (const uint8_t *)buffer;
+    char hex[PRINTF_BUFFER_SIZE];
+    uint32_t hexLength = 0;
 
     for (uint32_t i = 0; i < count; i++) {
-        putc(g_HexChars[(charBuffer[i] >> 4) & 0xF]);
-        putc(g_HexChars[charBuffer[i] & 0xF]);
+        if (hexLength == sizeof(hex)) {
+            writeOutput(hex, hexLength);
+            hexLength = 0;
+        }
+        hex[hexLength++] = g_HexChars[byteBuffer[i] >> 4];
+        hex[hexLength++] = g_HexChars[byteBuffer[i] & 0xF];
     }
+
+    writeOutput(hex, hexLength);
 }
@@ -1,9 +1,26 @@
+#include "font.h"
+#include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 
+#define OUTPUT_BUFFER_SIZE 256      // characters that can be pending before they're flushed, whatever the buffer mode
+#define OUTPUT_FLUSH_INTERVAL_MS 20 // the log is drained at least this often, even if nothing flushes it
+
+typedef enum {
+    OUTPUT_UNBUFFERED = 0,
+    OUTPUT_LINE_BUFFERED = 1,
+    OUTPUT_FULLY_BUFFERED = 2,
+} OutputBufferMode;
+
 void setCursorPosition(uint16_t x, uint16_t y);
+void setOutputBufferMode(OutputBufferMode mode);
+void flushOutput();
 
 void putc(char c);
 void puts(const char *buf);
 void printf(const char *format, ...);
+int vsnprintf(char *buffer, size_t size, const char *format, va_list args);
+int snprintf(char *buffer, size_t size, const char *format, ...);
 void printBuffer(const void *buffer, uint32_t count);
 void clearScreen();
+int setFont(FAT_Filesystem *fontsFilesystem, const FONT_FontInfo *fontInfo);
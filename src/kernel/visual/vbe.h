@@ -37,5 +37,21 @@ typedef struct {
     uint32_t framebuffer; // physical address of the linear frame buffer; write here to draw to the screen
     uint32_t offScreenMemoryOffset;
     uint16_t offScreenMemorySize; // size of memory in the framebuffer but not being displayed on the screen
-    uint8_t __reserved[206];
+
+    // vbe 3.0
+    uint16_t linearPitch; // bytes per line in linear frame buffer modes
+    uint8_t bankedImagePages;
+    uint8_t linearImagePages;
+    uint8_t linearRedMask;
+    uint8_t linearRedPosition;
+    uint8_t linearGreenMask;
+    uint8_t linearGreenPosition;
+    uint8_t linearBlueMask;
+    uint8_t linearBluePosition;
+    uint8_t linearReservedMask;
+    uint8_t linearReservedPosition;
+    uint32_t maxPixelClock;
+
+    uint16_t virtualHeight; // not part of vbe, lines of video memory the display start can be moved over, filled in by stage 2
+    uint8_t __reserved[188];
 } __attribute__((packed)) VbeModeInfo;
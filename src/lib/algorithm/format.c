@@ -0,0 +1,110 @@
+#include "format.h"
+#include "math.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+static const char g_Digits[] = "0123456789abcdef";
+static const char g_CapitalDigits[] = "0123456789ABCDEF";
+
+// "00" to "99", so decimal numbers are done two digits per division
+static const char g_DigitPairs[200] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// 64 by 32 bit division, in two steps so that each fits the `div` instruction
+static uint64_t divide(uint64_t dividend, uint32_t divisor, uint32_t *remainderOutput) {
+    uint32_t high = dividend >> 32;
+    uint32_t highQuotient = high / divisor;
+    high %= divisor; // now the quotient of the rest fits in 32 bits
+
+    uint32_t lowQuotient;
+    __asm__("divl %4" : "=a"(lowQuotient), "=d"(*remainderOutput) : "a"((uint32_t)dividend), "d"(high), "rm"(divisor));
+    return ((uint64_t)highQuotient << 32) | lowQuotient;
+}
+
+// number / 100 for every 32-bit number, multiplying by the reciprocal (2^37 / 100, rounded up) is a lot faster than `div`
+static uint32_t divideBy100(uint32_t number) {
+    return ((uint64_t)number * 0x51EB851F) >> 37;
+}
+
+static char *formatDecimal(char *end, uint32_t number) {
+    while (number >= 100) {
+        uint32_t quotient = divideBy100(number);
+        const char *pair = &g_DigitPairs[(number - quotient * 100) * 2];
+        *--end = pair[1];
+        *--end = pair[0];
+        number = quotient;
+    }
+
+    if (number >= 10) {
+        *--end = g_DigitPairs[number * 2 + 1];
+        *--end = g_DigitPairs[number * 2];
+    } else {
+        *--end = '0' + number;
+    }
+
+    return end;
+}
+
+static char *formatUnsigned32(char *end, uint32_t number, uint8_t radix, const char *digits) {
+    if (radix == 10)
+        return formatDecimal(end, number);
+
+    if ((radix & (radix - 1)) == 0) {
+        uint8_t shift = findLowestSetBit(radix);
+        do {
+            *--end = digits[number & (radix - 1)];
+            number >>= shift;
+        } while (number > 0);
+        return end;
+    }
+
+    do {
+        *--end = digits[number % radix];
+        number /= radix;
+    } while (number > 0);
+    return end;
+}
+
+char *formatUnsigned(char *end, uint64_t number, uint8_t radix, bool capital) {
+    const char *digits = capital ? g_CapitalDigits : g_Digits;
+
+    // most numbers fit in 32 bits, the digits above that are taken off first
+    if (radix == 10) {
+        while (number > UINT32_MAX) {
+            uint32_t lowDigits;
+            number = divide(number, 1000000000, &lowDigits);
+
+            char *start = formatDecimal(end, lowDigits);
+            while (end - start < 9)
+                *--start = '0';
+            end = start;
+        }
+    } else if ((radix & (radix - 1)) == 0) {
+        uint8_t shift = findLowestSetBit(radix);
+        while (number > UINT32_MAX) {
+            *--end = digits[number & (radix - 1)];
+            number >>= shift;
+        }
+    } else {
+        while (number > UINT32_MAX) {
+            uint32_t remainder;
+            number = divide(number, radix, &remainder);
+            *--end = digits[remainder];
+        }
+    }
+
+    return formatUnsigned32(end, number, radix, digits);
+}
+
+char *formatSigned(char *end, int64_t number, uint8_t radix, bool capital) {
+    if (number >= 0)
+        return formatUnsigned(end, number, radix, capital);
+
+    char *start = formatUnsigned(end, 0 - (uint64_t)number, radix, capital); // negated as unsigned, so INT64_MIN works too
+    *--start = '-';
+    return start;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FORMAT_MAX_DIGITS 64 // a uint64_t in binary, every other radix needs fewer
+
+// number to text without the slow 64-bit division helpers of i686, the radix can be 2 to 16
+// the digits are written backwards so that they end right before `end`, returns where they start
+char *formatUnsigned(char *end, uint64_t number, uint8_t radix, bool capital);
+char *formatSigned(char *end, int64_t number, uint8_t radix, bool capital); // needs room for one more character, the '-'
@@ -27,3 +27,15 @@ uint8_t findLowestSetBit(uint64_t number) {
 
     return index;
 }
+
+// returns 0xFF (255) is no bits are set
+uint8_t findHighestSetBit(uint64_t number) {
+    if (number == 0)
+        return 0xFF;
+
+    uint8_t index = 0;
+    while (number >>= 1)
+        ++index;
+
+    return index;
+}
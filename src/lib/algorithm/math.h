@@ -8,3 +8,4 @@
 uint32_t min(uint32_t firstNumber, uint32_t secondNumber);
 uint32_t max(uint32_t firstNumber, uint32_t secondNumber);
 uint8_t findLowestSetBit(uint64_t number);
+uint8_t findHighestSetBit(uint64_t number);
@@ -0,0 +1,905 @@
+#include "ahci.h"
+#include "ata.h"
+#include "disk.h"
+#include <lib/algorithm/math.h>
+#include <lib/errors/errors.h>
+#include <lib/interrupt/irq/irq.h>
+#include <lib/memory/allocator.h>
+#include <lib/memory/memory.h>
+#include <lib/pci/pci.h>
+#include <lib/time/tsc.h>
+#include <lib/x86/general.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// pci class of an ahci controller
+#define AHCI_PCI_CLASS 0x01    // mass storage
+#define AHCI_PCI_SUBCLASS 0x06 // sata
+#define AHCI_PCI_PROG_IF 0x01  // ahci 1.0
+#define AHCI_PCI_BAR 5         // abar, the memory mapped registers
+#define AHCI_PCI_BAR_FLAGS 0xF
+
+#define AHCI_MAX_PORTS 32
+#define AHCI_MAX_SLOTS 32
+#define AHCI_PRDT_ENTRIES 8                // per command, every io vector needs at least one
+#define AHCI_PRDT_MAX_SECTORS 0x2000       // 4 MiB per entry
+#define AHCI_MAX_SECTORS_48BIT 65536       // 0 means 65536
+#define AHCI_MAX_SECTORS_28BIT 256         // 0 means 256
+#define AHCI_RECEIVED_FIS_OFFSET 0x400     // the received fis area is put right after the command list
+#define AHCI_LOG_SECTOR_SIZE 512
+
+// other
+#define DEFAULT_AHCI_TIMEOUT_MS 30000 // 30 seconds
+#define AHCI_IRQ_TIMEOUT_MS 100       // if the controller hasn't interrupted by then, we fall back to polling
+#define AHCI_PORT_STOP_TIMEOUT_MS 500
+
+// host capabilities
+#define AHCI_CAP_COMMAND_SLOTS(capabilities) ((((capabilities) >> 8) & 0x1F) + 1)
+#define AHCI_CAP_NCQ 0x40000000
+#define AHCI_CAP2_BIOS_HANDOFF 0x00000001
+
+// global host control
+#define AHCI_GHC_INTERRUPT_ENABLE 0x00000002
+#define AHCI_GHC_AHCI_ENABLE 0x80000000
+
+// bios/os handoff
+#define AHCI_BOHC_BIOS_OWNED 0x00000001
+#define AHCI_BOHC_OS_OWNED 0x00000002
+
+// port command and status
+#define AHCI_PORT_CMD_START 0x00000001
+#define AHCI_PORT_CMD_FIS_RECEIVE_ENABLE 0x00000010
+#define AHCI_PORT_CMD_FIS_RECEIVE_RUNNING 0x00004000
+#define AHCI_PORT_CMD_LIST_RUNNING 0x00008000
+
+// port interrupt status/enable
+#define AHCI_PORT_IS_D2H_REGISTER_FIS 0x00000001
+#define AHCI_PORT_IS_PIO_SETUP_FIS 0x00000002
+#define AHCI_PORT_IS_DMA_SETUP_FIS 0x00000004
+#define AHCI_PORT_IS_SET_DEVICE_BITS_FIS 0x00000008
+#define AHCI_PORT_IS_INTERFACE_FATAL 0x08000000
+#define AHCI_PORT_IS_HOST_BUS_DATA 0x10000000
+#define AHCI_PORT_IS_HOST_BUS_FATAL 0x20000000
+#define AHCI_PORT_IS_TASK_FILE 0x40000000
+#define AHCI_PORT_IS_ERRORS (AHCI_PORT_IS_INTERFACE_FATAL | AHCI_PORT_IS_HOST_BUS_DATA | AHCI_PORT_IS_HOST_BUS_FATAL | AHCI_PORT_IS_TASK_FILE)
+#define AHCI_PORT_IE_DEFAULT (AHCI_PORT_IS_D2H_REGISTER_FIS | AHCI_PORT_IS_PIO_SETUP_FIS | AHCI_PORT_IS_DMA_SETUP_FIS | AHCI_PORT_IS_SET_DEVICE_BITS_FIS | AHCI_PORT_IS_ERRORS)
+
+// sata status
+#define AHCI_SSTS_DETECTION(status) ((status) & 0x0F)
+#define AHCI_SSTS_POWER(status) (((status) >> 8) & 0x0F)
+#define AHCI_SSTS_DEVICE_PRESENT 3
+#define AHCI_SSTS_ACTIVE 1
+
+#define AHCI_SIGNATURE_ATA 0x00000101 // atapi, port multipliers etc... aren't supported
+
+// task file data, the low byte is the ata status register
+#define AHCI_TFD_BSY 0x80
+#define AHCI_TFD_DRQ 0x08
+#define AHCI_TFD_ERR 0x01
+
+// command header flags
+#define AHCI_HEADER_WRITE 0x0040
+#define AHCI_HEADER_PREFETCHABLE 0x0080
+
+// fis
+#define AHCI_FIS_TYPE_REGISTER_H2D 0x27
+#define AHCI_FIS_H2D_COMMAND 0x80 // the fis carries a command, rather than a control register update
+#define AHCI_FIS_DEVICE_LBA 0x40
+#define AHCI_FIS_DEVICE_FUA 0x80 // for FPDMA QUEUED commands
+
+// commands
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_READ_DMA_EXTENDED 0x25
+#define ATA_CMD_WRITE_DMA_EXTENDED 0x35
+#define ATA_CMD_WRITE_DMA_FUA_EXTENDED 0x3D
+#define ATA_CMD_READ_FPDMA_QUEUED 0x60
+#define ATA_CMD_WRITE_FPDMA_QUEUED 0x61
+#define ATA_CMD_READ_LOG_EXTENDED 0x2F
+#define ATA_CMD_IDENTIFY 0xEC
+#define ATA_CMD_CACHE_FLUSH 0xE7
+#define ATA_CMD_CACHE_FLUSH_EXTENDED 0xEA
+
+#define ATA_LOG_NCQ_ERROR 0x10 // reading it gets the drive out of the error state after a failed ncq command
+
+// what a request does besides transferring its sectors, each is cleared once it has been issued
+#define AHCI_REQUEST_PRE_FLUSH 0x01  // flush the cache before the first command
+#define AHCI_REQUEST_FUA 0x02        // write with fua
+#define AHCI_REQUEST_POST_FLUSH 0x04 // flush the cache after the last command
+
+typedef volatile struct {
+    uint32_t commandListBase;
+    uint32_t commandListBaseUpper;
+    uint32_t fisBase;
+    uint32_t fisBaseUpper;
+    uint32_t interruptStatus;
+    uint32_t interruptEnable;
+    uint32_t command;
+    uint32_t reserved0;
+    uint32_t taskFileData;
+    uint32_t signature;
+    uint32_t sataStatus;
+    uint32_t sataControl;
+    uint32_t sataError;
+    uint32_t sataActive;
+    uint32_t commandIssue;
+    uint32_t sataNotification;
+    uint32_t fisBasedSwitchingControl;
+    uint32_t reserved1[11];
+    uint32_t vendor[4];
+} AHCI_PortRegisters;
+
+typedef volatile struct {
+    uint32_t capabilities;
+    uint32_t globalHostControl;
+    uint32_t interruptStatus;
+    uint32_t portsImplemented;
+    uint32_t version;
+    uint32_t commandCompletionCoalescingControl;
+    uint32_t commandCompletionCoalescingPorts;
+    uint32_t enclosureManagementLocation;
+    uint32_t enclosureManagementControl;
+    uint32_t capabilitiesExtended;
+    uint32_t biosHandoffControl;
+    uint8_t reserved[0x74];
+    uint8_t vendor[0x60];
+    AHCI_PortRegisters ports[AHCI_MAX_PORTS];
+} AHCI_HostRegisters;
+
+typedef struct {
+    uint16_t flags; // fis length in dwords (bits 0-4), AHCI_HEADER_...
+    uint16_t prdtLength;
+    volatile uint32_t prdByteCount;
+    uint32_t commandTableBase;
+    uint32_t commandTableBaseUpper;
+    uint32_t reserved[4];
+} __attribute__((packed)) AHCI_CommandHeader;
+
+typedef struct {
+    uint32_t dataBase;
+    uint32_t dataBaseUpper;
+    uint32_t reserved;
+    uint32_t byteCount; // minus 1, bits 0-21
+} __attribute__((packed)) AHCI_PrdtEntry;
+
+// 256 bytes, so every table in an array is 128 byte aligned like the controller needs
+typedef struct {
+    uint8_t commandFis[64];
+    uint8_t atapiCommand[16];
+    uint8_t reserved[48];
+    AHCI_PrdtEntry prdt[AHCI_PRDT_ENTRIES];
+} __attribute__((packed)) AHCI_CommandTable;
+
+typedef struct {
+    uint8_t type;
+    uint8_t flags; // port multiplier (bits 0-3), AHCI_FIS_H2D_COMMAND
+    uint8_t command;
+    uint8_t featureLow;
+    uint8_t lba0;
+    uint8_t lba1;
+    uint8_t lba2;
+    uint8_t device;
+    uint8_t lba3;
+    uint8_t lba4;
+    uint8_t lba5;
+    uint8_t featureHigh;
+    uint8_t countLow;
+    uint8_t countHigh;
+    uint8_t isochronousCommandCompletion;
+    uint8_t control;
+    uint8_t reserved[4];
+} __attribute__((packed)) AHCI_RegisterH2DFis;
+
+// a read, write or flush waiting for, or being run on, a port
+// a request is split into as many commands as it needs, and with ncq they are all outstanding at once
+typedef struct AHCI_Request {
+    bool write;
+    uint8_t flags;
+    uint64_t lba;              // first sector not covered by an issued command yet
+    uint64_t remainingSectors; // sectors not covered by an issued command yet
+    DISK_IoVectorCursor cursor;
+    uint32_t outstandingCommands;
+    bool fullyIssued;
+    volatile bool completed;
+    int status;
+    DISK_Command *command; // set if it came from the scheduler, which is told once it completes
+    struct AHCI_Request *next;
+} AHCI_Request;
+
+_Static_assert(sizeof(AHCI_Request) <= DISK_COMMAND_DRIVER_STORAGE, "AHCI_Request has to fit in DISK_Command::driverStorage");
+
+typedef struct {
+    uint8_t index;
+    AHCI_PortRegisters *registers;
+    AHCI_CommandHeader *commandList; // followed by the received fis area
+    AHCI_CommandTable *commandTables;
+    void *logBuffer; // for reading the ncq error log
+
+    bool supports48BitLba;
+    bool supportsFlush;
+    bool supportsFlushExtended;
+    bool supportsFua;
+    uint64_t sectorCount;
+
+    bool ncq;
+    uint8_t slotCount;  // commands that may be outstanding at once
+    uint32_t busySlots; // slots with a command issued to the drive
+    bool nonQueuedBusy; // a non ncq command is outstanding, it has to run alone
+    AHCI_Request *slotRequests[AHCI_MAX_SLOTS];
+    AHCI_Request *queueHead; // requests with commands left to issue, oldest first
+    AHCI_Request *queueTail;
+    AHCI_Request *finishedHead; // finished requests from the scheduler, it's told once the port is in a consistent state again
+    bool restartPending;        // a command failed in the irq handler, the port is restarted by the next one waiting on or submitting to it
+    volatile uint64_t lastProgressMs;
+} AHCI_Port;
+
+static AHCI_HostRegisters *g_Host = NULL;
+static AHCI_Port *g_Ports[AHCI_MAX_PORTS] = {NULL};
+static bool g_UsingInterrupts = false;
+
+// returns false if the timeout is reached
+static bool waitForPortBitsClear(volatile uint32_t *reg, uint32_t bits, uint64_t timeoutMs) {
+    uint64_t endTimeMs = TSC_GetTimeMs() + timeoutMs;
+
+    while ((*reg & bits) && TSC_GetTimeMs() < endTimeMs)
+        ;
+
+    return !(*reg & bits);
+}
+
+static bool stopPort(AHCI_Port *port) {
+    port->registers->command &= ~AHCI_PORT_CMD_START;
+    if (!waitForPortBitsClear(&port->registers->command, AHCI_PORT_CMD_LIST_RUNNING, AHCI_PORT_STOP_TIMEOUT_MS))
+        return false;
+
+    port->registers->command &= ~AHCI_PORT_CMD_FIS_RECEIVE_ENABLE;
+    return waitForPortBitsClear(&port->registers->command, AHCI_PORT_CMD_FIS_RECEIVE_RUNNING, AHCI_PORT_STOP_TIMEOUT_MS);
+}
+
+static bool startPort(AHCI_Port *port) {
+    if (!waitForPortBitsClear(&port->registers->taskFileData, AHCI_TFD_BSY | AHCI_TFD_DRQ, DEFAULT_AHCI_TIMEOUT_MS))
+        return false;
+
+    port->registers->command |= AHCI_PORT_CMD_FIS_RECEIVE_ENABLE;
+    port->registers->command |= AHCI_PORT_CMD_START;
+    return true;
+}
+
+static int findFreeSlot(AHCI_Port *port) {
+    for (uint8_t slot = 0; slot < port->slotCount; ++slot)
+        if (!(port->busySlots & (1u << slot)))
+            return slot;
+
+    return -1;
+}
+
+static void fillCommandFis(AHCI_CommandTable *table, uint8_t command, uint64_t lba, uint32_t count, bool lbaMode) {
+    AHCI_RegisterH2DFis *fis = (AHCI_RegisterH2DFis *)table->commandFis;
+
+    memset(fis, 0, sizeof(AHCI_RegisterH2DFis));
+    fis->type = AHCI_FIS_TYPE_REGISTER_H2D;
+    fis->flags = AHCI_FIS_H2D_COMMAND;
+    fis->command = command;
+    fis->device = lbaMode ? AHCI_FIS_DEVICE_LBA : 0;
+    fis->lba0 = lba & 0xFF;
+    fis->lba1 = (lba >> 8) & 0xFF;
+    fis->lba2 = (lba >> 16) & 0xFF;
+    fis->lba3 = (lba >> 24) & 0xFF;
+    fis->lba4 = (lba >> 32) & 0xFF;
+    fis->lba5 = (lba >> 40) & 0xFF;
+    fis->countLow = count & 0xFF; // 65536 (or 256) is truncated to 0, which is what the drive expects
+    fis->countHigh = (count >> 8) & 0xFF;
+}
+
+static void fillCommandHeader(AHCI_Port *port, uint8_t slot, uint16_t prdtLength, bool write) {
+    AHCI_CommandHeader *header = &port->commandList[slot];
+
+    header->flags = (sizeof(AHCI_RegisterH2DFis) / sizeof(uint32_t)) | (write ? AHCI_HEADER_WRITE : AHCI_HEADER_PREFETCHABLE);
+    header->prdtLength = prdtLength;
+    header->prdByteCount = 0;
+}
+
+// points the prdt of `table` at the buffers at `cursor`, returns the sectors covered (at most `maxSectors`)
+static uint32_t fillPrdt(AHCI_CommandTable *table, DISK_IoVectorCursor *cursor, uint32_t maxSectors, uint16_t *prdtLengthOutput) {
+    uint32_t sectors = 0;
+    uint16_t entry = 0;
+
+    while (sectors < maxSectors && entry < AHCI_PRDT_ENTRIES) {
+        uint32_t take = min(min(maxSectors - sectors, cursor->vector->sectorCount - cursor->sectorOffset), AHCI_PRDT_MAX_SECTORS);
+
+        if (take > 0) {
+            table->prdt[entry].dataBase = (uint32_t)(cursor->vector->buffer + cursor->sectorOffset * 512);
+            table->prdt[entry].dataBaseUpper = 0;
+            table->prdt[entry].reserved = 0;
+            table->prdt[entry].byteCount = take * 512 - 1;
+            ++entry;
+        }
+
+        sectors += take;
+        cursor->sectorOffset += take;
+        if (cursor->sectorOffset == cursor->vector->sectorCount) {
+            ++cursor->vector;
+            cursor->sectorOffset = 0;
+        }
+    }
+
+    *prdtLengthOutput = entry;
+    return sectors;
+}
+
+static void issueCommand(AHCI_Port *port, uint8_t slot, AHCI_Request *request, bool queued) {
+    port->busySlots |= 1u << slot;
+    port->slotRequests[slot] = request;
+    ++request->outstandingCommands;
+    port->lastProgressMs = TSC_GetTimeMs();
+
+    // for ncq the slot has to be marked active before it's issued
+    if (queued)
+        port->registers->sataActive = 1u << slot;
+    else
+        port->nonQueuedBusy = true;
+    port->registers->commandIssue = 1u << slot;
+}
+
+// issues the next read/write command of a request, ncq if possible, otherwise dma
+static int issueReadWrite(AHCI_Port *port, uint8_t slot, AHCI_Request *request) {
+    AHCI_CommandTable *table = &port->commandTables[slot];
+    bool fua = request->write && (request->flags & AHCI_REQUEST_FUA);
+
+    uint32_t maxSectors = port->supports48BitLba ? AHCI_MAX_SECTORS_48BIT : AHCI_MAX_SECTORS_28BIT;
+    if (request->lba + min(request->remainingSectors, maxSectors) > port->sectorCount)
+        return port->supports48BitLba ? ATA_LBA_TOO_LARGE_48BIT_ERROR : ATA_LBA_TOO_LARGE_28BIT_ERROR;
+
+    uint16_t prdtLength;
+    uint32_t sectors = fillPrdt(table, &request->cursor, min(request->remainingSectors, maxSectors), &prdtLength);
+
+    if (port->ncq) {
+        // queued commands carry the sector count in the feature register, and the tag in the count register
+        fillCommandFis(table, request->write ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED, request->lba, 0, true);
+
+        AHCI_RegisterH2DFis *fis = (AHCI_RegisterH2DFis *)table->commandFis;
+        fis->featureLow = sectors & 0xFF;
+        fis->featureHigh = (sectors >> 8) & 0xFF;
+        fis->countLow = slot << 3;
+        if (fua)
+            fis->device |= AHCI_FIS_DEVICE_FUA;
+    } else if (port->supports48BitLba) {
+        uint8_t command = fua ? ATA_CMD_WRITE_DMA_FUA_EXTENDED : (request->write ? ATA_CMD_WRITE_DMA_EXTENDED : ATA_CMD_READ_DMA_EXTENDED);
+        fillCommandFis(table, command, request->lba, sectors, true);
+    } else {
+        fillCommandFis(table, request->write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA, request->lba & 0xFFFFFF, sectors, true);
+        ((AHCI_RegisterH2DFis *)table->commandFis)->device |= (request->lba >> 24) & 0x0F;
+    }
+
+    fillCommandHeader(port, slot, prdtLength, request->write);
+
+    request->lba += sectors;
+    request->remainingSectors -= sectors;
+    issueCommand(port, slot, request, port->ncq);
+
+    return NO_ERROR;
+}
+
+// returns false if the drive has no cache to flush, in which case nothing is issued
+static bool issueFlush(AHCI_Port *port, AHCI_Request *request) {
+    uint8_t command;
+    if (port->supports48BitLba && port->supportsFlushExtended)
+        command = ATA_CMD_CACHE_FLUSH_EXTENDED;
+    else if (port->supportsFlush)
+        command = ATA_CMD_CACHE_FLUSH;
+    else
+        return false;
+
+    // flushes are only issued on an idle port, so slot 0 is always free
+    fillCommandFis(&port->commandTables[0], command, 0, 0, false);
+    fillCommandHeader(port, 0, 0, false);
+    issueCommand(port, 0, request, false);
+
+    return true;
+}
+
+static void finishRequest(AHCI_Port *port, AHCI_Request *request) {
+    request->completed = true;
+
+    if (request->command != NULL) {
+        request->next = port->finishedHead;
+        port->finishedHead = request;
+    }
+}
+
+// the scheduler may submit new requests from here, so this is only called once the port is done issuing, completing or restarting
+static void reportFinishedRequests(AHCI_Port *port) {
+    while (port->finishedHead != NULL) {
+        AHCI_Request *request = port->finishedHead;
+        port->finishedHead = request->next;
+
+        DISK_CompleteCommand(request->command, request->status);
+    }
+}
+
+// issues commands for the queued requests until the port runs out of slots, must be called with interrupts disabled
+// requests are issued in order, and a flush waits for everything before it since it can't be queued
+static void issueCommands(AHCI_Port *port) {
+    while (port->queueHead != NULL && !port->nonQueuedBusy && !port->restartPending) {
+        AHCI_Request *request = port->queueHead;
+
+        if (request->flags & AHCI_REQUEST_PRE_FLUSH) {
+            if (port->busySlots != 0)
+                return;
+
+            request->flags &= ~AHCI_REQUEST_PRE_FLUSH;
+            if (issueFlush(port, request))
+                return;
+            continue;
+        }
+
+        if (request->remainingSectors > 0) {
+            int slot = findFreeSlot(port);
+            if (slot < 0 || (!port->ncq && port->busySlots != 0))
+                return;
+
+            int status = issueReadWrite(port, slot, request);
+            if (status != NO_ERROR) {
+                request->status = status;
+                request->remainingSectors = 0;
+                request->flags = 0;
+            }
+            continue;
+        }
+
+        if (request->flags & AHCI_REQUEST_POST_FLUSH) {
+            if (port->busySlots != 0)
+                return;
+
+            request->flags &= ~AHCI_REQUEST_POST_FLUSH;
+            if (issueFlush(port, request))
+                return;
+            continue;
+        }
+
+        // everything has been issued, the request is done once its last command completes
+        port->queueHead = request->next;
+        if (port->queueHead == NULL)
+            port->queueTail = NULL;
+
+        request->fullyIssued = true;
+        if (request->outstandingCommands == 0)
+            finishRequest(port, request);
+    }
+}
+
+static void completeSlot(AHCI_Port *port, uint8_t slot, int status) {
+    AHCI_Request *request = port->slotRequests[slot];
+
+    port->slotRequests[slot] = NULL;
+    port->busySlots &= ~(1u << slot);
+    if (port->busySlots == 0)
+        port->nonQueuedBusy = false;
+
+    // nothing more of a failed request is issued, the first error is the one reported
+    if (status != NO_ERROR) {
+        if (request->status == NO_ERROR)
+            request->status = status;
+        request->remainingSectors = 0;
+        request->flags = 0;
+    }
+
+    if (--request->outstandingCommands == 0 && request->fullyIssued)
+        finishRequest(port, request);
+}
+
+// runs a single non queued command and polls for it, only used while nothing else is issued on the port
+static int runPolledCommand(AHCI_Port *port, uint8_t command, uint64_t lba, uint16_t count, void *buffer, uint32_t bytes) {
+    AHCI_CommandTable *table = &port->commandTables[0];
+
+    fillCommandFis(table, command, lba, count, false);
+    table->prdt[0].dataBase = (uint32_t)buffer;
+    table->prdt[0].dataBaseUpper = 0;
+    table->prdt[0].reserved = 0;
+    table->prdt[0].byteCount = bytes - 1;
+    fillCommandHeader(port, 0, 1, false);
+
+    port->registers->interruptStatus = port->registers->interruptStatus;
+    port->registers->commandIssue = 1;
+
+    uint64_t endTimeMs = TSC_GetTimeMs() + DEFAULT_AHCI_TIMEOUT_MS;
+    while ((port->registers->commandIssue & 1) && !(port->registers->interruptStatus & AHCI_PORT_IS_ERRORS)) {
+        if (TSC_GetTimeMs() >= endTimeMs)
+            return TIMEOUT_ERROR;
+    }
+
+    uint32_t interruptStatus = port->registers->interruptStatus;
+    port->registers->interruptStatus = interruptStatus;
+
+    if (interruptStatus & AHCI_PORT_IS_ERRORS || port->registers->taskFileData & AHCI_TFD_ERR)
+        return AHCI_TASK_FILE_ERROR;
+    return NO_ERROR;
+}
+
+// gets the port running again after an error, every outstanding command has been failed already
+// this waits for the port and the drive, so it's never done in the irq handler
+static void restartPort(AHCI_Port *port) {
+    port->restartPending = false;
+    stopPort(port);
+    port->registers->sataError = 0xFFFFFFFF; // write 1 to clear
+    port->registers->interruptStatus = 0xFFFFFFFF;
+    startPort(port);
+
+    // after a failed ncq command the drive doesn't take new ones until the error log has been read
+    if (port->ncq)
+        runPolledCommand(port, ATA_CMD_READ_LOG_EXTENDED, ATA_LOG_NCQ_ERROR, 1, port->logBuffer, AHCI_LOG_SECTOR_SIZE);
+}
+
+static int errorFromInterruptStatus(uint32_t interruptStatus) {
+    if (interruptStatus & AHCI_PORT_IS_TASK_FILE)
+        return AHCI_TASK_FILE_ERROR;
+    if (interruptStatus & (AHCI_PORT_IS_HOST_BUS_FATAL | AHCI_PORT_IS_HOST_BUS_DATA))
+        return AHCI_HOST_BUS_ERROR;
+    if (interruptStatus & AHCI_PORT_IS_INTERFACE_FATAL)
+        return AHCI_INTERFACE_ERROR;
+    return AHCI_ERROR;
+}
+
+static void failOutstandingCommands(AHCI_Port *port, int status) {
+    for (uint8_t slot = 0; slot < AHCI_MAX_SLOTS; ++slot)
+        if (port->busySlots & (1u << slot))
+            completeSlot(port, slot, status);
+}
+
+// completes the commands the drive is done with and issues new ones, called from the irq handler, or when polling, with interrupts disabled
+static void servicePort(AHCI_Port *port) {
+    uint32_t interruptStatus = port->registers->interruptStatus;
+    port->registers->interruptStatus = interruptStatus; // write 1 to clear
+
+    if (interruptStatus & AHCI_PORT_IS_ERRORS) {
+        // the drive aborts every outstanding command when one fails, so there's no telling which one it was
+        // nothing is issued until the port has been restarted, which has to wait, so it's left to whoever waits on the port next
+        failOutstandingCommands(port, errorFromInterruptStatus(interruptStatus));
+        port->restartPending = true;
+        port->lastProgressMs = TSC_GetTimeMs();
+    } else {
+        // ncq commands are done once their sata active bit clears, other commands once their command issue bit clears
+        uint32_t finishedSlots = port->busySlots & ~(port->registers->commandIssue | port->registers->sataActive);
+
+        if (finishedSlots != 0)
+            port->lastProgressMs = TSC_GetTimeMs();
+        for (uint8_t slot = 0; slot < AHCI_MAX_SLOTS; ++slot)
+            if (finishedSlots & (1u << slot))
+                completeSlot(port, slot, NO_ERROR);
+    }
+
+    issueCommands(port);
+    reportFinishedRequests(port);
+}
+
+// pci interrupts are level triggered, if another port interrupts while we're in here the line stays up and the edge is missed
+// that is caught by the polling fallback in waitForRequest
+static void irqHandler(Registers *registers) {
+    uint32_t pendingPorts = g_Host->interruptStatus;
+
+    for (uint8_t i = 0; i < AHCI_MAX_PORTS; ++i)
+        if ((pendingPorts & (1u << i)) && g_Ports[i] != NULL)
+            servicePort(g_Ports[i]);
+
+    g_Host->interruptStatus = pendingPorts; // only after the ports, or they would raise it again right away
+}
+
+static void submitRequest(AHCI_Port *port, AHCI_Request *request) {
+    request->next = NULL;
+    request->outstandingCommands = 0;
+    request->fullyIssued = false;
+    request->completed = false;
+    request->status = NO_ERROR;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // the irq handler touches the queue too
+
+    if (port->queueTail == NULL)
+        port->queueHead = request;
+    else
+        port->queueTail->next = request;
+    port->queueTail = request;
+
+    if (port->restartPending)
+        restartPort(port);
+    issueCommands(port);
+    reportFinishedRequests(port);
+
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+// halts the cpu until `*completed` is set by a request on the port completing, the irq handler does the work
+// the port is polled from here instead if interrupts aren't used, or if the controller hasn't made progress for AHCI_IRQ_TIMEOUT_MS
+// a restart the irq handler left behind is done from here, the timeouts are measured with the tsc since the pit stops with interrupts disabled
+static void waitUntilCompleted(AHCI_Port *port, volatile bool *completed) {
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // so the irq can't arrive between checking the request and halting
+    bool canHalt = g_UsingInterrupts && interruptsEnabled;
+
+    while (!*completed) {
+        uint64_t idleMs = TSC_GetTimeMs() - port->lastProgressMs;
+
+        if (port->restartPending || (idleMs >= DEFAULT_AHCI_TIMEOUT_MS && port->busySlots != 0)) {
+            failOutstandingCommands(port, TIMEOUT_ERROR); // nothing is outstanding after an error, only after a timeout
+            restartPort(port);
+            port->lastProgressMs = TSC_GetTimeMs();
+            issueCommands(port);
+            reportFinishedRequests(port);
+        } else if (!canHalt || idleMs >= AHCI_IRQ_TIMEOUT_MS) {
+            servicePort(port);
+
+            // the caller had interrupts enabled, so the timer (and everything else) shouldn't have to wait for the port
+            if (interruptsEnabled)
+                x86_AllowInterrupts();
+        } else {
+            x86_EnableInterruptsAndHalt();
+            x86_DisableInterrupts();
+        }
+    }
+
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+static int runRequest(AHCI_Request *request, DISK *disk) {
+    AHCI_Port *port = (AHCI_Port *)disk->driverData;
+    if (port == NULL)
+        return NULL_ERROR;
+
+    submitRequest(port, request);
+    waitUntilCompleted(port, &request->completed);
+
+    return request->status;
+}
+
+// maps DISK_WRITE_... to what the request has to do
+static uint8_t writeRequestFlags(AHCI_Port *port, uint8_t flags) {
+    uint8_t requestFlags = 0;
+
+    if (flags & DISK_WRITE_BARRIER)
+        requestFlags |= AHCI_REQUEST_PRE_FLUSH;
+    if (flags & DISK_WRITE_FUA)
+        requestFlags |= port->supportsFua ? AHCI_REQUEST_FUA : AHCI_REQUEST_POST_FLUSH;
+
+    return requestFlags;
+}
+
+static int transferVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk, bool write, uint8_t requestFlags) {
+    AHCI_Request request = {
+        .write = write,
+        .flags = requestFlags,
+        .lba = lba,
+        .remainingSectors = 0,
+        .cursor = {.vector = vectors, .sectorOffset = 0},
+    };
+    for (uint32_t i = 0; i < vectorCount; ++i)
+        request.remainingSectors += vectors[i].sectorCount;
+
+    return runRequest(&request, disk);
+}
+
+int AHCI_ReadVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk) {
+    return transferVectored(lba, vectors, vectorCount, disk, false, 0);
+}
+
+// the data may stay in the drive cache, unless DISK_WRITE_FUA is passed
+int AHCI_WriteVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags, DISK *disk) {
+    AHCI_Port *port = (AHCI_Port *)disk->driverData;
+    if (port == NULL)
+        return NULL_ERROR;
+
+    return transferVectored(lba, vectors, vectorCount, disk, true, writeRequestFlags(port, flags));
+}
+
+int AHCI_Flush(DISK *disk) {
+    AHCI_Request request = {
+        .write = false,
+        .flags = AHCI_REQUEST_POST_FLUSH,
+        .remainingSectors = 0,
+    };
+
+    return runRequest(&request, disk);
+}
+
+// queues the command on the port and returns, the request lives in the command until it completes
+int AHCI_Submit(DISK_Command *command) {
+    AHCI_Port *port = (AHCI_Port *)command->disk->driverData;
+    if (port == NULL)
+        return NULL_ERROR;
+
+    AHCI_Request *request = (AHCI_Request *)command->driverStorage;
+    *request = (AHCI_Request){
+        .write = command->write,
+        .flags = command->write ? writeRequestFlags(port, command->flags) : 0,
+        .lba = command->lba,
+        .remainingSectors = command->sectorCount,
+        .cursor = {.vector = command->vectors, .sectorOffset = 0},
+        .command = command,
+    };
+
+    submitRequest(port, request);
+    return NO_ERROR;
+}
+
+void AHCI_Wait(DISK *disk, volatile bool *completed) {
+    AHCI_Port *port = (AHCI_Port *)disk->driverData;
+    if (port != NULL)
+        waitUntilCompleted(port, completed);
+}
+
+static void freePort(AHCI_Port *port) {
+    free(port->commandList);
+    free(port->commandTables);
+    free(port->logBuffer);
+    free(port);
+}
+
+// stops the port so the controller no longer writes to its memory, the bootloader has to do this before the kernel reuses that memory
+void AHCI_DeInitialize(DISK *disk) {
+    AHCI_Port *port = (AHCI_Port *)disk->driverData;
+    if (port == NULL)
+        return;
+
+    port->registers->interruptEnable = 0;
+    stopPort(port);
+
+    g_Ports[port->index] = NULL;
+    freePort(port);
+    disk->driverData = NULL;
+}
+
+// the bios may still own the controller, ask it to give it up
+static void takeOwnership() {
+    if (!(g_Host->capabilitiesExtended & AHCI_CAP2_BIOS_HANDOFF))
+        return;
+
+    g_Host->biosHandoffControl |= AHCI_BOHC_OS_OWNED;
+    waitForPortBitsClear(&g_Host->biosHandoffControl, AHCI_BOHC_BIOS_OWNED, AHCI_PORT_STOP_TIMEOUT_MS);
+}
+
+// the identify data is handed to the disk, so it's freed with it
+static int initializePort(uint8_t index, uint32_t capabilities, DISK *diskOutput) {
+    AHCI_Port *port = calloc(1, sizeof(AHCI_Port));
+    if (port == NULL)
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+
+    port->commandList = mallocPageAligned(PAGE_SIZE);
+    port->commandTables = mallocPageAligned(AHCI_MAX_SLOTS * sizeof(AHCI_CommandTable));
+    port->logBuffer = malloc(AHCI_LOG_SECTOR_SIZE);
+    ATA_IdentifyData *identifyData = malloc(sizeof(ATA_IdentifyData));
+    if (port->commandList == NULL || port->commandTables == NULL || port->logBuffer == NULL || identifyData == NULL) {
+        free(identifyData);
+        freePort(port);
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+    }
+
+    port->index = index;
+    port->registers = &g_Host->ports[index];
+    port->slotCount = 1;
+
+    if (!stopPort(port)) {
+        free(identifyData);
+        freePort(port);
+        return AHCI_PORT_HUNG_ERROR;
+    }
+
+    memset(port->commandList, 0, PAGE_SIZE);
+    memset(port->commandTables, 0, AHCI_MAX_SLOTS * sizeof(AHCI_CommandTable));
+    for (uint8_t slot = 0; slot < AHCI_MAX_SLOTS; ++slot) {
+        port->commandList[slot].commandTableBase = (uint32_t)&port->commandTables[slot];
+        port->commandList[slot].commandTableBaseUpper = 0;
+    }
+
+    port->registers->commandListBase = (uint32_t)port->commandList;
+    port->registers->commandListBaseUpper = 0;
+    port->registers->fisBase = (uint32_t)port->commandList + AHCI_RECEIVED_FIS_OFFSET;
+    port->registers->fisBaseUpper = 0;
+    port->registers->sataError = 0xFFFFFFFF; // write 1 to clear
+    port->registers->interruptStatus = 0xFFFFFFFF;
+    port->registers->interruptEnable = 0;
+
+    int status = NO_ERROR;
+    if (!startPort(port))
+        status = AHCI_PORT_HUNG_ERROR;
+    else if ((status = runPolledCommand(port, ATA_CMD_IDENTIFY, 0, 0, identifyData, sizeof(ATA_IdentifyData))) == NO_ERROR && !identifyData->Capabilities.LbaSupported)
+        status = ATA_UNSUPPORTED_DRIVE;
+
+    if (status != NO_ERROR) {
+        stopPort(port);
+        free(identifyData);
+        freePort(port);
+        return status;
+    }
+
+    port->supports48BitLba = identifyData->CommandSetSupport.BigLba && identifyData->CommandSetActive.BigLba;
+    port->supportsFlush = identifyData->CommandSetSupport.FlushCache;
+    port->supportsFlushExtended = identifyData->CommandSetSupport.FlushCacheExt;
+    port->sectorCount = port->supports48BitLba ? identifyData->Max48BitLBA : identifyData->Max28BitLBA;
+
+    // ncq commands are always 48 bit
+    port->ncq = (capabilities & AHCI_CAP_NCQ) && identifyData->SerialAtaCapabilities.NCQ && port->supports48BitLba;
+    if (port->ncq)
+        port->slotCount = min(AHCI_CAP_COMMAND_SLOTS(capabilities), identifyData->QueueDepth + 1);
+
+    // every ncq write can carry fua, otherwise WRITE DMA FUA EXT is needed
+    port->supportsFua = port->ncq || (port->supports48BitLba && identifyData->CommandSetSupport.WriteFua);
+
+    if (g_UsingInterrupts)
+        port->registers->interruptEnable = AHCI_PORT_IE_DEFAULT;
+
+    diskOutput->driver = AHCI_GetDriver();
+    diskOutput->driverData = port;
+    diskOutput->channel = 0;
+    diskOutput->isMaster = true;
+    diskOutput->cylinders = identifyData->NumberOfCurrentCylinders;
+    diskOutput->sectors = identifyData->CurrentSectorsPerTrack;
+    diskOutput->heads = identifyData->NumberOfCurrentHeads;
+    diskOutput->supports48BitLba = port->supports48BitLba;
+    diskOutput->sectorsPerBlock = 1;
+    diskOutput->ataData = (struct ATA_IdentifyData *)identifyData;
+    diskOutput->stats = NULL;
+    diskOutput->queue.commands = NULL;
+
+    g_Ports[index] = port;
+    return NO_ERROR;
+}
+
+// sets up a disk for every sata drive on the first ahci controller, returns PCI_DEVICE_NOT_FOUND_ERROR if there is no controller
+// !!! YOU ARE RESPONSIBLE FOR FREEING EVERY DISK IN `disksOutput` WITH `DISK_DeInitialize` !!!
+int AHCI_Initialize(DISK *disksOutput, uint8_t maxDisks, uint8_t *diskCountOutput) {
+    int status;
+    PCI_Device device;
+
+    *diskCountOutput = 0;
+    if ((status = PCI_FindDeviceByClass(AHCI_PCI_CLASS, AHCI_PCI_SUBCLASS, AHCI_PCI_PROG_IF, &device)) != NO_ERROR)
+        return status;
+
+    PCI_EnableDevice(&device, PCI_COMMAND_MEMORY_SPACE | PCI_COMMAND_BUS_MASTER);
+    g_Host = (AHCI_HostRegisters *)(PCI_GetBar(&device, AHCI_PCI_BAR) & ~AHCI_PCI_BAR_FLAGS);
+
+    takeOwnership();
+    g_Host->globalHostControl |= AHCI_GHC_AHCI_ENABLE;
+
+    // interrupts can only be used if the irqs have been set up (they aren't in the bootloader)
+    const PICDriver *picDriver = i686_IRQ_GetDriver();
+    g_UsingInterrupts = picDriver != NULL && device.interruptLine < 16;
+
+    uint32_t capabilities = g_Host->capabilities;
+    uint32_t implementedPorts = g_Host->portsImplemented;
+    uint8_t diskCount = 0;
+    for (uint8_t i = 0; i < AHCI_MAX_PORTS && diskCount < maxDisks; ++i) {
+        if (!(implementedPorts & (1u << i)))
+            continue;
+
+        AHCI_PortRegisters *registers = &g_Host->ports[i];
+        if (AHCI_SSTS_DETECTION(registers->sataStatus) != AHCI_SSTS_DEVICE_PRESENT || AHCI_SSTS_POWER(registers->sataStatus) != AHCI_SSTS_ACTIVE)
+            continue;
+        if (registers->signature != AHCI_SIGNATURE_ATA)
+            continue;
+
+        if (initializePort(i, capabilities, &disksOutput[diskCount]) == NO_ERROR)
+            ++diskCount;
+    }
+
+    if (g_UsingInterrupts) {
+        i686_IRQ_RegisterHandler(device.interruptLine, irqHandler);
+        picDriver->unmask(device.interruptLine);
+        g_Host->interruptStatus = g_Host->interruptStatus; // write 1 to clear
+        g_Host->globalHostControl |= AHCI_GHC_INTERRUPT_ENABLE;
+    }
+
+    *diskCountOutput = diskCount;
+    return NO_ERROR;
+}
+
+static const DISK_Driver g_AhciDriver = {
+    .name = "AHCI",
+    .readVectored = AHCI_ReadVectored,
+    .writeVectored = AHCI_WriteVectored,
+    .flush = AHCI_Flush,
+    .submit = AHCI_Submit,
+    .wait = AHCI_Wait,
+    .deinitialize = AHCI_DeInitialize,
+};
+
+const DISK_Driver *AHCI_GetDriver() {
+    return &g_AhciDriver;
+}
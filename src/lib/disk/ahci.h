@@ -0,0 +1,14 @@
+#pragma once
+
+#include "disk.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+int AHCI_Initialize(DISK *disksOutput, uint8_t maxDisks, uint8_t *diskCountOutput);
+void AHCI_DeInitialize(DISK *disk);
+int AHCI_ReadVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk);
+int AHCI_WriteVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags, DISK *disk);
+int AHCI_Flush(DISK *disk);
+int AHCI_Submit(DISK_Command *command);
+void AHCI_Wait(DISK *disk, volatile bool *completed);
+const DISK_Driver *AHCI_GetDriver();
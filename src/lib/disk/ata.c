@@ -3,8 +3,9 @@
 #include "visual/stdio.h"
 #include <lib/algorithm/math.h>
 #include <lib/errors/errors.h>
+#include <lib/interrupt/irq/irq.h>
 #include <lib/memory/memdefs.h>
-#include <lib/time/pit.h>
+#include <lib/time/tsc.h>
 #include <lib/x86/general.h>
 #include <stdbool.h>
 #include <stddef.h>
@@ -13,29 +14,51 @@
 #define MAX_48_BIT_UNSIGNED_INTEGER 0x1000000000000
 #define MAX_28_BIT_UNSIGNED_INTEGER 0x10000000
 
+// the most sectors a single read/write command can transfer
+#define ATA_MAX_SECTORS_28BIT 256
+#define ATA_MAX_SECTORS_48BIT 65536
+
 // other
 #define DEFAULT_ATA_TIMEOUT_MS 30000 // 30 seconds
-
-// ports
-#define ATA_PORT_DATA 0x1F0
-#define ATA_PORT_ERROR 0x1F1
-#define ATA_PORT_SECTOR_COUNT 0x1F2
-#define ATA_PORT_LBA_LOW 0x1F3
-#define ATA_PORT_LBA_MID 0x1F4
-#define ATA_PORT_LBA_HIGH 0x1F5
-#define ATA_PORT_DRIVE_SELECT 0x1F6
-#define ATA_PORT_STATUS_COMMAND 0x1F7
-
-#define ATA_PORT_ALTERNATE_STATUS 0x3F6
-#define ATA_PORT_CONTROL 0x3F6
+#define ATA_IRQ_TIMEOUT_MS 100       // if the drive hasn't interrupted by then, we fall back to polling
+
+// channels, each has its own registers, irq and request queue
+#define ATA_CHANNEL_COUNT 2
+#define ATA_PRIMARY_IO_BASE 0x1F0
+#define ATA_PRIMARY_CONTROL_BASE 0x3F6
+#define ATA_PRIMARY_IRQ 14
+#define ATA_SECONDARY_IO_BASE 0x170
+#define ATA_SECONDARY_CONTROL_BASE 0x376
+#define ATA_SECONDARY_IRQ 15
+
+// registers, relative to the io base of a channel
+#define ATA_REGISTER_DATA 0
+#define ATA_REGISTER_ERROR 1
+#define ATA_REGISTER_SECTOR_COUNT 2
+#define ATA_REGISTER_LBA_LOW 3
+#define ATA_REGISTER_LBA_MID 4
+#define ATA_REGISTER_LBA_HIGH 5
+#define ATA_REGISTER_DRIVE_SELECT 6
+#define ATA_REGISTER_STATUS_COMMAND 7
+
+// registers, relative to the control base of a channel
+#define ATA_REGISTER_ALTERNATE_STATUS 0
+#define ATA_REGISTER_CONTROL 0
 
 // commands
 #define ATA_CMD_READ_SECTORS 0x20
 #define ATA_CMD_WRITE_SECTORS 0x30
 #define ATA_CMD_READ_SECTORS_EXTENDED 0x24  // for 48 bit lba
 #define ATA_CMD_WRITE_SECTORS_EXTENDED 0x34 // for 48 bit lba
+#define ATA_CMD_READ_MULTIPLE 0xC4
+#define ATA_CMD_WRITE_MULTIPLE 0xC5
+#define ATA_CMD_READ_MULTIPLE_EXTENDED 0x29  // for 48 bit lba
+#define ATA_CMD_WRITE_MULTIPLE_EXTENDED 0x39 // for 48 bit lba
+#define ATA_CMD_SET_MULTIPLE_MODE 0xC6
 #define ATA_CMD_IDENTIFY 0xEC
+#define ATA_CMD_WRITE_MULTIPLE_FUA_EXTENDED 0xCE // for 48 bit lba, the data is on the media once the command completes
 #define ATA_CMD_CACHE_FLUSH 0xE7
+#define ATA_CMD_CACHE_FLUSH_EXTENDED 0xEA
 
 // these are the values if doing stuff with the master drive, for most commands the value to use for the slave drive is simply 1 higher than these values
 #define ATA_SELECT_IDENTIFY 0xA0
@@ -52,6 +75,7 @@
 #define ATA_STATUS_REGISTER_ERR 0x01
 #define ATA_STATUS_REGISTER_DRQ 0x08
 #define ATA_STATUS_REGISTER_SRV 0x10
+#define ATA_STATUS_FLOATING_BUS 0xFF // nothing is connected to the channel
 
 const char *ataErrorMessages[] = {
     "Address mark not found",
@@ -64,57 +88,94 @@ const char *ataErrorMessages[] = {
     "Bad block detected",
 };
 
-static uint8_t g_ControlPortByte = 0x00;
+// what a request does besides transferring its sectors, each is cleared once it has been sent
+#define ATA_REQUEST_PRE_FLUSH 0x01  // flush the cache before the first command
+#define ATA_REQUEST_FUA 0x02        // write with WRITE MULTIPLE FUA EXT
+#define ATA_REQUEST_POST_FLUSH 0x04 // flush the cache after the last command
+
+// a read, write or flush waiting for, or being run on, a channel
+// requests larger than a single command allows are split up, and a single command may cover several of the buffers
+typedef struct ATA_Request {
+    DISK *disk;
+    bool write;
+    uint8_t flags;
+    uint64_t lba;              // first sector not covered by a sent command yet
+    uint64_t remainingSectors; // sectors not covered by a sent command yet
+    DISK_IoVectorCursor cursor;
+    uint32_t commandSectors;     // sectors of the command on the drive, 0 for a flush
+    uint32_t transferredSectors; // sectors of the command on the drive that have been transferred
+    volatile bool completed;
+    int status;
+    DISK_Command *command; // set if it came from the scheduler, which is told once it completes
+    struct ATA_Request *next;
+} ATA_Request;
+
+_Static_assert(sizeof(ATA_Request) <= DISK_COMMAND_DRIVER_STORAGE, "ATA_Request has to fit in DISK_Command::driverStorage");
+
+typedef struct {
+    uint16_t ioBase;
+    uint16_t controlBase;
+    uint8_t irq;
+    uint8_t controlPortByte;
+    bool usingInterrupts;
+    ATA_Request *current;   // the request whose command is on the drive
+    uint64_t commandStartCycles;
+    bool polling;     // waitForRequest is polling the channel and counts the time itself
+    bool sendPending; // the drive was busy when the next command of `current` was due, waitUntilCompleted sends it once it isn't
+    ATA_Request *queueHead; // requests waiting for the channel, oldest first
+    ATA_Request *queueTail;
+    volatile uint64_t lastProgressMs;
+} ATA_Channel;
+
+static ATA_Channel g_Channels[ATA_CHANNEL_COUNT] = {
+    {.ioBase = ATA_PRIMARY_IO_BASE, .controlBase = ATA_PRIMARY_CONTROL_BASE, .irq = ATA_PRIMARY_IRQ},
+    {.ioBase = ATA_SECONDARY_IO_BASE, .controlBase = ATA_SECONDARY_CONTROL_BASE, .irq = ATA_SECONDARY_IRQ},
+};
+
+static inline uint8_t readAlternateStatus(ATA_Channel *channel) {
+    return x86_InByte(channel->controlBase + ATA_REGISTER_ALTERNATE_STATUS);
+}
 
 // reading from any port seemingly uses at least 30ns as i understand
-void waitNsRough(uint32_t ns) {
+void waitNsRough(ATA_Channel *channel, uint32_t ns) {
     uint32_t count = DIV_ROUND_UP(ns, 30);
 
     for (uint32_t i = 0; i < count; ++i)
-        x86_InByte(ATA_PORT_STATUS_COMMAND);
+        readAlternateStatus(channel);
 }
 
-// returns false if the timeout is reached
-bool waitForBSYClear() {
-    uint64_t endTimeMs = PIT_GetTimeMs() + DEFAULT_ATA_TIMEOUT_MS;
-
-    while ((x86_InByte(ATA_PORT_ALTERNATE_STATUS) & ATA_STATUS_REGISTER_BSY) && PIT_GetTimeMs() < endTimeMs)
-        ;
-
-    return PIT_GetTimeMs() < endTimeMs;
+// counts the busy waiting towards the disk of the request on the channel, there is none while identifying
+void recordPollTime(ATA_Channel *channel, uint64_t startCycles) {
+    if (channel->current != NULL && !channel->polling)
+        DISK_RecordPoll(channel->current->disk, x86_ReadTsc() - startCycles);
 }
 
 // returns false if the timeout is reached
-bool waitForDRQOrERRSet() {
-    uint64_t endTimeMs = PIT_GetTimeMs() + DEFAULT_ATA_TIMEOUT_MS;
+bool waitForBSYClear(ATA_Channel *channel) {
+    uint64_t startCycles = x86_ReadTsc();
+    uint64_t endTimeMs = TSC_GetTimeMs() + DEFAULT_ATA_TIMEOUT_MS;
 
-    while (!(x86_InByte(ATA_PORT_ALTERNATE_STATUS) & (ATA_STATUS_REGISTER_DRQ | ATA_STATUS_REGISTER_ERR)) && PIT_GetTimeMs() < endTimeMs)
+    while ((readAlternateStatus(channel) & ATA_STATUS_REGISTER_BSY) && TSC_GetTimeMs() < endTimeMs)
         ;
 
-    return PIT_GetTimeMs() < endTimeMs;
+    recordPollTime(channel, startCycles);
+    return TSC_GetTimeMs() < endTimeMs;
 }
 
-// waits for bsy to clear and drq to set
-bool poll() {
-    uint8_t status;
-    uint64_t endTimeMs = PIT_GetTimeMs() + DEFAULT_ATA_TIMEOUT_MS;
-
-    while (PIT_GetTimeMs() < endTimeMs) {
-        status = x86_InByte(ATA_PORT_ALTERNATE_STATUS);
-
-        if (status & ATA_STATUS_REGISTER_BSY)
-            continue;
-        if (!(status & ATA_STATUS_REGISTER_DRQ || status & ATA_STATUS_REGISTER_ERR || status & ATA_STATUS_REGISTER_DF))
-            continue;
+// returns false if the timeout is reached
+bool waitForDRQOrERRSet(ATA_Channel *channel) {
+    uint64_t startCycles = x86_ReadTsc();
+    uint64_t endTimeMs = TSC_GetTimeMs() + DEFAULT_ATA_TIMEOUT_MS;
 
-        break;
-    }
+    while (!(readAlternateStatus(channel) & (ATA_STATUS_REGISTER_DRQ | ATA_STATUS_REGISTER_ERR)) && TSC_GetTimeMs() < endTimeMs)
+        ;
 
-    return PIT_GetTimeMs() < endTimeMs;
+    recordPollTime(channel, startCycles);
+    return TSC_GetTimeMs() < endTimeMs;
 }
 
 // returns error
-int identify(bool master, ATA_IdentifyData *outputBuffer, uint8_t *errorCodeOutput) {
+int identify(ATA_Channel *channel, bool master, ATA_IdentifyData *outputBuffer, uint8_t *errorCodeOutput) {
     uint16_t *dataBuffer = (uint16_t *)outputBuffer;
 
     uint8_t slaveBit;
@@ -123,239 +184,631 @@ int identify(bool master, ATA_IdentifyData *outputBuffer, uint8_t *errorCodeOutp
     else
         slaveBit = 0x10;
 
-    x86_OutByte(ATA_PORT_DRIVE_SELECT, ATA_SELECT_IDENTIFY + slaveBit);
-    x86_OutByte(ATA_PORT_SECTOR_COUNT, 0);
-    x86_OutByte(ATA_PORT_LBA_LOW, 0);
-    x86_OutByte(ATA_PORT_LBA_MID, 0);
-    x86_OutByte(ATA_PORT_LBA_HIGH, 0);
-    x86_OutByte(ATA_PORT_STATUS_COMMAND, ATA_CMD_IDENTIFY);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_DRIVE_SELECT, ATA_SELECT_IDENTIFY + slaveBit);
+    waitNsRough(channel, 400); // give the drive time to respond to the select
+    x86_OutByte(channel->ioBase + ATA_REGISTER_SECTOR_COUNT, 0);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_LOW, 0);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_MID, 0);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_HIGH, 0);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_STATUS_COMMAND, ATA_CMD_IDENTIFY);
 
-    uint8_t identifyReturn = x86_InByte(ATA_PORT_ALTERNATE_STATUS);
+    uint8_t identifyReturn = readAlternateStatus(channel);
 
     // drive does not exist
-    if (identifyReturn == 0)
+    if (identifyReturn == 0 || identifyReturn == ATA_STATUS_FLOATING_BUS)
         return ATA_DRIVE_DOESNT_EXIST;
 
-    if (!waitForBSYClear())
+    if (!waitForBSYClear(channel))
         return TIMEOUT_ERROR;
 
     // some atapi drives dont follow the specification, so as programmers we need to handle this because drive manufacturers can do whatever the fuck they want, and they just expect us to make shit happen anyway
     // this is a check to see if the drive is actually ata
-    uint8_t lbaMid = x86_InByte(ATA_PORT_LBA_MID);
-    uint8_t lbaHigh = x86_InByte(ATA_PORT_LBA_HIGH);
+    uint8_t lbaMid = x86_InByte(channel->ioBase + ATA_REGISTER_LBA_MID);
+    uint8_t lbaHigh = x86_InByte(channel->ioBase + ATA_REGISTER_LBA_HIGH);
     if (lbaMid != 0x00 || lbaHigh != 0x00)
         return ATA_UNSUPPORTED_DRIVE;
 
     // wait for data to be ready
-    if (!waitForDRQOrERRSet())
+    if (!waitForDRQOrERRSet(channel))
         return TIMEOUT_ERROR;
 
     // error check
-    if (x86_InByte(ATA_PORT_ALTERNATE_STATUS) & ATA_STATUS_REGISTER_ERR) {
+    if (readAlternateStatus(channel) & ATA_STATUS_REGISTER_ERR) {
         if (errorCodeOutput != NULL)
-            *errorCodeOutput = x86_InByte(ATA_PORT_ERROR);
+            *errorCodeOutput = x86_InByte(channel->ioBase + ATA_REGISTER_ERROR);
         return ATA_ERROR;
     }
 
-    for (uint16_t i = 0; i < 256; ++i)
-        dataBuffer[i] = x86_InWord(ATA_PORT_DATA);
+    x86_InWords(channel->ioBase + ATA_REGISTER_DATA, dataBuffer, 256);
 
     return NO_ERROR;
 }
 
-void softwareReset() {
-    g_ControlPortByte |= ATA_CONTROL_SRST;
-    x86_OutByte(ATA_PORT_CONTROL, g_ControlPortByte);
-    g_ControlPortByte &= ~ATA_CONTROL_SRST;
+void softwareReset(ATA_Channel *channel) {
+    x86_OutByte(channel->controlBase + ATA_REGISTER_CONTROL, channel->controlPortByte | ATA_CONTROL_SRST);
+    waitNsRough(channel, 5000); // srst has to be held for at least 5us
+    x86_OutByte(channel->controlBase + ATA_REGISTER_CONTROL, channel->controlPortByte);
 }
 
-void selectDrive28Bit(uint32_t lba, uint8_t slaveBit) {
-    x86_OutByte(ATA_PORT_DRIVE_SELECT, (ATA_SELECT_READWRITE + slaveBit) | ((lba >> 24) & 0x0F));
+void selectDrive28Bit(ATA_Channel *channel, uint32_t lba, uint8_t slaveBit) {
+    x86_OutByte(channel->ioBase + ATA_REGISTER_DRIVE_SELECT, (ATA_SELECT_READWRITE + slaveBit) | ((lba >> 24) & 0x0F));
 }
 
-void selectDrive48Bit(uint8_t slaveBit) {
-    x86_OutByte(ATA_PORT_DRIVE_SELECT, ATA_SELECT_READWRITE_EXTENDED + slaveBit);
+void selectDrive48Bit(ATA_Channel *channel, uint8_t slaveBit) {
+    x86_OutByte(channel->ioBase + ATA_REGISTER_DRIVE_SELECT, ATA_SELECT_READWRITE_EXTENDED + slaveBit);
 }
 
-void readSectors28BitLba(uint32_t lba, uint8_t count, uint8_t slaveBit) {
-    selectDrive28Bit(lba, slaveBit);
+// sends a command with a 28 bit lba, a count of 0 means 256 sectors
+void sendCommand28BitLba(ATA_Channel *channel, uint32_t lba, uint8_t count, uint8_t slaveBit, uint8_t command) {
+    selectDrive28Bit(channel, lba, slaveBit);
+
+    x86_OutByte(channel->ioBase + ATA_REGISTER_ERROR, 0); // optional, i think
+    x86_OutByte(channel->ioBase + ATA_REGISTER_SECTOR_COUNT, count);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_LOW, lba & 0xFF);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_MID, (lba >> 8) & 0xFF);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_HIGH, (lba >> 16) & 0xFF);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_STATUS_COMMAND, command);
+    waitNsRough(channel, 400); // the status register isn't valid until 400ns after sending a command
+}
 
-    x86_OutByte(ATA_PORT_ERROR, 0); // optional, i think
-    x86_OutByte(ATA_PORT_SECTOR_COUNT, count);
-    x86_OutByte(ATA_PORT_LBA_LOW, lba & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_MID, (lba >> 8) & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_HIGH, (lba >> 16) & 0xFF);
-    x86_OutByte(ATA_PORT_STATUS_COMMAND, ATA_CMD_READ_SECTORS);
+// sends a command with a 48 bit lba, a count of 0 means 65536 sectors
+void sendCommand48BitLba(ATA_Channel *channel, uint64_t lba, uint16_t count, uint8_t slaveBit, uint8_t command) {
+    selectDrive48Bit(channel, slaveBit);
+
+    x86_OutByte(channel->ioBase + ATA_REGISTER_SECTOR_COUNT, (count >> 8) & 0xFF); // high sector count byte
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_LOW, (lba >> 24) & 0xFF);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_MID, (lba >> 32) & 0xFF);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_HIGH, (lba >> 40) & 0xFF);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_SECTOR_COUNT, count & 0xFF); // low sector count byte
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_LOW, lba & 0xFF);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_MID, (lba >> 8) & 0xFF);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_LBA_HIGH, (lba >> 16) & 0xFF);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_STATUS_COMMAND, command);
+    waitNsRough(channel, 400);
 }
 
-void readSectors48BitLba(uint64_t lba, uint16_t count, uint8_t slaveBit) {
-    selectDrive48Bit(slaveBit);
+// returns false if the drive has no cache to flush, in which case nothing is sent
+bool cacheFlush(ATA_Channel *channel, DISK *disk) {
+    ATA_IdentifyData *identifyData = (ATA_IdentifyData *)disk->ataData;
+
+    uint8_t command;
+    if (disk->supports48BitLba && identifyData->CommandSetSupport.FlushCacheExt)
+        command = ATA_CMD_CACHE_FLUSH_EXTENDED;
+    else if (identifyData->CommandSetSupport.FlushCache)
+        command = ATA_CMD_CACHE_FLUSH;
+    else
+        return false;
 
-    x86_OutByte(ATA_PORT_SECTOR_COUNT, (count >> 8) & 0xFF); // high sector count byte
-    x86_OutByte(ATA_PORT_LBA_LOW, (lba >> 24) & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_MID, (lba >> 32) & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_HIGH, (lba >> 40) & 0xFF);
-    x86_OutByte(ATA_PORT_SECTOR_COUNT, count & 0xFF); // low sector count byte
-    x86_OutByte(ATA_PORT_LBA_LOW, lba & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_MID, (lba >> 8) & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_HIGH, (lba >> 16) & 0xFF);
-    x86_OutByte(ATA_PORT_STATUS_COMMAND, ATA_CMD_READ_SECTORS_EXTENDED);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_DRIVE_SELECT, ATA_SELECT_READWRITE + (disk->isMaster ? 0 : 0x10));
+    x86_OutByte(channel->ioBase + ATA_REGISTER_STATUS_COMMAND, command);
+    waitNsRough(channel, 400);
+
+    return true;
 }
 
-void cacheFlush() {
-    x86_OutByte(ATA_PORT_STATUS_COMMAND, ATA_CMD_CACHE_FLUSH);
+// WRITE MULTIPLE FUA EXT needs both 48 bit addressing and multiple mode
+bool supportsFua(DISK *disk) {
+    ATA_IdentifyData *identifyData = (ATA_IdentifyData *)disk->ataData;
+
+    return disk->supports48BitLba && disk->sectorsPerBlock > 1 && identifyData->CommandSetSupport.WriteFua;
 }
 
-int checkErrors() {
-    uint8_t status = x86_InByte(ATA_PORT_ALTERNATE_STATUS);
-    uint8_t errorCode = x86_InByte(ATA_PORT_ERROR);
+int checkErrors(ATA_Channel *channel) {
+    uint8_t status = readAlternateStatus(channel);
 
     if (status & ATA_STATUS_REGISTER_DF)
         return ATA_DRIVE_FAULT_ERROR;
 
-    if (status & ATA_STATUS_REGISTER_ERR || errorCode != 0)
-        switch (findLowestSetBit(errorCode)) {
-        case 0:
-            return ATA_ADDRESS_MARK_NOT_FOUND_ERROR;
-        case 1:
-            return ATA_TRACK_ZERO_NOT_FOUND_ERROR;
-        case 2:
-            return ATA_COMMAND_ABORTED_ERROR;
-        case 3:
-            return ATA_MEDIA_CHANGE_REQUEST_ERROR;
-        case 4:
-            return ATA_ID_NOT_FOUND_ERROR;
-        case 5:
-            return ATA_MEDIA_CHANGED_ERROR;
-        case 6:
-            return ATA_UNCORRECTABLE_DATA_ERROR;
-        case 7:
-            return ATA_BAD_BLOCK_DETECTED_ERROR;
-        }
+    // the error register is only valid when the err bit is set, so don't spend a port read on it otherwise
+    if (!(status & ATA_STATUS_REGISTER_ERR))
+        return NO_ERROR;
+
+    switch (findLowestSetBit(x86_InByte(channel->ioBase + ATA_REGISTER_ERROR))) {
+    case 0:
+        return ATA_ADDRESS_MARK_NOT_FOUND_ERROR;
+    case 1:
+        return ATA_TRACK_ZERO_NOT_FOUND_ERROR;
+    case 2:
+        return ATA_COMMAND_ABORTED_ERROR;
+    case 3:
+        return ATA_MEDIA_CHANGE_REQUEST_ERROR;
+    case 4:
+        return ATA_ID_NOT_FOUND_ERROR;
+    case 5:
+        return ATA_MEDIA_CHANGED_ERROR;
+    case 6:
+        return ATA_UNCORRECTABLE_DATA_ERROR;
+    case 7:
+        return ATA_BAD_BLOCK_DETECTED_ERROR;
+    default:
+        return ATA_ERROR;
+    }
+}
 
-    return NO_ERROR;
+// picks the read or write command to use, READ/WRITE MULTIPLE transfer `disk->sectorsPerBlock` sectors per drq block instead of one
+uint8_t selectCommand(DISK *disk, bool write, bool extended, bool fua) {
+    if (write && fua)
+        return ATA_CMD_WRITE_MULTIPLE_FUA_EXTENDED;
+
+    if (disk->sectorsPerBlock > 1) {
+        if (write)
+            return extended ? ATA_CMD_WRITE_MULTIPLE_EXTENDED : ATA_CMD_WRITE_MULTIPLE;
+        return extended ? ATA_CMD_READ_MULTIPLE_EXTENDED : ATA_CMD_READ_MULTIPLE;
+    }
+
+    if (write)
+        return extended ? ATA_CMD_WRITE_SECTORS_EXTENDED : ATA_CMD_WRITE_SECTORS;
+    return extended ? ATA_CMD_READ_SECTORS_EXTENDED : ATA_CMD_READ_SECTORS;
 }
 
-int ATA_ReadSectors(uint64_t lba, void *buffer, uint16_t count, DISK *disk) {
+// picks 28 or 48 bit addressing, limits the sector count to what a single command can transfer, validates the lba and sends the command
+// fua commands only exist with 48 bit addressing, the drive has to be ready for a command
+int sendReadWriteCommand(ATA_Channel *channel, uint64_t lba, uint64_t sectorCount, DISK *disk, bool write, bool fua, uint32_t *commandSectorsOutput) {
     uint8_t slaveBit;
     if (disk->isMaster)
         slaveBit = 0;
     else
         slaveBit = 0x10;
 
-    if (x86_InByte(ATA_PORT_ALTERNATE_STATUS) & ATA_STATUS_REGISTER_SRV)
-        softwareReset();
-
-    if (!waitForBSYClear())
-        return TIMEOUT_ERROR;
+    ATA_IdentifyData *identifyData = (ATA_IdentifyData *)disk->ataData;
 
-    if (disk->supports48BitLba && lba > MAX_28_BIT_UNSIGNED_INTEGER) { // 28 bit is faster
-        if (lba > ((ATA_IdentifyData *)disk->ataData)->Max48BitLBA || lba > MAX_48_BIT_UNSIGNED_INTEGER)
+    // 28 bit is faster, but 48 bit needs fewer commands for large requests
+    uint32_t commandSectors;
+    if (disk->supports48BitLba && (fua || sectorCount > ATA_MAX_SECTORS_28BIT || lba + sectorCount > MAX_28_BIT_UNSIGNED_INTEGER)) {
+        commandSectors = sectorCount > ATA_MAX_SECTORS_48BIT ? ATA_MAX_SECTORS_48BIT : sectorCount;
+        if (lba + commandSectors > identifyData->Max48BitLBA || lba + commandSectors > MAX_48_BIT_UNSIGNED_INTEGER)
             return ATA_LBA_TOO_LARGE_48BIT_ERROR;
-        readSectors48BitLba(lba, count, slaveBit);
+        sendCommand48BitLba(channel, lba, commandSectors, slaveBit, selectCommand(disk, write, true, fua)); // 65536 is truncated to 0, which is what the drive expects
     } else {
-        if (lba > ((ATA_IdentifyData *)disk->ataData)->Max28BitLBA || lba > MAX_28_BIT_UNSIGNED_INTEGER)
+        commandSectors = sectorCount > ATA_MAX_SECTORS_28BIT ? ATA_MAX_SECTORS_28BIT : sectorCount;
+        if (lba + commandSectors > identifyData->Max28BitLBA || lba + commandSectors > MAX_28_BIT_UNSIGNED_INTEGER)
             return ATA_LBA_TOO_LARGE_28BIT_ERROR;
-        readSectors28BitLba(lba, count, slaveBit);
+        sendCommand28BitLba(channel, lba, commandSectors, slaveBit, selectCommand(disk, write, false, false)); // same here, 256 becomes 0
     }
-    if (!poll())
-        return TIMEOUT_ERROR;
 
+    *commandSectorsOutput = commandSectors;
+    return NO_ERROR;
+}
+
+// moves `sectorCount` sectors between the data port and the buffers at `cursor`, a single call may span several buffers
+void transferSectors(ATA_Channel *channel, DISK_IoVectorCursor *cursor, uint32_t sectorCount, bool write) {
+    while (sectorCount > 0) {
+        uint32_t take = min(sectorCount, cursor->vector->sectorCount - cursor->sectorOffset);
+        uint16_t *buffer = (uint16_t *)(cursor->vector->buffer + cursor->sectorOffset * 512);
+
+        if (write)
+            x86_OutWords(channel->ioBase + ATA_REGISTER_DATA, buffer, take * 256);
+        else
+            x86_InWords(channel->ioBase + ATA_REGISTER_DATA, buffer, take * 256);
+
+        sectorCount -= take;
+        cursor->sectorOffset += take;
+        if (cursor->sectorOffset == cursor->vector->sectorCount) {
+            ++cursor->vector;
+            cursor->sectorOffset = 0;
+        }
+    }
+}
+
+// transfers the next drq block of the command on the drive, the last block may be shorter
+void transferBlock(ATA_Channel *channel, ATA_Request *request) {
+    uint32_t blockSectors = min(max(request->disk->sectorsPerBlock, 1), request->commandSectors - request->transferredSectors);
+
+    uint64_t startCycles = x86_ReadTsc();
+    transferSectors(channel, &request->cursor, blockSectors, request->write);
+    DISK_RecordCopy(request->disk, request->write ? DISK_STATS_WRITE : DISK_STATS_READ, blockSectors * 512, x86_ReadTsc() - startCycles);
+    request->transferredSectors += blockSectors;
+
+    // when polling, the status register has to be given time to show that the drive is busy again
+    if (!channel->usingInterrupts || channel->polling)
+        waitNsRough(channel, 400);
+}
+
+// sends the next read/write command of a request
+// the drive doesn't interrupt for the first block of a write, waitUntilCompleted polls for it instead of waiting here, since this may run in an irq handler
+int startCommand(ATA_Channel *channel, ATA_Request *request) {
     int status;
-    if ((status = checkErrors()) != NO_ERROR)
+    bool fua = request->flags & ATA_REQUEST_FUA;
+    if ((status = sendReadWriteCommand(channel, request->lba, request->remainingSectors, request->disk, request->write, fua, &request->commandSectors)) != NO_ERROR)
         return status;
 
-    for (uint16_t sectorIndex = 0; sectorIndex < count; ++sectorIndex) {
-        if (!poll())
-            return TIMEOUT_ERROR;
-        if ((status = checkErrors()) != NO_ERROR)
-            return status;
-        waitNsRough(400);
+    request->lba += request->commandSectors;
+    request->remainingSectors -= request->commandSectors;
+    request->transferredSectors = 0;
+    channel->lastProgressMs = TSC_GetTimeMs();
+    channel->commandStartCycles = x86_ReadTsc();
+
+    return NO_ERROR;
+}
+
+// the flush has no data phase, the drive interrupts once the cache has been written out
+// returns false if the drive has no cache to flush, in which case nothing is sent
+bool startFlush(ATA_Channel *channel, ATA_Request *request) {
+    request->commandSectors = 0;
+    request->transferredSectors = 0;
+    channel->lastProgressMs = TSC_GetTimeMs();
+    channel->commandStartCycles = x86_ReadTsc();
+
+    return cacheFlush(channel, request->disk);
+}
+
+// sends whatever the request needs next: the pre flush, its read/write commands and then the post flush
+// `*sentOutput` is false once there is nothing left, which means the request is done
+// this never waits for the drive, it may run in an irq handler, if the drive is still busy `sendPending` is set and the command is sent later
+int sendNextCommand(ATA_Channel *channel, ATA_Request *request, bool *sentOutput) {
+    *sentOutput = false;
+
+    if (!(request->flags & (ATA_REQUEST_PRE_FLUSH | ATA_REQUEST_POST_FLUSH)) && request->remainingSectors == 0)
+        return NO_ERROR;
+
+    if (readAlternateStatus(channel) & ATA_STATUS_REGISTER_SRV) {
+        softwareReset(channel);
+        DISK_RecordEvent(request->disk, DISK_EVENT_RESET);
+    }
+
+    if (readAlternateStatus(channel) & ATA_STATUS_REGISTER_BSY) {
+        channel->sendPending = true;
+        *sentOutput = true;
+        return NO_ERROR;
+    }
+
+    if (request->flags & ATA_REQUEST_PRE_FLUSH) {
+        request->flags &= ~ATA_REQUEST_PRE_FLUSH;
+        if ((*sentOutput = startFlush(channel, request)))
+            return NO_ERROR;
+    }
 
-        for (uint16_t dataWordIndex = 0; dataWordIndex < 256; ++dataWordIndex)
-            ((uint16_t *)buffer)[dataWordIndex] = x86_InWord(ATA_PORT_DATA);
-        buffer += 512;
+    if (request->remainingSectors > 0) {
+        *sentOutput = true;
+        return startCommand(channel, request);
+    }
+
+    if (request->flags & ATA_REQUEST_POST_FLUSH) {
+        request->flags &= ~ATA_REQUEST_POST_FLUSH;
+        *sentOutput = startFlush(channel, request);
     }
 
     return NO_ERROR;
 }
 
-void writeSectors28BitLba(uint32_t lba, uint8_t count, uint8_t slaveBit) {
-    selectDrive28Bit(lba, slaveBit);
+DISK_StatsDirection commandDirection(ATA_Request *request) {
+    if (request->commandSectors == 0)
+        return DISK_STATS_FLUSH;
+
+    return request->write ? DISK_STATS_WRITE : DISK_STATS_READ;
+}
+
+void finishRequest(ATA_Request *request, int status) {
+    request->status = status;
+    request->completed = true;
+
+    if (request->command != NULL)
+        DISK_CompleteCommand(request->command, status);
+}
 
-    x86_OutByte(ATA_PORT_ERROR, 0); // optional, i think
-    x86_OutByte(ATA_PORT_SECTOR_COUNT, count);
-    x86_OutByte(ATA_PORT_LBA_LOW, lba & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_MID, (lba >> 8) & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_HIGH, (lba >> 16) & 0xFF);
-    x86_OutByte(ATA_PORT_STATUS_COMMAND, ATA_CMD_WRITE_SECTORS);
+// starts queued requests until one is on the drive or the queue is empty, must be called with interrupts disabled
+void startNextRequest(ATA_Channel *channel) {
+    while (channel->current == NULL && channel->queueHead != NULL) {
+        ATA_Request *request = channel->queueHead;
+        channel->queueHead = request->next;
+        if (channel->queueHead == NULL)
+            channel->queueTail = NULL;
+
+        channel->current = request;
+        channel->lastProgressMs = TSC_GetTimeMs(); // it may have to wait for the drive before its first command goes out
+
+        bool sent;
+        int status = sendNextCommand(channel, request, &sent);
+        if (status != NO_ERROR || !sent) {
+            channel->current = NULL;
+            finishRequest(request, status);
+        }
+    }
 }
 
-void writeSectors48BitLba(uint64_t lba, uint16_t count, uint8_t slaveBit) {
-    selectDrive48Bit(slaveBit);
+void completeCurrentRequest(ATA_Channel *channel, int status) {
+    ATA_Request *request = channel->current;
+    channel->current = NULL;
 
-    x86_OutByte(ATA_PORT_SECTOR_COUNT, (count >> 8) & 0xFF); // high sector count byte
-    x86_OutByte(ATA_PORT_LBA_LOW, (lba >> 24) & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_MID, (lba >> 32) & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_HIGH, (lba >> 40) & 0xFF);
-    x86_OutByte(ATA_PORT_SECTOR_COUNT, count & 0xFF); // low sector count byte
-    x86_OutByte(ATA_PORT_LBA_LOW, lba & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_MID, (lba >> 8) & 0xFF);
-    x86_OutByte(ATA_PORT_LBA_HIGH, (lba >> 16) & 0xFF);
-    x86_OutByte(ATA_PORT_STATUS_COMMAND, ATA_CMD_WRITE_SECTORS_EXTENDED);
+    finishRequest(request, status);
+    startNextRequest(channel);
 }
 
-int ATA_WriteSectors(uint64_t lba, void *buffer, uint16_t count, DISK *disk) {
+// advances the request on the drive, called from the irq handler, or when polling, with interrupts disabled
+void serviceChannel(ATA_Channel *channel) {
+    uint8_t status = x86_InByte(channel->ioBase + ATA_REGISTER_STATUS_COMMAND); // reading the regular (not alternate) status register acknowledges the interrupt
+    ATA_Request *request = channel->current;
+
+    if (request == NULL || channel->sendPending || (status & ATA_STATUS_REGISTER_BSY))
+        return;
+
+    if (status & (ATA_STATUS_REGISTER_ERR | ATA_STATUS_REGISTER_DF)) {
+        DISK_RecordCommand(request->disk, commandDirection(request), x86_ReadTsc() - channel->commandStartCycles);
+        completeCurrentRequest(channel, checkErrors(channel));
+        return;
+    }
+
+    if (request->transferredSectors < request->commandSectors) {
+        // when reading the drive interrupts once for every block that is ready
+        // when writing it interrupts once every block has been written, and requests the next one
+        if (!(status & ATA_STATUS_REGISTER_DRQ))
+            return;
+
+        channel->lastProgressMs = TSC_GetTimeMs();
+        transferBlock(channel, request);
+
+        // a write isn't done before the drive interrupts for its last block
+        if (request->write || request->transferredSectors < request->commandSectors)
+            return;
+    }
+
+    // the command is done, send the next one, or finish up the request
+    channel->lastProgressMs = TSC_GetTimeMs();
+    DISK_RecordCommand(request->disk, commandDirection(request), x86_ReadTsc() - channel->commandStartCycles);
+
+    bool sent;
+    int sendStatus = sendNextCommand(channel, request, &sent);
+    if (sendStatus != NO_ERROR || !sent)
+        completeCurrentRequest(channel, sendStatus);
+}
+
+void primaryIrqHandler(Registers *registers) {
+    serviceChannel(&g_Channels[0]);
+}
+
+void secondaryIrqHandler(Registers *registers) {
+    serviceChannel(&g_Channels[1]);
+}
+
+// queues a request on the channel of its disk, it's started right away if the channel is idle
+void submitRequest(ATA_Channel *channel, ATA_Request *request) {
+    request->next = NULL;
+    request->completed = false;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // the irq handler touches the queue too
+
+    if (channel->queueTail == NULL)
+        channel->queueHead = request;
+    else
+        channel->queueTail->next = request;
+    channel->queueTail = request;
+
+    startNextRequest(channel);
+
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+// sends the command sendNextCommand had to leave because the drive was busy, if it isn't anymore
+void sendPendingCommand(ATA_Channel *channel) {
+    if (readAlternateStatus(channel) & ATA_STATUS_REGISTER_BSY)
+        return;
+
+    channel->sendPending = false;
+
+    bool sent;
+    int status = sendNextCommand(channel, channel->current, &sent);
+    if (status != NO_ERROR || !sent)
+        completeCurrentRequest(channel, status);
+}
+
+// true if the drive won't interrupt for what the request on the channel waits for: a command that hasn't been sent yet, or the first block of a write
+bool needsPolling(ATA_Channel *channel) {
+    ATA_Request *request = channel->current;
+    if (request == NULL)
+        return false;
+
+    return channel->sendPending || (request->write && request->commandSectors > 0 && request->transferredSectors == 0);
+}
+
+// halts the cpu until `*completed` is set by a request on the channel completing, the irq handler does the work
+// the channel is polled from here instead if interrupts aren't used, if the drive won't interrupt for what comes next,
+// or if it hasn't made progress for ATA_IRQ_TIMEOUT_MS
+// the timeouts are measured with the tsc, the pit doesn't tick while interrupts are disabled
+void waitUntilCompleted(ATA_Channel *channel, DISK *disk, volatile bool *completed) {
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // so the irq can't arrive between checking the request and halting
+    bool canHalt = channel->usingInterrupts && interruptsEnabled;
+    bool irqTimedOut = false;
+
+    while (!*completed) {
+        uint64_t idleMs = TSC_GetTimeMs() - channel->lastProgressMs;
+        bool polling = !canHalt || needsPolling(channel);
+
+        if (idleMs >= DEFAULT_ATA_TIMEOUT_MS && channel->current != NULL) {
+            // the drive may still be in the middle of the command, it's reset so the next request doesn't go to it like that
+            DISK_RecordEvent(channel->current->disk, DISK_EVENT_TIMEOUT);
+            softwareReset(channel);
+            DISK_RecordEvent(channel->current->disk, DISK_EVENT_RESET);
+            channel->sendPending = false;
+            completeCurrentRequest(channel, TIMEOUT_ERROR);
+        } else if (polling || idleMs >= ATA_IRQ_TIMEOUT_MS) {
+            if (!polling && !irqTimedOut) {
+                DISK_RecordEvent(disk, DISK_EVENT_IRQ_TIMEOUT);
+                irqTimedOut = true;
+            }
+
+            uint64_t startCycles = x86_ReadTsc();
+            channel->polling = true;
+            if (channel->sendPending)
+                sendPendingCommand(channel);
+            else
+                serviceChannel(channel);
+            channel->polling = false;
+            DISK_RecordPoll(disk, x86_ReadTsc() - startCycles);
+
+            // the caller had interrupts enabled, so the timer (and everything else) shouldn't have to wait for the drive
+            if (interruptsEnabled)
+                x86_AllowInterrupts();
+        } else {
+            x86_EnableInterruptsAndHalt();
+            x86_DisableInterrupts();
+        }
+    }
+
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+// submits the request on the channel of its disk and waits for it
+int runRequest(ATA_Request *request) {
+    if (request->disk->channel >= ATA_CHANNEL_COUNT)
+        return ATA_DRIVE_DOESNT_EXIST;
+
+    ATA_Channel *channel = &g_Channels[request->disk->channel];
+    submitRequest(channel, request);
+    waitUntilCompleted(channel, request->disk, &request->completed);
+
+    return request->status;
+}
+
+// maps DISK_WRITE_... to what the request has to do
+uint8_t writeRequestFlags(uint8_t flags, DISK *disk) {
+    uint8_t requestFlags = 0;
+
+    if (flags & DISK_WRITE_BARRIER)
+        requestFlags |= ATA_REQUEST_PRE_FLUSH;
+    if (flags & DISK_WRITE_FUA)
+        requestFlags |= supportsFua(disk) ? ATA_REQUEST_FUA : ATA_REQUEST_POST_FLUSH;
+
+    return requestFlags;
+}
+
+int transferVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk, bool write, uint8_t requestFlags) {
+    ATA_Request request = {
+        .disk = disk,
+        .write = write,
+        .flags = requestFlags,
+        .lba = lba,
+        .remainingSectors = 0,
+        .cursor = {.vector = vectors, .sectorOffset = 0},
+    };
+    for (uint32_t i = 0; i < vectorCount; ++i)
+        request.remainingSectors += vectors[i].sectorCount;
+
+    return runRequest(&request);
+}
+
+int ATA_ReadVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk) {
+    return transferVectored(lba, vectors, vectorCount, disk, false, 0);
+}
+
+// the data may stay in the drive cache, unless DISK_WRITE_FUA is passed
+int ATA_WriteVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags, DISK *disk) {
+    return transferVectored(lba, vectors, vectorCount, disk, true, writeRequestFlags(flags, disk));
+}
+
+// queued like any other request, so it covers every write that was submitted before it
+int ATA_Flush(DISK *disk) {
+    ATA_Request request = {
+        .disk = disk,
+        .write = false,
+        .flags = ATA_REQUEST_POST_FLUSH,
+        .remainingSectors = 0,
+    };
+
+    return runRequest(&request);
+}
+
+// queues the command on the channel and returns, the request lives in the command until it completes
+int ATA_Submit(DISK_Command *command) {
+    DISK *disk = command->disk;
+    if (disk->channel >= ATA_CHANNEL_COUNT)
+        return ATA_DRIVE_DOESNT_EXIST;
+
+    ATA_Request *request = (ATA_Request *)command->driverStorage;
+    *request = (ATA_Request){
+        .disk = disk,
+        .write = command->write,
+        .flags = command->write ? writeRequestFlags(command->flags, disk) : 0,
+        .lba = command->lba,
+        .remainingSectors = command->sectorCount,
+        .cursor = {.vector = command->vectors, .sectorOffset = 0},
+        .command = command,
+    };
+
+    submitRequest(&g_Channels[disk->channel], request);
+    return NO_ERROR;
+}
+
+void ATA_Wait(DISK *disk, volatile bool *completed) {
+    if (disk->channel < ATA_CHANNEL_COUNT)
+        waitUntilCompleted(&g_Channels[disk->channel], disk, completed);
+}
+
+// enables READ/WRITE MULTIPLE with the largest block size the drive supports, returns the sectors per block (1 if not supported)
+uint8_t setMultipleMode(ATA_Channel *channel, bool master, ATA_IdentifyData *identifyData) {
+    uint8_t sectorsPerBlock = identifyData->MaximumBlockTransfer;
+    if (sectorsPerBlock <= 1)
+        return 1;
+
     uint8_t slaveBit;
-    if (disk->isMaster)
+    if (master)
         slaveBit = 0;
     else
         slaveBit = 0x10;
 
-    if (x86_InByte(ATA_PORT_ALTERNATE_STATUS) & ATA_STATUS_REGISTER_SRV)
-        softwareReset();
+    if (!waitForBSYClear(channel))
+        return 1;
 
-    if (!waitForBSYClear())
-        return TIMEOUT_ERROR;
+    x86_OutByte(channel->ioBase + ATA_REGISTER_DRIVE_SELECT, ATA_SELECT_READWRITE + slaveBit);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_SECTOR_COUNT, sectorsPerBlock);
+    x86_OutByte(channel->ioBase + ATA_REGISTER_STATUS_COMMAND, ATA_CMD_SET_MULTIPLE_MODE);
+    waitNsRough(channel, 400);
 
-    if (disk->supports48BitLba && lba > MAX_28_BIT_UNSIGNED_INTEGER) { // 28 bit is faster
-        if (lba > ((ATA_IdentifyData *)disk->ataData)->Max48BitLBA || lba > MAX_48_BIT_UNSIGNED_INTEGER)
-            return ATA_LBA_TOO_LARGE_48BIT_ERROR;
-        writeSectors48BitLba(lba, count, slaveBit);
-    } else {
-        if (lba > ((ATA_IdentifyData *)disk->ataData)->Max28BitLBA || lba > MAX_28_BIT_UNSIGNED_INTEGER)
-            return ATA_LBA_TOO_LARGE_28BIT_ERROR;
-        writeSectors28BitLba(lba, count, slaveBit);
-    }
-    if (!poll())
-        return TIMEOUT_ERROR;
+    if (!waitForBSYClear(channel) || checkErrors(channel) != NO_ERROR)
+        return 1; // the drive rejected the block size, just keep using single sector commands
 
-    int status;
-    if ((status = checkErrors()) != NO_ERROR)
-        return status;
+    return sectorsPerBlock;
+}
 
-    for (uint16_t sectorIndex = 0; sectorIndex < count; ++sectorIndex) {
-        if (!poll())
-            return TIMEOUT_ERROR;
-        if ((status = checkErrors()) != NO_ERROR)
-            return status;
-        waitNsRough(400);
-
-        // volatile makes the compiler not optimize out the loop, because we need to wait "a jmp $+2 size of delay" between each outword
-        for (volatile uint16_t dataWordIndex = 0; dataWordIndex < 256; ++dataWordIndex)
-            x86_OutWord(ATA_PORT_DATA, ((uint16_t *)buffer)[dataWordIndex]);
-        buffer += 512;
-    }
+// `outputs` is indexed by ATA_DRIVE_INDEX
+void ATA_Initialize(ATA_InitializeDriveOutput *outputs) {
+    // interrupts can only be used if the irqs have been set up (they aren't in the bootloader)
+    const PICDriver *picDriver = i686_IRQ_GetDriver();
+
+    for (uint8_t channelIndex = 0; channelIndex < ATA_CHANNEL_COUNT; ++channelIndex) {
+        ATA_Channel *channel = &g_Channels[channelIndex];
+        channel->usingInterrupts = picDriver != NULL;
+
+        channel->controlPortByte = 0x00; // clear all properties of the control port (recommandation from wiki.osdev.org)
+        if (channel->usingInterrupts) {
+            i686_IRQ_RegisterHandler(channel->irq, channelIndex == 0 ? primaryIrqHandler : secondaryIrqHandler);
+            picDriver->unmask(channel->irq);
+        } else {
+            channel->controlPortByte |= ATA_CONTROL_NIEN;
+        }
+        x86_OutByte(channel->controlBase + ATA_REGISTER_CONTROL, channel->controlPortByte);
+
+        // if the status floats high there is no controller (or no drives) on the channel, so don't wait on it
+        bool channelPresent = readAlternateStatus(channel) != ATA_STATUS_FLOATING_BUS;
+
+        for (uint8_t driveIndex = 0; driveIndex < 2; ++driveIndex) {
+            ATA_InitializeDriveOutput *output = &outputs[ATA_DRIVE_INDEX(channelIndex, driveIndex == 0)];
 
-    cacheFlush();
+            output->channel = channelIndex;
+            output->isMaster = driveIndex == 0;
+            output->sectorsPerBlock = 1;
 
-    return count;
+            if (!channelPresent) {
+                output->initializationResult = ATA_DRIVE_DOESNT_EXIST;
+                continue;
+            }
+
+            output->initializationResult = identify(channel, output->isMaster, output->driveData, &output->errorCode);
+            if (output->initializationResult == NO_ERROR)
+                output->sectorsPerBlock = setMultipleMode(channel, output->isMaster, output->driveData);
+        }
+    }
 }
 
-void ATA_Initialize(ATA_InitializeDriveOutput *masterOutput, ATA_InitializeDriveOutput *slaveOutput) {
-    g_ControlPortByte = 0x00;
-    x86_OutByte(ATA_PORT_CONTROL, g_ControlPortByte); // clear all properties of the control port (recommandation from wiki.osdev.org)
+static const DISK_Driver g_AtaDriver = {
+    .name = "ATA",
+    .readVectored = ATA_ReadVectored,
+    .writeVectored = ATA_WriteVectored,
+    .flush = ATA_Flush,
+    .submit = ATA_Submit,
+    .wait = ATA_Wait,
+    .deinitialize = NULL,
+};
 
-    masterOutput->initializationResult = identify(true, masterOutput->driveData, &masterOutput->errorCode);
-    slaveOutput->initializationResult = identify(false, slaveOutput->driveData, &slaveOutput->errorCode);
+const DISK_Driver *ATA_GetDriver() {
+    return &g_AtaDriver;
 }
@@ -491,12 +491,23 @@ typedef struct {
     uint16_t CheckSum : 8;
 } __attribute__((aligned(2), packed)) ATA_IdentifyData;
 
+// two channels (primary and secondary), with a master and a slave drive each
+#define ATA_MAX_DRIVES 4
+#define ATA_DRIVE_INDEX(channel, master) ((channel) * 2 + ((master) ? 0 : 1))
+
 typedef struct {
     ATA_IdentifyData *driveData;
+    uint8_t channel; // 0 is primary, 1 is secondary
+    bool isMaster;
     uint8_t errorCode;
     int initializationResult;
+    uint8_t sectorsPerBlock; // sectors per drq block, more than 1 if READ/WRITE MULTIPLE was enabled
 } ATA_InitializeDriveOutput;
 
-void ATA_Initialize(ATA_InitializeDriveOutput *masterOutput, ATA_InitializeDriveOutput *slaveOutput);
-int ATA_ReadSectors(uint64_t lba, void *buffer, uint16_t count, DISK *disk);
-int ATA_WriteSectors(uint64_t lba, void *buffer, uint16_t count, DISK *disk);
+void ATA_Initialize(ATA_InitializeDriveOutput *outputs);
+int ATA_ReadVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk);
+int ATA_WriteVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags, DISK *disk);
+int ATA_Flush(DISK *disk);
+int ATA_Submit(DISK_Command *command);
+void ATA_Wait(DISK *disk, volatile bool *completed);
+const DISK_Driver *ATA_GetDriver();
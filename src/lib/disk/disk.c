@@ -1,54 +1,111 @@
 #include "disk.h"
+#include "ahci.h"
 #include "ata.h"
+#include "virtio.h"
 #include "visual/stdio.h"
 #include <lib/errors/errors.h>
+#include <lib/interrupt/irq/irq.h>
 #include <lib/memory/allocator.h>
+#include <lib/x86/general.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-// !!! YOU ARE RESPONSIBLE FOR FREEING `masterDisk->ataData` AND `slaveDisk->ataData` with `DISK_DeInitialize` !!!
-int DISK_Initialize(DISK_InitializeResult *resultOutput, DISK *masterDisk, DISK *slaveDisk) {
-    ATA_InitializeDriveOutput masterOutput, slaveOutput;
+// detects the drives on both ata channels, the disks are put in `disksOutput` in order (primary master, primary slave, secondary master, secondary slave)
+int initializeAtaDisks(DISK *disksOutput, uint8_t maxDisks, uint8_t *diskCountOutput) {
+    ATA_InitializeDriveOutput driveOutputs[ATA_MAX_DRIVES];
 
-    masterOutput.driveData = (ATA_IdentifyData *)malloc(sizeof(ATA_IdentifyData));
-    slaveOutput.driveData = (ATA_IdentifyData *)malloc(sizeof(ATA_IdentifyData));
+    for (uint8_t i = 0; i < ATA_MAX_DRIVES; ++i) {
+        driveOutputs[i].driveData = (ATA_IdentifyData *)malloc(sizeof(ATA_IdentifyData));
+        if (driveOutputs[i].driveData != NULL)
+            continue;
 
-    if (masterOutput.driveData == NULL)
-        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
-    if (slaveOutput.driveData == NULL) {
-        free(masterOutput.driveData); // for once, we will do it for the caller
+        // for once, we will do it for the caller
+        for (uint8_t j = 0; j < i; ++j)
+            free(driveOutputs[j].driveData);
         return FAILED_TO_ALLOCATE_MEMORY_ERROR;
     }
 
-    ATA_Initialize(&masterOutput, &slaveOutput);
+    ATA_Initialize(driveOutputs);
+
+    uint8_t diskCount = 0;
+    for (uint8_t i = 0; i < ATA_MAX_DRIVES; ++i) {
+        ATA_InitializeDriveOutput *output = &driveOutputs[i];
+
+        if (output->initializationResult != NO_ERROR || !output->driveData->Capabilities.LbaSupported || diskCount >= maxDisks) {
+            free(output->driveData);
+            continue;
+        }
+
+        DISK *disk = &disksOutput[diskCount++];
+        disk->driver = ATA_GetDriver();
+        disk->driverData = NULL;
+        disk->channel = output->channel;
+        disk->isMaster = output->isMaster;
+        disk->cylinders = output->driveData->NumberOfCurrentCylinders;
+        disk->sectors = output->driveData->CurrentSectorsPerTrack;
+        disk->heads = output->driveData->NumberOfCurrentHeads;
+        disk->supports48BitLba = output->driveData->CommandSetSupport.BigLba && output->driveData->CommandSetActive.BigLba;
+        disk->sectorsPerBlock = output->sectorsPerBlock;
+        disk->ataData = (struct ATA_IdentifyData *)output->driveData;
+        disk->stats = NULL;
+        disk->queue.commands = NULL;
+    }
+
+    *diskCountOutput = diskCount;
+    return NO_ERROR;
+}
+
+// ahci disks come first, on machines with an ahci controller that is what the bios booted from, then the virtio disk, the legacy ata channels are checked last
+// !!! YOU ARE RESPONSIBLE FOR FREEING EVERY DISK IN `disksOutput` WITH `DISK_DeInitialize` !!!
+int DISK_Initialize(DISK *disksOutput, uint8_t maxDisks, uint8_t *diskCountOutput) {
+    int status;
+    uint8_t ahciDiskCount;
+    uint8_t virtioDiskCount;
+    uint8_t ataDiskCount;
 
-    resultOutput->initializedMasterDisk = masterOutput.initializationResult == NO_ERROR;
-    resultOutput->initializedSlaveDisk = slaveOutput.initializationResult == NO_ERROR;
+    // no controller just means no ahci disks
+    if ((status = AHCI_Initialize(disksOutput, maxDisks, &ahciDiskCount)) != NO_ERROR && status != PCI_DEVICE_NOT_FOUND_ERROR)
+        return status;
 
-    // spaghetti, maybe de-duplicate code?
-    if (resultOutput->initializedMasterDisk && masterOutput.driveData->Capabilities.LbaSupported) {
-        masterDisk->isMaster = true;
-        masterDisk->cylinders = masterOutput.driveData->NumberOfCurrentCylinders;
-        masterDisk->sectors = masterOutput.driveData->CurrentSectorsPerTrack;
-        masterDisk->heads = masterOutput.driveData->NumberOfCurrentHeads;
-        masterDisk->supports48BitLba = masterOutput.driveData->CommandSetSupport.BigLba && masterOutput.driveData->CommandSetActive.BigLba;
-        masterDisk->ataData = (struct ATA_IdentifyData *)masterOutput.driveData;
+    // same for virtio
+    if ((status = VIRTIO_Initialize(disksOutput + ahciDiskCount, maxDisks - ahciDiskCount, &virtioDiskCount)) != NO_ERROR && status != PCI_DEVICE_NOT_FOUND_ERROR) {
+        for (uint8_t i = 0; i < ahciDiskCount; ++i)
+            DISK_DeInitialize(&disksOutput[i]);
+        return status;
     }
 
-    if (resultOutput->initializedSlaveDisk && slaveOutput.driveData->Capabilities.LbaSupported) {
-        slaveDisk->isMaster = false;
-        slaveDisk->cylinders = slaveOutput.driveData->NumberOfCurrentCylinders;
-        slaveDisk->sectors = slaveOutput.driveData->CurrentSectorsPerTrack;
-        slaveDisk->heads = slaveOutput.driveData->NumberOfCurrentHeads;
-        slaveDisk->supports48BitLba = slaveOutput.driveData->CommandSetSupport.BigLba && slaveOutput.driveData->CommandSetActive.BigLba;
-        slaveDisk->ataData = (struct ATA_IdentifyData *)slaveOutput.driveData;
+    uint8_t diskCount = ahciDiskCount + virtioDiskCount;
+    if ((status = initializeAtaDisks(disksOutput + diskCount, maxDisks - diskCount, &ataDiskCount)) != NO_ERROR) {
+        for (uint8_t i = 0; i < diskCount; ++i)
+            DISK_DeInitialize(&disksOutput[i]);
+        return status;
     }
 
+    diskCount += ataDiskCount;
+    for (uint8_t i = 0; i < diskCount; ++i) {
+        DISK_InitializeStats(&disksOutput[i]);
+        if ((status = DISK_InitializeQueue(&disksOutput[i])) != NO_ERROR) {
+            for (uint8_t j = 0; j < diskCount; ++j)
+                DISK_DeInitialize(&disksOutput[j]);
+            return status;
+        }
+    }
+
+    *diskCountOutput = diskCount;
     return NO_ERROR;
 }
 
+// waits for everything that was submitted to the disk first
 void DISK_DeInitialize(DISK *disk) {
+    DISK_DeInitializeQueue(disk);
+
+    if (disk->driver != NULL && disk->driver->deinitialize != NULL)
+        disk->driver->deinitialize(disk);
+
+    free(disk->stats);
+    disk->stats = NULL;
+
     if (disk->ataData == NULL)
         return;
 
@@ -56,10 +113,69 @@ void DISK_DeInitialize(DISK *disk) {
     disk->ataData = NULL;
 }
 
-int DISK_ReadSectors(DISK *disk, uint64_t lba, uint16_t count, uint16_t *readCountOutput, void *dataOutput) {
-    return ATA_ReadSectors(lba, dataOutput, count, disk);
+int DISK_ReadSectors(DISK *disk, uint64_t lba, uint32_t count, uint32_t *readCountOutput, void *dataOutput) {
+    DISK_IoVector vector = {.buffer = dataOutput, .sectorCount = count};
+
+    int status = DISK_ReadVectored(disk, lba, &vector, 1);
+
+    if (readCountOutput != NULL)
+        *readCountOutput = status == NO_ERROR ? count : 0;
+
+    return status;
 }
 
-int DISK_WriteSectors(DISK *disk, uint64_t lba, uint16_t count, void *buffer) {
-    return ATA_WriteSectors(lba, buffer, count, disk);
+int DISK_WriteSectors(DISK *disk, uint64_t lba, uint32_t count, void *buffer, uint8_t flags) {
+    DISK_IoVector vector = {.buffer = buffer, .sectorCount = count};
+
+    return DISK_WriteVectored(disk, lba, &vector, 1, flags);
+}
+
+// goes through the scheduler like an asynchronous request, so it is sent along with anything else that is queued on the disk
+int scheduleRequest(DISK *disk, bool write, uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags) {
+    DISK_Request request = {
+        .write = write,
+        .flags = flags,
+        .lba = lba,
+        .vectors = vectors,
+        .vectorCount = vectorCount,
+        .callback = NULL,
+    };
+
+    // the request is on the stack, so it can't be left queued when waiting fails
+    if (i686_IRQ_InHandler())
+        return DISK_BLOCKING_IN_IRQ_ERROR;
+
+    DISK_Submit(disk, &request);
+    DISK_Wait(disk, &request);
+
+    return request.status;
+}
+
+int DISK_ReadVectored(DISK *disk, uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount) {
+    if (disk == NULL || vectors == NULL)
+        return NULL_ERROR;
+
+    return scheduleRequest(disk, false, lba, vectors, vectorCount, 0);
+}
+
+int DISK_WriteVectored(DISK *disk, uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags) {
+    if (disk == NULL || vectors == NULL)
+        return NULL_ERROR;
+
+    return scheduleRequest(disk, true, lba, vectors, vectorCount, flags);
+}
+
+// waits until every write that was submitted before the call is on the media, submitted requests are completed first
+int DISK_Flush(DISK *disk) {
+    if (disk == NULL)
+        return NULL_ERROR;
+
+    uint64_t startCycles = x86_ReadTsc();
+    int status;
+    if ((status = DISK_Drain(disk)) != NO_ERROR)
+        return status;
+    status = disk->driver->flush(disk);
+    DISK_RecordRequest(disk, DISK_STATS_FLUSH, 0, x86_ReadTsc() - startCycles, status);
+
+    return status;
 }
@@ -6,21 +6,182 @@
 // forward declaration because of fucky wucky circular dependancy
 struct ATA_IdentifyData;
 
+#define DISK_MAX_DISKS 8
+
+struct DISK_Driver;
+
+// i/o accounting, every time is in tsc cycles
+#define DISK_STATS_LATENCY_BUCKETS 32 // bucket n counts latencies of 2^n to 2^(n+1)-1 cycles, the last one also counts everything longer
+
+typedef enum {
+    DISK_STATS_READ = 0,
+    DISK_STATS_WRITE = 1,
+    DISK_STATS_FLUSH = 2,
+    DISK_STATS_DIRECTION_COUNT = 3,
+} DISK_StatsDirection;
+
+typedef enum {
+    DISK_EVENT_IRQ_TIMEOUT = 0, // the driver stopped waiting for an interrupt and polled instead
+    DISK_EVENT_TIMEOUT = 1,     // a command was given up on
+    DISK_EVENT_RESET = 2,       // the device was reset to recover it
+    DISK_EVENT_COUNT = 3,
+} DISK_StatsEvent;
+
+typedef struct {
+    uint64_t count;
+    uint64_t totalCycles;
+    uint32_t buckets[DISK_STATS_LATENCY_BUCKETS];
+} DISK_LatencyHistogram;
+
 typedef struct {
-    bool isMaster; // if false its the slave drive
+    uint64_t requests; // DISK_ReadVectored, DISK_WriteVectored or DISK_Flush calls
+    uint64_t sectors;
+    uint64_t errors;         // failed requests
+    uint64_t copiedBytes;    // moved by the cpu (pio, memcpy), 0 for dma
+    uint64_t copyCycles;
+    DISK_LatencyHistogram requestLatency; // from the call until it returns, queueing and copying included
+    DISK_LatencyHistogram commandLatency; // from sending a command to the device until it completes, the count is the command count
+} DISK_DirectionStats;
+
+typedef struct {
+    DISK_DirectionStats directions[DISK_STATS_DIRECTION_COUNT];
+    uint64_t pollCycles; // spent busy waiting on the device instead of halting, pio copies done while polling are included
+    uint64_t events[DISK_EVENT_COUNT];
+} DISK_Stats;
+
+struct DISK_Request;
+struct DISK_Command;
+
+#define DISK_MAX_COMMANDS 4 // commands a disk can have sent to its driver at once
+
+// requests waiting to be sent to the driver, see scheduler.c
+typedef struct {
+    struct DISK_Request *reads;      // sorted by lba
+    struct DISK_Request *writes;     // in submission order
+    struct DISK_Request *writesTail;
+    uint64_t headLba;                // where the last command ended, the elevator continues from here
+    uint32_t nextSequence;
+    struct DISK_Command *commands;   // DISK_MAX_COMMANDS of them
+    bool dispatching;                // so a completion in the middle of dispatching doesn't start dispatching again
+    bool dispatchAgain;
+    volatile bool commandCompleted;  // set whenever the driver completes a command, DISK_Wait and DISK_Drain wait on it
+} DISK_Queue;
+
+typedef struct DISK {
+    const struct DISK_Driver *driver;
+    void *driverData; // owned by the driver, the ahci port for example
+    uint8_t channel;  // ata channel, 0 is primary and 1 is secondary
+    bool isMaster;    // if false its the slave drive
     uint16_t cylinders;
     uint16_t sectors;
     uint16_t heads;
     bool supports48BitLba;
-    struct ATA_IdentifyData *ataData;
+    uint8_t sectorsPerBlock; // sectors transferred per drq block (READ/WRITE MULTIPLE)
+    struct ATA_IdentifyData *ataData; // ahci drives identify with the same data
+    DISK_Stats *stats;                // NULL if it couldn't be allocated, nothing is counted then
+    DISK_Queue queue;
 } DISK;
 
+// one buffer of a vectored request, the buffers are transferred in order to/from consecutive sectors
 typedef struct {
-    bool initializedMasterDisk;
-    bool initializedSlaveDisk;
-} DISK_InitializeResult;
+    void *buffer;
+    uint32_t sectorCount;
+} DISK_IoVector;
 
-int DISK_Initialize(DISK_InitializeResult *resultOutput, DISK *masterDisk, DISK *slaveDisk);
+// a position in a list of io vectors, for drivers walking through a vectored request
+typedef struct {
+    const DISK_IoVector *vector;
+    uint32_t sectorOffset; // sectors of `vector` that have already been transferred
+} DISK_IoVectorCursor;
+
+struct DISK_Request;
+
+// called once the request is done, possibly from an irq handler, so keep it short and never wait for a disk in it
+// DISK_Wait, DISK_Drain and the synchronous DISK_... functions fail with DISK_BLOCKING_IN_IRQ_ERROR there, DISK_Submit is fine
+typedef void (*DISK_RequestCallback)(struct DISK_Request *request);
+
+// a read or write going through the scheduler, the request and its `vectors` have to stay around until it completes
+typedef struct DISK_Request {
+    bool write;
+    uint8_t flags; // DISK_WRITE_..., only for writes
+    uint64_t lba;
+    const DISK_IoVector *vectors;
+    uint32_t vectorCount;
+    DISK_RequestCallback callback; // may be NULL
+    void *context;                 // for the callback
+
+    // filled in by the scheduler
+    uint64_t sectorCount;
+    uint32_t sequence; // submission order
+    uint64_t submitCycles;
+    volatile bool completed;
+    int status;
+    struct DISK_Request *next;
+} DISK_Request;
+
+#define DISK_SCHEDULER_MAX_MERGED_VECTORS 32 // io vectors a merged command can have
+#define DISK_COMMAND_DRIVER_STORAGE 128      // bytes of a command the driver can keep its own request in
+
+// what the scheduler sends to the driver, one or more merged requests
+typedef struct DISK_Command {
+    DISK *disk;
+    bool write;
+    uint8_t flags;
+    uint64_t lba;
+    uint64_t sectorCount;
+    const DISK_IoVector *vectors; // `mergedVectors`, or the vectors of the only request
+    uint32_t vectorCount;
+    DISK_Request *requests; // the requests it covers, in lba order for reads, linked through `next`
+    volatile bool idle;     // not sent to the driver, or completed
+    DISK_IoVector mergedVectors[DISK_SCHEDULER_MAX_MERGED_VECTORS];
+    uint64_t driverStorage[DISK_COMMAND_DRIVER_STORAGE / sizeof(uint64_t)];
+} DISK_Command;
+
+typedef struct DISK_Driver {
+    // driver name
+    const char *name;
+
+    int (*readVectored)(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk);
+    int (*writeVectored)(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags, DISK *disk);
+    int (*flush)(DISK *disk);
+
+    // starts the command and returns right away, the driver calls DISK_CompleteCommand once it is done
+    // may be NULL, the scheduler uses readVectored/writeVectored then, and the command is done by the time they return
+    int (*submit)(DISK_Command *command);
+    // waits until `*completed` is set by a command completing, halting or polling the device as needed, NULL if `submit` is
+    void (*wait)(DISK *disk, volatile bool *completed);
+
+    // stop the device from touching the disks memory, may be NULL
+    void (*deinitialize)(DISK *disk);
+} DISK_Driver;
+
+// flags for writes, without any the data may sit in the drive's write cache until DISK_Flush
+#define DISK_WRITE_BARRIER 0x01 // every earlier write is made durable before this one is written
+#define DISK_WRITE_FUA 0x02     // the write is durable once it completes (force unit access)
+
+int DISK_Initialize(DISK *disksOutput, uint8_t maxDisks, uint8_t *diskCountOutput);
 void DISK_DeInitialize(DISK *disk);
-int DISK_ReadSectors(DISK *disk, uint64_t lba, uint16_t count, uint16_t *readCountOutput, void *dataOutput);
-int DISK_WriteSectors(DISK *disk, uint64_t lba, uint16_t count, void *buffer);
+int DISK_ReadSectors(DISK *disk, uint64_t lba, uint32_t count, uint32_t *readCountOutput, void *dataOutput);
+int DISK_WriteSectors(DISK *disk, uint64_t lba, uint32_t count, void *buffer, uint8_t flags);
+int DISK_ReadVectored(DISK *disk, uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount);
+int DISK_WriteVectored(DISK *disk, uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags);
+int DISK_Flush(DISK *disk);
+
+// scheduler.c
+int DISK_InitializeQueue(DISK *disk);
+void DISK_DeInitializeQueue(DISK *disk);
+void DISK_Submit(DISK *disk, DISK_Request *request);
+int DISK_Wait(DISK *disk, DISK_Request *request);
+int DISK_Drain(DISK *disk);
+void DISK_CompleteCommand(DISK_Command *command, int status);
+
+// stats.c
+void DISK_InitializeStats(DISK *disk);
+void DISK_RecordRequest(DISK *disk, DISK_StatsDirection direction, uint64_t sectors, uint64_t cycles, int status);
+void DISK_RecordCommand(DISK *disk, DISK_StatsDirection direction, uint64_t cycles);
+void DISK_RecordCopy(DISK *disk, DISK_StatsDirection direction, uint32_t bytes, uint64_t cycles);
+void DISK_RecordPoll(DISK *disk, uint64_t cycles);
+void DISK_RecordEvent(DISK *disk, DISK_StatsEvent event);
+int DISK_GetStats(DISK *disk, DISK_Stats *statsOutput);
+void DISK_ResetStats(DISK *disk);
+void DISK_DumpStats(DISK *disk, uint8_t index);
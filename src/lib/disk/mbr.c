@@ -7,6 +7,10 @@ void MBR_InitializePartition(Partition *partitionOut, DISK *disk, uint32_t parti
     partitionOut->partitionSize = partitionSize;
 }
 
-int Partition_ReadSectors(Partition *partition, uint64_t lba, uint16_t sectors, uint16_t *readCountOutput, void *dataOutput) {
+int Partition_ReadSectors(Partition *partition, uint64_t lba, uint32_t sectors, uint32_t *readCountOutput, void *dataOutput) {
     return DISK_ReadSectors(partition->disk, partition->partitionLBA + lba, sectors, readCountOutput, dataOutput);
 }
+
+int Partition_ReadVectored(Partition *partition, uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount) {
+    return DISK_ReadVectored(partition->disk, partition->partitionLBA + lba, vectors, vectorCount);
+}
@@ -11,4 +11,5 @@ typedef struct {
 
 void MBR_InitializePartition(Partition *partitionOut, DISK *disk, uint32_t partitionLBA, uint32_t partitionSize);
 
-int Partition_ReadSectors(Partition *partition, uint64_t lba, uint16_t sectors, uint16_t *readCountOutput, void *dataOutput);
+int Partition_ReadSectors(Partition *partition, uint64_t lba, uint32_t sectors, uint32_t *readCountOutput, void *dataOutput);
+int Partition_ReadVectored(Partition *partition, uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount);
@@ -0,0 +1,158 @@
+#include "ramdisk.h"
+#include "disk.h"
+#include "fat.h"
+#include <lib/algorithm/math.h>
+#include <lib/errors/errors.h>
+#include <lib/memory/allocator.h>
+#include <lib/memory/memory.h>
+#include <lib/x86/general.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint8_t *memory;
+    uint64_t sectorCount;
+    bool ownsMemory; // false if the image was handed to us, it is never freed then
+} RAMDISK_Data;
+
+// copies between the disk and the vectors, `write` decides the direction
+static int transferVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk, bool write) {
+    RAMDISK_Data *data = (RAMDISK_Data *)disk->driverData;
+    if (data == NULL)
+        return NULL_ERROR;
+
+    uint64_t totalSectors = 0;
+    for (uint32_t i = 0; i < vectorCount; ++i)
+        totalSectors += vectors[i].sectorCount;
+    if (lba + totalSectors > data->sectorCount)
+        return OUT_OF_BOUNDS_ERROR;
+
+    for (uint32_t i = 0; i < vectorCount; ++i) {
+        uint8_t *sectors = data->memory + lba * SECTOR_SIZE;
+        uint32_t bytes = vectors[i].sectorCount * SECTOR_SIZE;
+        uint64_t startCycles = x86_ReadTsc();
+
+        if (write)
+            memcpy(sectors, vectors[i].buffer, bytes);
+        else
+            memcpy(vectors[i].buffer, sectors, bytes);
+
+        DISK_RecordCopy(disk, write ? DISK_STATS_WRITE : DISK_STATS_READ, bytes, x86_ReadTsc() - startCycles);
+
+        lba += vectors[i].sectorCount;
+    }
+
+    return NO_ERROR;
+}
+
+int RAMDISK_ReadVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk) {
+    return transferVectored(lba, vectors, vectorCount, disk, false);
+}
+
+// every write is durable as soon as it's done (as durable as ram gets), so the flags don't change anything
+int RAMDISK_WriteVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags, DISK *disk) {
+    return transferVectored(lba, vectors, vectorCount, disk, true);
+}
+
+int RAMDISK_Flush(DISK *disk) {
+    return disk->driverData == NULL ? NULL_ERROR : NO_ERROR;
+}
+
+// serves sectors from `image`, if `image` is NULL a zeroed scratch disk of `sectorCount` sectors is allocated instead
+// the image is not copied, so it has to stay around until the disk is deinitialized
+// !!! YOU ARE RESPONSIBLE FOR FREEING `diskOutput` WITH `DISK_DeInitialize` !!!
+int RAMDISK_Initialize(DISK *diskOutput, void *image, uint64_t sectorCount) {
+    if (diskOutput == NULL)
+        return NULL_ERROR;
+
+    RAMDISK_Data *data = malloc(sizeof(RAMDISK_Data));
+    if (data == NULL)
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+
+    data->memory = image;
+    data->sectorCount = sectorCount;
+    data->ownsMemory = image == NULL;
+    if (data->ownsMemory) {
+        data->memory = calloc(sectorCount, SECTOR_SIZE);
+        if (data->memory == NULL) {
+            free(data);
+            return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+        }
+    }
+
+    diskOutput->driver = RAMDISK_GetDriver();
+    diskOutput->driverData = data;
+    diskOutput->channel = 0;
+    diskOutput->isMaster = true;
+    diskOutput->cylinders = 0;
+    diskOutput->sectors = 0;
+    diskOutput->heads = 0;
+    diskOutput->supports48BitLba = true;
+    diskOutput->sectorsPerBlock = 1;
+    diskOutput->ataData = NULL;
+    DISK_InitializeStats(diskOutput);
+
+    int status = DISK_InitializeQueue(diskOutput);
+    if (status != NO_ERROR) {
+        free(diskOutput->stats);
+        diskOutput->stats = NULL;
+        RAMDISK_DeInitialize(diskOutput);
+    }
+
+    return status;
+}
+
+// reads the file at `path` into memory, padded with zeros to a whole sector, to be passed to `RAMDISK_Initialize`
+// !!! YOU ARE RESPONSIBLE FOR FREEING `imageOutput` !!!
+int RAMDISK_LoadImage(FAT_Filesystem *filesystem, const char *path, void **imageOutput, uint32_t *sectorCountOutput) {
+    int status;
+    FAT_File *file;
+
+    if ((status = FAT_Open(filesystem, path, &file)) != NO_ERROR)
+        return status;
+
+    uint32_t sectorCount = DIV_ROUND_UP(file->size, SECTOR_SIZE);
+    uint8_t *image = mallocPageAligned(sectorCount * SECTOR_SIZE);
+    if (image == NULL) {
+        FAT_Close(filesystem, file);
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+    }
+
+    uint32_t readCount;
+    if ((status = FAT_Read(filesystem, file, file->size, &readCount, image)) != NO_ERROR || readCount != file->size) {
+        FAT_Close(filesystem, file);
+        free(image);
+        return status != NO_ERROR ? status : FILESYSTEM_READ_ERROR;
+    }
+    memset(image + file->size, 0, sectorCount * SECTOR_SIZE - file->size);
+
+    FAT_Close(filesystem, file);
+
+    *imageOutput = image;
+    *sectorCountOutput = sectorCount;
+    return NO_ERROR;
+}
+
+void RAMDISK_DeInitialize(DISK *disk) {
+    RAMDISK_Data *data = (RAMDISK_Data *)disk->driverData;
+    if (data == NULL)
+        return;
+
+    if (data->ownsMemory)
+        free(data->memory);
+    free(data);
+    disk->driverData = NULL;
+}
+
+static const DISK_Driver g_RamdiskDriver = {
+    .name = "ramdisk",
+    .readVectored = RAMDISK_ReadVectored,
+    .writeVectored = RAMDISK_WriteVectored,
+    .flush = RAMDISK_Flush,
+    .deinitialize = RAMDISK_DeInitialize,
+};
+
+const DISK_Driver *RAMDISK_GetDriver() {
+    return &g_RamdiskDriver;
+}
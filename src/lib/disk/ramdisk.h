@@ -0,0 +1,14 @@
+#pragma once
+
+#include "disk.h"
+#include "fat.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+int RAMDISK_Initialize(DISK *diskOutput, void *image, uint64_t sectorCount);
+int RAMDISK_LoadImage(FAT_Filesystem *filesystem, const char *path, void **imageOutput, uint32_t *sectorCountOutput);
+void RAMDISK_DeInitialize(DISK *disk);
+int RAMDISK_ReadVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk);
+int RAMDISK_WriteVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags, DISK *disk);
+int RAMDISK_Flush(DISK *disk);
+const DISK_Driver *RAMDISK_GetDriver();
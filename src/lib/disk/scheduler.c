@@ -0,0 +1,464 @@
+#include "disk.h"
+#include <lib/errors/errors.h>
+#include <lib/interrupt/irq/irq.h>
+#include <lib/memory/allocator.h>
+#include <lib/memory/memory.h>
+#include <lib/x86/general.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// an elevator between the users of a disk and its driver
+// reads are kept sorted by lba and sent in c-look order (ascending from where the last command ended, then wrapping around to the lowest lba),
+// adjacent or overlapping reads are merged into one command, and reads go ahead of queued writes unless they overlap an earlier one
+// writes stay in submission order, so barriers keep meaning what they mean, but adjacent ones are still merged
+// up to DISK_MAX_COMMANDS commands are handed to the driver at once, the driver may run them in any order,
+// so nothing that overlaps a command the driver has is sent, unless both only read
+// drivers may wait for the hardware while taking a command, so commands are never sent from an irq handler,
+// a completion there only marks the queue, and what can go next is sent once the irq handler has returned (see dispatchDeferred)
+
+static DISK *g_Disks[DISK_MAX_DISKS]; // the disks with a queue, for dispatchDeferred
+
+static uint64_t requestEnd(const DISK_Request *request) {
+    return request->lba + request->sectorCount;
+}
+
+static bool overlaps(const DISK_Request *first, const DISK_Request *second) {
+    return first->lba < requestEnd(second) && second->lba < requestEnd(first);
+}
+
+// commands the driver has are older than anything queued
+static bool blockedBySentCommand(const DISK_Queue *queue, const DISK_Request *request) {
+    for (uint8_t i = 0; i < DISK_MAX_COMMANDS; ++i) {
+        const DISK_Command *command = &queue->commands[i];
+        if (command->idle || (!command->write && !request->write))
+            continue;
+
+        if (command->lba < requestEnd(request) && request->lba < command->lba + command->sectorCount)
+            return true;
+    }
+
+    return false;
+}
+
+// a read can't go ahead of a write that was submitted before it and covers some of the same sectors
+static bool readIsBlocked(const DISK_Queue *queue, const DISK_Request *read) {
+    for (const DISK_Request *write = queue->writes; write != NULL; write = write->next)
+        if (write->sequence < read->sequence && overlaps(write, read))
+            return true;
+
+    return blockedBySentCommand(queue, read);
+}
+
+// and a write can't go ahead of a read that was submitted before it
+static bool writeIsBlocked(const DISK_Queue *queue, const DISK_Request *write) {
+    for (const DISK_Request *read = queue->reads; read != NULL; read = read->next)
+        if (read->sequence < write->sequence && overlaps(write, read))
+            return true;
+
+    return blockedBySentCommand(queue, write);
+}
+
+// c-look, the first read at or after the head, or the lowest one if there is nothing after the head
+static DISK_Request *pickRead(const DISK_Queue *queue) {
+    DISK_Request *lowest = NULL;
+
+    for (DISK_Request *read = queue->reads; read != NULL; read = read->next) {
+        if (readIsBlocked(queue, read))
+            continue;
+        if (read->lba >= queue->headLba)
+            return read;
+        if (lowest == NULL)
+            lowest = read;
+    }
+
+    return lowest;
+}
+
+static DISK_Command *findIdleCommand(DISK_Queue *queue) {
+    for (uint8_t i = 0; i < DISK_MAX_COMMANDS; ++i)
+        if (queue->commands[i].idle)
+            return &queue->commands[i];
+
+    return NULL;
+}
+
+// appends the vectors of `request` to the merged vectors of `command`, leaving out its first `skipSectors` sectors
+// returns false if they don't fit, nothing is appended then
+static bool appendVectors(DISK_Command *command, const DISK_Request *request, uint64_t skipSectors) {
+    uint32_t count = command->vectorCount;
+
+    for (uint32_t i = 0; i < request->vectorCount; ++i) {
+        const DISK_IoVector *vector = &request->vectors[i];
+        if (skipSectors >= vector->sectorCount) {
+            skipSectors -= vector->sectorCount;
+            continue;
+        }
+
+        if (count >= DISK_SCHEDULER_MAX_MERGED_VECTORS)
+            return false;
+
+        command->mergedVectors[count].buffer = (uint8_t *)vector->buffer + skipSectors * 512;
+        command->mergedVectors[count].sectorCount = vector->sectorCount - skipSectors;
+        skipSectors = 0;
+        ++count;
+    }
+
+    command->vectorCount = count;
+    return true;
+}
+
+// moves the cursor forward by `sectors`
+static void advanceCursor(DISK_IoVectorCursor *cursor, uint64_t sectors) {
+    while (sectors > 0) {
+        uint32_t left = cursor->vector->sectorCount - cursor->sectorOffset;
+        if (sectors < left) {
+            cursor->sectorOffset += sectors;
+            return;
+        }
+
+        sectors -= left;
+        ++cursor->vector;
+        cursor->sectorOffset = 0;
+    }
+}
+
+// copies `sectors` sectors, starting `offset` sectors into `from`, to the start of `to`
+static void copySectors(const DISK_IoVector *from, uint64_t offset, const DISK_IoVector *to, uint64_t sectors) {
+    DISK_IoVectorCursor source = {.vector = from, .sectorOffset = 0};
+    DISK_IoVectorCursor destination = {.vector = to, .sectorOffset = 0};
+    advanceCursor(&source, offset);
+
+    while (sectors > 0) {
+        uint32_t run = source.vector->sectorCount - source.sectorOffset;
+        if (destination.vector->sectorCount - destination.sectorOffset < run)
+            run = destination.vector->sectorCount - destination.sectorOffset;
+        if (sectors < run)
+            run = sectors;
+
+        memcpy((uint8_t *)destination.vector->buffer + destination.sectorOffset * 512, (uint8_t *)source.vector->buffer + source.sectorOffset * 512, run * 512);
+
+        advanceCursor(&source, run);
+        advanceCursor(&destination, run);
+        sectors -= run;
+    }
+}
+
+// the command covers `first` alone, using its own vectors
+static void useRequestVectors(DISK_Command *command, DISK_Request *first) {
+    command->vectors = first->vectors;
+    command->vectorCount = first->vectorCount;
+    command->sectorCount = first->sectorCount;
+    command->requests = first;
+}
+
+// takes `first` off the queue together with the reads after it in the sorted list that touch the range read so far
+static void buildReadCommand(DISK_Queue *queue, DISK_Command *command, DISK_Request *first) {
+    command->write = false;
+    command->flags = 0;
+    command->lba = first->lba;
+    command->vectors = command->mergedVectors;
+    command->vectorCount = 0;
+    command->requests = first;
+
+    // find where `first` is in the list, so it can be unlinked together with the rest of the batch
+    DISK_Request **link = &queue->reads;
+    while (*link != first)
+        link = &(*link)->next;
+
+    DISK_Request *last = first;
+    uint64_t end = requestEnd(first);
+    if (!appendVectors(command, first, 0)) {
+        // too fragmented to go through the merged vectors, send it as it is
+        useRequestVectors(command, first);
+    } else {
+        for (DISK_Request *next = first->next; next != NULL && next->lba <= end && !readIsBlocked(queue, next); next = next->next) {
+            if (requestEnd(next) > end && !appendVectors(command, next, end - next->lba))
+                break;
+
+            if (requestEnd(next) > end)
+                end = requestEnd(next);
+            last = next;
+        }
+        command->sectorCount = end - first->lba;
+    }
+
+    *link = last->next;
+    last->next = NULL;
+}
+
+// takes the oldest write off the queue together with the writes after it that continue where it ends
+static void buildWriteCommand(DISK_Queue *queue, DISK_Command *command) {
+    DISK_Request *first = queue->writes;
+    DISK_Request *last = first;
+
+    command->write = true;
+    command->flags = first->flags;
+    command->lba = first->lba;
+    command->vectors = command->mergedVectors;
+    command->vectorCount = 0;
+    command->requests = first;
+
+    if (!appendVectors(command, first, 0)) {
+        useRequestVectors(command, first);
+    } else {
+        uint64_t end = requestEnd(first);
+
+        // a barrier has to wait for the writes before it, so it can't be part of their command
+        for (DISK_Request *next = first->next; next != NULL && next->lba == end && !(next->flags & DISK_WRITE_BARRIER) && !writeIsBlocked(queue, next); next = next->next) {
+            if (!appendVectors(command, next, 0))
+                break;
+
+            end = requestEnd(next);
+            command->flags |= next->flags;
+            last = next;
+        }
+        command->sectorCount = end - first->lba;
+    }
+
+    queue->writes = last->next;
+    if (queue->writes == NULL)
+        queue->writesTail = NULL;
+    last->next = NULL;
+}
+
+static void completeRequest(DISK *disk, DISK_Request *request, int status) {
+    DISK_RecordRequest(disk, request->write ? DISK_STATS_WRITE : DISK_STATS_READ, request->sectorCount, x86_ReadTsc() - request->submitCycles, status);
+
+    request->status = status;
+    request->completed = true;
+    if (request->callback != NULL)
+        request->callback(request);
+}
+
+// `interruptsEnabled` is what they were before dispatching disabled them
+static void sendCommand(DISK *disk, DISK_Command *command, bool interruptsEnabled) {
+    const DISK_Driver *driver = disk->driver;
+    command->idle = false;
+
+    if (driver->submit != NULL) {
+        int status = driver->submit(command);
+        if (status != NO_ERROR)
+            DISK_CompleteCommand(command, status);
+        return;
+    }
+
+    // synchronous drivers may want to halt while waiting, the dispatching flag keeps everything else out of the queue meanwhile
+    x86_RestoreInterrupts(interruptsEnabled);
+    int status;
+    if (command->write)
+        status = driver->writeVectored(command->lba, command->vectors, command->vectorCount, command->flags, disk);
+    else
+        status = driver->readVectored(command->lba, command->vectors, command->vectorCount, disk);
+    x86_DisableInterrupts();
+
+    DISK_CompleteCommand(command, status);
+}
+
+// sends queued requests to the driver until it has DISK_MAX_COMMANDS commands or nothing else can go
+// `nested` runs it even inside another dispatch (from a completion callback), for callers that can't return before their request went out
+static void dispatch(DISK *disk, bool nested) {
+    DISK_Queue *queue = &disk->queue;
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // completions touch the queue from the irq handlers
+
+    if (i686_IRQ_InHandler() || (queue->dispatching && !nested)) {
+        queue->dispatchAgain = true;
+        x86_RestoreInterrupts(interruptsEnabled);
+        return;
+    }
+    bool outermost = !queue->dispatching;
+    queue->dispatching = true;
+
+    do {
+        queue->dispatchAgain = false;
+
+        DISK_Command *command;
+        while ((command = findIdleCommand(queue)) != NULL) {
+            // a blocked read has an earlier write in front of it, so if no read can go, that write may
+            DISK_Request *read = pickRead(queue);
+            if (read != NULL)
+                buildReadCommand(queue, command, read);
+            else if (queue->writes != NULL && !writeIsBlocked(queue, queue->writes))
+                buildWriteCommand(queue, command);
+            else
+                break;
+
+            queue->headLba = command->lba + command->sectorCount;
+            sendCommand(disk, command, interruptsEnabled);
+        }
+    } while (queue->dispatchAgain);
+
+    queue->dispatching = !outermost;
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+// a deferred irq handler, it sends what the completions in the irq handler left queued
+// a dispatch it interrupted picks that up itself, dispatch only marks the queue again then
+static void dispatchDeferred() {
+    for (uint8_t i = 0; i < DISK_MAX_DISKS; ++i) {
+        DISK *disk = g_Disks[i];
+        if (disk != NULL && disk->queue.dispatchAgain)
+            dispatch(disk, false);
+    }
+}
+
+// called by the driver once it is done with a command, from its irq handler or while polling
+void DISK_CompleteCommand(DISK_Command *command, int status) {
+    DISK *disk = command->disk;
+    DISK_Request *request = command->requests;
+    command->requests = NULL;
+
+    // the sectors a read shares with the ones before it were read into their buffers, so they are copied over
+    uint64_t covered = command->lba;
+    for (DISK_Request *read = request; read != NULL && !command->write; read = read->next) {
+        if (status == NO_ERROR && read->lba < covered) {
+            uint64_t shared = covered - read->lba;
+            if (shared > read->sectorCount)
+                shared = read->sectorCount;
+            copySectors(command->vectors, read->lba - command->lba, read->vectors, shared);
+        }
+        if (requestEnd(read) > covered)
+            covered = requestEnd(read);
+    }
+
+    command->idle = true;
+    disk->queue.commandCompleted = true;
+
+    while (request != NULL) {
+        DISK_Request *next = request->next; // the callback may reuse the request
+        completeRequest(disk, request, status);
+        request = next;
+    }
+
+    dispatch(disk, false);
+}
+
+// !!! YOU ARE RESPONSIBLE FOR FREEING THE QUEUE WITH `DISK_DeInitializeQueue` !!!
+int DISK_InitializeQueue(DISK *disk) {
+    static bool deferredHandlerAdded = false;
+    int status;
+    if (!deferredHandlerAdded) {
+        if ((status = i686_IRQ_AddDeferredHandler(dispatchDeferred)) != NO_ERROR)
+            return status;
+        deferredHandlerAdded = true;
+    }
+
+    memset(&disk->queue, 0, sizeof(DISK_Queue));
+
+    uint8_t slot = 0;
+    while (slot < DISK_MAX_DISKS && g_Disks[slot] != NULL)
+        ++slot;
+    if (slot == DISK_MAX_DISKS)
+        return OUT_OF_BOUNDS_ERROR;
+
+    disk->queue.commands = malloc(DISK_MAX_COMMANDS * sizeof(DISK_Command));
+    if (disk->queue.commands == NULL)
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+
+    for (uint8_t i = 0; i < DISK_MAX_COMMANDS; ++i) {
+        disk->queue.commands[i].disk = disk;
+        disk->queue.commands[i].idle = true;
+        disk->queue.commands[i].requests = NULL;
+    }
+
+    g_Disks[slot] = disk;
+    return NO_ERROR;
+}
+
+// waits for everything queued first
+void DISK_DeInitializeQueue(DISK *disk) {
+    if (disk->queue.commands == NULL)
+        return;
+
+    DISK_Drain(disk);
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // so dispatchDeferred doesn't see it half removed
+    for (uint8_t i = 0; i < DISK_MAX_DISKS; ++i)
+        if (g_Disks[i] == disk)
+            g_Disks[i] = NULL;
+    x86_RestoreInterrupts(interruptsEnabled);
+
+    free(disk->queue.commands);
+    disk->queue.commands = NULL;
+}
+
+// queues the request and returns, it may already be done by then
+// once it is, `completed` is set and the callback is called, possibly from an irq handler
+// if the driver is busy, the request is sent once a command completes, without anybody having to wait for it
+void DISK_Submit(DISK *disk, DISK_Request *request) {
+    DISK_Queue *queue = &disk->queue;
+
+    request->sectorCount = 0;
+    for (uint32_t i = 0; i < request->vectorCount; ++i)
+        request->sectorCount += request->vectors[i].sectorCount;
+    request->submitCycles = x86_ReadTsc();
+    request->completed = false;
+    request->status = NO_ERROR;
+    request->next = NULL;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+
+    request->sequence = queue->nextSequence++;
+    if (request->write) {
+        if (queue->writesTail == NULL)
+            queue->writes = request;
+        else
+            queue->writesTail->next = request;
+        queue->writesTail = request;
+    } else {
+        // after any reads of the same lba, so those keep their order
+        DISK_Request **link = &queue->reads;
+        while (*link != NULL && (*link)->lba <= request->lba)
+            link = &(*link)->next;
+
+        request->next = *link;
+        *link = request;
+    }
+
+    x86_RestoreInterrupts(interruptsEnabled);
+
+    dispatch(disk, false);
+}
+
+// returns once the request is done, sending whatever can go next every time a command completes
+// the dispatch here also covers a DISK_Submit from inside a dispatch (a callback reading synchronously), which only queued the request
+// fails right away in an irq handler, nothing would be sent from there, so it would wait forever, the request stays queued then
+int DISK_Wait(DISK *disk, DISK_Request *request) {
+    DISK_Queue *queue = &disk->queue;
+    if (i686_IRQ_InHandler())
+        return DISK_BLOCKING_IN_IRQ_ERROR;
+
+    while (!request->completed) {
+        queue->commandCompleted = false;
+        dispatch(disk, true);
+
+        // without a wait function the driver is synchronous, and the dispatch above did the work
+        if (!request->completed && disk->driver->wait != NULL)
+            disk->driver->wait(disk, &queue->commandCompleted);
+    }
+
+    return NO_ERROR;
+}
+
+// returns once everything that was submitted is done, fails right away in an irq handler like DISK_Wait
+int DISK_Drain(DISK *disk) {
+    DISK_Queue *queue = &disk->queue;
+    if (i686_IRQ_InHandler())
+        return DISK_BLOCKING_IN_IRQ_ERROR;
+
+    for (;;) {
+        queue->commandCompleted = false;
+        dispatch(disk, true);
+
+        bool sent = false;
+        for (uint8_t i = 0; i < DISK_MAX_COMMANDS; ++i)
+            if (!queue->commands[i].idle)
+                sent = true;
+
+        // if nothing is with the driver, the dispatch above sent everything there was
+        if (!sent || disk->driver->wait == NULL)
+            return NO_ERROR;
+
+        disk->driver->wait(disk, &queue->commandCompleted);
+    }
+}
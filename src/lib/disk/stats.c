@@ -0,0 +1,195 @@
+#include "disk.h"
+#include <lib/algorithm/math.h>
+#include <lib/errors/errors.h>
+#include <lib/memory/allocator.h>
+#include <lib/memory/memory.h>
+#include <lib/x86/general.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define E9_PORT 0xE9
+
+static const char *g_DirectionNames[DISK_STATS_DIRECTION_COUNT] = {"read", "write", "flush"};
+static const char *g_EventNames[DISK_EVENT_COUNT] = {"irq timeouts", "timeouts", "resets"};
+
+// the dump goes straight to the e9 port, so it doesn't end up on the screen and works in release builds too
+static void e9Write(const char *string) {
+    while (*string)
+        x86_OutByte(E9_PORT, *string++);
+}
+
+static void e9WriteNumber(uint64_t number) {
+    char digits[20];
+    uint8_t count = 0;
+
+    do {
+        digits[count++] = '0' + number % 10;
+        number /= 10;
+    } while (number > 0);
+
+    while (count > 0)
+        x86_OutByte(E9_PORT, digits[--count]);
+}
+
+static void recordLatency(DISK_LatencyHistogram *histogram, uint64_t cycles) {
+    uint8_t bucket = cycles == 0 ? 0 : findHighestSetBit(cycles);
+    if (bucket >= DISK_STATS_LATENCY_BUCKETS)
+        bucket = DISK_STATS_LATENCY_BUCKETS - 1;
+
+    ++histogram->count;
+    histogram->totalCycles += cycles;
+    ++histogram->buckets[bucket];
+}
+
+static void dumpHistogram(const char *name, const DISK_LatencyHistogram *histogram) {
+    if (histogram->count == 0)
+        return;
+
+    e9Write("    ");
+    e9Write(name);
+    e9Write(": average ");
+    e9WriteNumber(histogram->totalCycles / histogram->count);
+    e9Write(" cycles\n");
+
+    for (uint8_t bucket = 0; bucket < DISK_STATS_LATENCY_BUCKETS; ++bucket) {
+        if (histogram->buckets[bucket] == 0)
+            continue;
+
+        e9Write("        2^");
+        e9WriteNumber(bucket);
+        e9Write(": ");
+        e9WriteNumber(histogram->buckets[bucket]);
+        e9Write("\n");
+    }
+}
+
+// called once a driver has set up the disk, the disk works without stats too
+void DISK_InitializeStats(DISK *disk) {
+    disk->stats = calloc(1, sizeof(DISK_Stats));
+}
+
+// the record functions can be called from the irq handlers of the drivers, so interrupts are disabled while counting
+void DISK_RecordRequest(DISK *disk, DISK_StatsDirection direction, uint64_t sectors, uint64_t cycles, int status) {
+    if (disk->stats == NULL)
+        return;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+
+    DISK_DirectionStats *stats = &disk->stats->directions[direction];
+    ++stats->requests;
+    if (status == NO_ERROR)
+        stats->sectors += sectors;
+    else
+        ++stats->errors;
+    recordLatency(&stats->requestLatency, cycles);
+
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+void DISK_RecordCommand(DISK *disk, DISK_StatsDirection direction, uint64_t cycles) {
+    if (disk->stats == NULL)
+        return;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    recordLatency(&disk->stats->directions[direction].commandLatency, cycles);
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+void DISK_RecordCopy(DISK *disk, DISK_StatsDirection direction, uint32_t bytes, uint64_t cycles) {
+    if (disk->stats == NULL)
+        return;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    disk->stats->directions[direction].copiedBytes += bytes;
+    disk->stats->directions[direction].copyCycles += cycles;
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+void DISK_RecordPoll(DISK *disk, uint64_t cycles) {
+    if (disk->stats == NULL)
+        return;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    disk->stats->pollCycles += cycles;
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+void DISK_RecordEvent(DISK *disk, DISK_StatsEvent event) {
+    if (disk->stats == NULL)
+        return;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    ++disk->stats->events[event];
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+// copies the stats, so they don't change while being looked at
+int DISK_GetStats(DISK *disk, DISK_Stats *statsOutput) {
+    if (disk == NULL || statsOutput == NULL || disk->stats == NULL)
+        return NULL_ERROR;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    memcpy(statsOutput, disk->stats, sizeof(DISK_Stats));
+    x86_RestoreInterrupts(interruptsEnabled);
+
+    return NO_ERROR;
+}
+
+void DISK_ResetStats(DISK *disk) {
+    if (disk == NULL || disk->stats == NULL)
+        return;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts();
+    memset(disk->stats, 0, sizeof(DISK_Stats));
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+// writes the stats to the e9 port, `index` is only used to tell the disks apart
+void DISK_DumpStats(DISK *disk, uint8_t index) {
+    DISK_Stats stats;
+    if (DISK_GetStats(disk, &stats) != NO_ERROR)
+        return;
+
+    e9Write("disk ");
+    e9WriteNumber(index);
+    e9Write(" (");
+    e9Write(disk->driver->name);
+    e9Write("): ");
+    e9WriteNumber(stats.pollCycles);
+    e9Write(" cycles polling");
+    for (uint8_t event = 0; event < DISK_EVENT_COUNT; ++event) {
+        e9Write(", ");
+        e9WriteNumber(stats.events[event]);
+        e9Write(" ");
+        e9Write(g_EventNames[event]);
+    }
+    e9Write("\n");
+
+    for (uint8_t direction = 0; direction < DISK_STATS_DIRECTION_COUNT; ++direction) {
+        DISK_DirectionStats *directionStats = &stats.directions[direction];
+        if (directionStats->requests == 0)
+            continue;
+
+        e9Write("  ");
+        e9Write(g_DirectionNames[direction]);
+        e9Write(": ");
+        e9WriteNumber(directionStats->requests);
+        e9Write(" requests, ");
+        e9WriteNumber(directionStats->commandLatency.count);
+        e9Write(" commands, ");
+        e9WriteNumber(directionStats->sectors);
+        e9Write(" sectors (");
+        e9WriteNumber(directionStats->sectors * 512);
+        e9Write(" bytes), ");
+        e9WriteNumber(directionStats->errors);
+        e9Write(" errors, ");
+        e9WriteNumber(directionStats->copiedBytes);
+        e9Write(" bytes copied in ");
+        e9WriteNumber(directionStats->copyCycles);
+        e9Write(" cycles\n");
+
+        dumpHistogram("request latency", &directionStats->requestLatency);
+        dumpHistogram("command latency", &directionStats->commandLatency);
+    }
+}
@@ -0,0 +1,676 @@
+#include "virtio.h"
+#include "ata.h"
+#include "disk.h"
+#include <lib/algorithm/math.h>
+#include <lib/errors/errors.h>
+#include <lib/interrupt/irq/irq.h>
+#include <lib/memory/allocator.h>
+#include <lib/memory/memory.h>
+#include <lib/pci/pci.h>
+#include <lib/time/tsc.h>
+#include <lib/x86/general.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// this is the legacy (virtio 0.9.5) interface, qemu's `if=virtio` block device is transitional so it has it
+#define VIRTIO_PCI_VENDOR 0x1AF4
+#define VIRTIO_PCI_DEVICE_BLOCK 0x1001
+#define VIRTIO_PCI_BAR 0 // io space
+
+// registers, relative to the io base
+#define VIRTIO_REGISTER_DEVICE_FEATURES 0x00
+#define VIRTIO_REGISTER_GUEST_FEATURES 0x04
+#define VIRTIO_REGISTER_QUEUE_ADDRESS 0x08
+#define VIRTIO_REGISTER_QUEUE_SIZE 0x0C
+#define VIRTIO_REGISTER_QUEUE_SELECT 0x0E
+#define VIRTIO_REGISTER_QUEUE_NOTIFY 0x10
+#define VIRTIO_REGISTER_DEVICE_STATUS 0x12
+#define VIRTIO_REGISTER_ISR_STATUS 0x13
+#define VIRTIO_REGISTER_BLOCK_CAPACITY 0x14 // the device config, only at this offset without msi-x
+#define VIRTIO_REGISTER_BLOCK_SEGMENT_MAX 0x20
+
+// device status
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER 0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED 0x80
+
+// features
+#define VIRTIO_BLOCK_FEATURE_SEGMENT_MAX 0x00000004
+#define VIRTIO_BLOCK_FEATURE_READ_ONLY 0x00000020
+#define VIRTIO_BLOCK_FEATURE_FLUSH 0x00000200
+
+// request types
+#define VIRTIO_BLOCK_TYPE_IN 0
+#define VIRTIO_BLOCK_TYPE_OUT 1
+#define VIRTIO_BLOCK_TYPE_FLUSH 4
+
+// request status, written by the device
+#define VIRTIO_BLOCK_STATUS_OK 0
+#define VIRTIO_BLOCK_STATUS_IO_ERROR 1
+#define VIRTIO_BLOCK_STATUS_UNSUPPORTED 2
+
+// descriptor flags
+#define VIRTIO_DESCRIPTOR_NEXT 0x1
+#define VIRTIO_DESCRIPTOR_WRITE 0x2 // the device writes to the buffer
+
+#define VIRTIO_AVAILABLE_NO_INTERRUPT 0x1 // we poll the used ring, the device doesn't have to interrupt
+#define VIRTIO_USED_NO_NOTIFY 0x1         // the device is already processing the queue, no need to notify it
+
+#define VIRTIO_QUEUE_ALIGNMENT 0x1000 // the used ring starts on the next page
+#define VIRTIO_MAX_COMMANDS 32
+#define VIRTIO_MAX_SEGMENTS 8                                       // data descriptors per command
+#define VIRTIO_DESCRIPTORS_PER_COMMAND (VIRTIO_MAX_SEGMENTS + 2)    // with the header and status descriptors
+#define VIRTIO_SEGMENT_MAX_SECTORS 0x2000                           // 4 MiB
+
+// other
+#define DEFAULT_VIRTIO_TIMEOUT_MS 30000 // 30 seconds
+#define VIRTIO_IRQ_TIMEOUT_MS 100       // if the device hasn't interrupted by then, we fall back to polling
+
+// what a request does besides transferring its sectors, each is cleared once it has been issued
+#define VIRTIO_REQUEST_PRE_FLUSH 0x01  // flush before the first command
+#define VIRTIO_REQUEST_POST_FLUSH 0x02 // flush after the last command, there is no fua so this is used for it
+
+typedef volatile struct {
+    uint64_t address;
+    uint32_t length;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) VIRTIO_Descriptor;
+
+typedef volatile struct {
+    uint16_t flags;
+    uint16_t index;
+    uint16_t ring[];
+} __attribute__((packed)) VIRTIO_AvailableRing;
+
+typedef volatile struct {
+    uint32_t id; // head descriptor of the chain
+    uint32_t length;
+} __attribute__((packed)) VIRTIO_UsedElement;
+
+typedef volatile struct {
+    uint16_t flags;
+    uint16_t index;
+    VIRTIO_UsedElement ring[];
+} __attribute__((packed)) VIRTIO_UsedRing;
+
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) VIRTIO_BlockRequestHeader;
+
+// device readable header and device writable status of a command
+typedef struct {
+    VIRTIO_BlockRequestHeader header;
+    volatile uint8_t status;
+} VIRTIO_CommandBuffer;
+
+// a read, write or flush waiting for, or being run on, the device
+// a request is split into as many commands as it needs, and they are all put on the queue at once
+typedef struct VIRTIO_Request {
+    bool write;
+    uint8_t flags;
+    uint64_t lba;              // first sector not covered by an issued command yet
+    uint64_t remainingSectors; // sectors not covered by an issued command yet
+    DISK_IoVectorCursor cursor;
+    uint32_t outstandingCommands;
+    bool fullyIssued;
+    volatile bool completed;
+    int status;
+    DISK_Command *command; // set if it came from the scheduler, which is told once it completes
+    struct VIRTIO_Request *next;
+} VIRTIO_Request;
+
+_Static_assert(sizeof(VIRTIO_Request) <= DISK_COMMAND_DRIVER_STORAGE, "VIRTIO_Request has to fit in DISK_Command::driverStorage");
+
+typedef struct {
+    uint16_t ioBase;
+    uint8_t irq;
+    bool usingInterrupts;
+    bool supportsFlush;
+    uint32_t features; // what was negotiated, it's negotiated again after a reset
+    uint64_t sectorCount;
+
+    uint16_t queueSize;
+    void *queueMemory;
+    VIRTIO_Descriptor *descriptors;
+    VIRTIO_AvailableRing *available;
+    VIRTIO_UsedRing *used;
+    uint16_t lastUsedIndex;
+
+    // every command has a fixed chain of VIRTIO_DESCRIPTORS_PER_COMMAND descriptors
+    uint8_t commandCount;
+    uint8_t segmentsPerCommand;
+    uint32_t busyCommands;
+    VIRTIO_CommandBuffer *commandBuffers;
+    VIRTIO_Request *commandRequests[VIRTIO_MAX_COMMANDS];
+
+    VIRTIO_Request *queueHead; // requests with commands left to issue, oldest first
+    VIRTIO_Request *queueTail;
+    VIRTIO_Request *finishedHead; // finished requests from the scheduler, it's told once the queue is in a consistent state again
+    volatile uint64_t lastProgressMs;
+} VIRTIO_Device;
+
+static VIRTIO_Device *g_Device = NULL;
+
+static uint32_t queueBytes(uint16_t queueSize) {
+    uint32_t descriptorsAndAvailable = sizeof(VIRTIO_Descriptor) * queueSize + sizeof(uint16_t) * (3 + queueSize);
+    uint32_t used = sizeof(uint16_t) * 3 + sizeof(VIRTIO_UsedElement) * queueSize;
+
+    return DIV_ROUND_UP(descriptorsAndAvailable, VIRTIO_QUEUE_ALIGNMENT) * VIRTIO_QUEUE_ALIGNMENT + used;
+}
+
+static int findFreeCommand(VIRTIO_Device *device) {
+    for (uint8_t command = 0; command < device->commandCount; ++command)
+        if (!(device->busyCommands & (1u << command)))
+            return command;
+
+    return -1;
+}
+
+static void setDescriptor(VIRTIO_Device *device, uint16_t index, void *address, uint32_t length, uint16_t flags) {
+    device->descriptors[index].address = (uint32_t)address;
+    device->descriptors[index].length = length;
+    device->descriptors[index].flags = flags;
+    device->descriptors[index].next = index + 1;
+}
+
+// builds the descriptor chain of `command` and puts it on the available ring, the device isn't notified yet
+static void queueCommand(VIRTIO_Device *device, uint8_t command, VIRTIO_Request *request, uint32_t type, uint64_t sector, uint32_t *sectorsOutput) {
+    VIRTIO_CommandBuffer *buffer = &device->commandBuffers[command];
+    uint16_t head = command * VIRTIO_DESCRIPTORS_PER_COMMAND;
+    uint16_t descriptor = head;
+    uint32_t sectors = 0;
+
+    buffer->header.type = type;
+    buffer->header.reserved = 0;
+    buffer->header.sector = sector;
+    buffer->status = 0xFF;
+    setDescriptor(device, descriptor++, &buffer->header, sizeof(VIRTIO_BlockRequestHeader), VIRTIO_DESCRIPTOR_NEXT);
+
+    if (type != VIRTIO_BLOCK_TYPE_FLUSH) {
+        uint16_t dataFlags = VIRTIO_DESCRIPTOR_NEXT | (request->write ? 0 : VIRTIO_DESCRIPTOR_WRITE);
+        DISK_IoVectorCursor *cursor = &request->cursor;
+
+        while (sectors < request->remainingSectors && descriptor - head - 1 < device->segmentsPerCommand) {
+            uint32_t take = min(min(request->remainingSectors - sectors, cursor->vector->sectorCount - cursor->sectorOffset), VIRTIO_SEGMENT_MAX_SECTORS);
+
+            if (take > 0)
+                setDescriptor(device, descriptor++, cursor->vector->buffer + cursor->sectorOffset * 512, take * 512, dataFlags);
+
+            sectors += take;
+            cursor->sectorOffset += take;
+            if (cursor->sectorOffset == cursor->vector->sectorCount) {
+                ++cursor->vector;
+                cursor->sectorOffset = 0;
+            }
+        }
+    }
+
+    setDescriptor(device, descriptor, (void *)&buffer->status, sizeof(uint8_t), VIRTIO_DESCRIPTOR_WRITE);
+
+    device->busyCommands |= 1u << command;
+    device->commandRequests[command] = request;
+    ++request->outstandingCommands;
+
+    device->available->ring[device->available->index % device->queueSize] = head;
+    ++device->available->index; // volatile, so the chain is written before the device can see it
+
+    if (sectorsOutput != NULL)
+        *sectorsOutput = sectors;
+}
+
+// returns false if the device can't flush, in which case nothing is queued
+static bool queueFlush(VIRTIO_Device *device, uint8_t command, VIRTIO_Request *request) {
+    if (!device->supportsFlush)
+        return false;
+
+    queueCommand(device, command, request, VIRTIO_BLOCK_TYPE_FLUSH, 0, NULL);
+    return true;
+}
+
+static void finishRequest(VIRTIO_Device *device, VIRTIO_Request *request) {
+    request->completed = true;
+
+    if (request->command != NULL) {
+        request->next = device->finishedHead;
+        device->finishedHead = request;
+    }
+}
+
+// the scheduler may submit new requests from here, so this is only called once the device is done issuing or completing
+static void reportFinishedRequests(VIRTIO_Device *device) {
+    while (device->finishedHead != NULL) {
+        VIRTIO_Request *request = device->finishedHead;
+        device->finishedHead = request->next;
+
+        DISK_CompleteCommand(request->command, request->status);
+    }
+}
+
+// puts commands for the queued requests on the available ring until it runs out of commands, then notifies the device once
+// must be called with interrupts disabled
+static void issueCommands(VIRTIO_Device *device) {
+    uint16_t startIndex = device->available->index;
+
+    while (device->queueHead != NULL) {
+        VIRTIO_Request *request = device->queueHead;
+
+        // a flush only covers writes that have completed, so it waits for everything before it
+        if (request->flags & VIRTIO_REQUEST_PRE_FLUSH) {
+            if (device->busyCommands != 0)
+                break;
+
+            request->flags &= ~VIRTIO_REQUEST_PRE_FLUSH;
+            if (queueFlush(device, 0, request))
+                break;
+            continue;
+        }
+
+        if (request->remainingSectors > 0) {
+            int command = findFreeCommand(device);
+            if (command < 0)
+                break;
+
+            if (request->lba + request->remainingSectors > device->sectorCount) {
+                request->status = OUT_OF_BOUNDS_ERROR;
+                request->remainingSectors = 0;
+                request->flags = 0;
+                continue;
+            }
+
+            uint32_t sectors;
+            queueCommand(device, command, request, request->write ? VIRTIO_BLOCK_TYPE_OUT : VIRTIO_BLOCK_TYPE_IN, request->lba, &sectors);
+            request->lba += sectors;
+            request->remainingSectors -= sectors;
+            continue;
+        }
+
+        if (request->flags & VIRTIO_REQUEST_POST_FLUSH) {
+            if (device->busyCommands != 0)
+                break;
+
+            request->flags &= ~VIRTIO_REQUEST_POST_FLUSH;
+            if (queueFlush(device, 0, request))
+                break;
+            continue;
+        }
+
+        // everything has been issued, the request is done once its last command completes
+        device->queueHead = request->next;
+        if (device->queueHead == NULL)
+            device->queueTail = NULL;
+
+        request->fullyIssued = true;
+        if (request->outstandingCommands == 0)
+            finishRequest(device, request);
+    }
+
+    if (device->available->index != startIndex) {
+        device->lastProgressMs = TSC_GetTimeMs();
+        if (!(device->used->flags & VIRTIO_USED_NO_NOTIFY))
+            x86_OutWord(device->ioBase + VIRTIO_REGISTER_QUEUE_NOTIFY, 0);
+    }
+}
+
+static void completeCommand(VIRTIO_Device *device, uint8_t command) {
+    VIRTIO_Request *request = device->commandRequests[command];
+    uint8_t status = device->commandBuffers[command].status;
+
+    device->commandRequests[command] = NULL;
+    device->busyCommands &= ~(1u << command);
+
+    // nothing more of a failed request is issued, the first error is the one reported
+    if (status != VIRTIO_BLOCK_STATUS_OK) {
+        if (request->status == NO_ERROR)
+            request->status = status == VIRTIO_BLOCK_STATUS_UNSUPPORTED ? VIRTIO_UNSUPPORTED_ERROR : VIRTIO_IO_ERROR;
+        request->remainingSectors = 0;
+        request->flags = 0;
+    }
+
+    if (--request->outstandingCommands == 0 && request->fullyIssued)
+        finishRequest(device, request);
+}
+
+// completes the commands on the used ring and issues new ones, called from the irq handler, or when polling, with interrupts disabled
+static void serviceDevice(VIRTIO_Device *device) {
+    while (device->lastUsedIndex != device->used->index) {
+        uint32_t head = device->used->ring[device->lastUsedIndex % device->queueSize].id;
+        ++device->lastUsedIndex;
+
+        device->lastProgressMs = TSC_GetTimeMs();
+        completeCommand(device, head / VIRTIO_DESCRIPTORS_PER_COMMAND);
+    }
+
+    issueCommands(device);
+    reportFinishedRequests(device);
+}
+
+// resetting the device is the only way to take commands back from it, afterwards it doesn't touch the queue or their buffers anymore
+// the queue is emptied and handed to the device again, the same way VIRTIO_Initialize does it
+static void resetDevice(VIRTIO_Device *device) {
+    x86_OutByte(device->ioBase + VIRTIO_REGISTER_DEVICE_STATUS, 0);
+    x86_OutByte(device->ioBase + VIRTIO_REGISTER_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    x86_OutByte(device->ioBase + VIRTIO_REGISTER_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    x86_OutDword(device->ioBase + VIRTIO_REGISTER_GUEST_FEATURES, device->features);
+
+    uint16_t availableFlags = device->available->flags;
+    memset(device->queueMemory, 0, queueBytes(device->queueSize));
+    device->available->flags = availableFlags;
+    device->lastUsedIndex = 0;
+
+    x86_OutWord(device->ioBase + VIRTIO_REGISTER_QUEUE_SELECT, 0);
+    x86_OutDword(device->ioBase + VIRTIO_REGISTER_QUEUE_ADDRESS, (uint32_t)device->queueMemory / VIRTIO_QUEUE_ALIGNMENT);
+    x86_OutByte(device->ioBase + VIRTIO_REGISTER_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+}
+
+// fails every request, the device is reset first so none of the commands it still has can complete (or write to a buffer) later
+static void failRequests(VIRTIO_Device *device, int status) {
+    resetDevice(device);
+
+    for (uint8_t command = 0; command < VIRTIO_MAX_COMMANDS; ++command) {
+        VIRTIO_Request *request = device->commandRequests[command];
+        if (request == NULL)
+            continue;
+
+        device->commandRequests[command] = NULL;
+        request->status = status;
+        request->remainingSectors = 0;
+        request->flags = 0;
+        if (--request->outstandingCommands == 0 && request->fullyIssued)
+            finishRequest(device, request);
+    }
+    device->busyCommands = 0;
+
+    // the queued ones are finished by issueCommands, now that there is nothing left to issue for them
+    for (VIRTIO_Request *request = device->queueHead; request != NULL; request = request->next) {
+        request->status = status;
+        request->remainingSectors = 0;
+        request->flags = 0;
+    }
+
+    device->lastProgressMs = TSC_GetTimeMs();
+    issueCommands(device);
+    reportFinishedRequests(device);
+}
+
+static void irqHandler(Registers *registers) {
+    // reading the isr status acknowledges the interrupt
+    if (g_Device == NULL || !(x86_InByte(g_Device->ioBase + VIRTIO_REGISTER_ISR_STATUS) & 0x1))
+        return;
+
+    serviceDevice(g_Device);
+}
+
+static void submitRequest(VIRTIO_Device *device, VIRTIO_Request *request) {
+    request->next = NULL;
+    request->outstandingCommands = 0;
+    request->fullyIssued = false;
+    request->completed = false;
+    request->status = NO_ERROR;
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // the irq handler touches the queue too
+
+    if (device->queueTail == NULL)
+        device->queueHead = request;
+    else
+        device->queueTail->next = request;
+    device->queueTail = request;
+
+    issueCommands(device);
+    reportFinishedRequests(device);
+
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+// halts the cpu until `*completed` is set by a request on the device completing, the irq handler does the work
+// the used ring is polled from here instead if interrupts aren't used, or if the device hasn't made progress for VIRTIO_IRQ_TIMEOUT_MS
+// the timeouts are measured with the tsc, the pit doesn't tick while interrupts are disabled
+static void waitUntilCompleted(VIRTIO_Device *device, volatile bool *completed) {
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // so the irq can't arrive between checking the request and halting
+    bool canHalt = device->usingInterrupts && interruptsEnabled;
+
+    while (!*completed) {
+        uint64_t idleMs = TSC_GetTimeMs() - device->lastProgressMs;
+
+        if (idleMs >= DEFAULT_VIRTIO_TIMEOUT_MS && device->busyCommands != 0) {
+            failRequests(device, TIMEOUT_ERROR);
+        } else if (!canHalt || idleMs >= VIRTIO_IRQ_TIMEOUT_MS) {
+            serviceDevice(device);
+
+            // the caller had interrupts enabled, so the timer (and everything else) shouldn't have to wait for the device
+            if (interruptsEnabled)
+                x86_AllowInterrupts();
+        } else {
+            x86_EnableInterruptsAndHalt();
+            x86_DisableInterrupts();
+        }
+    }
+
+    x86_RestoreInterrupts(interruptsEnabled);
+}
+
+static int runRequest(VIRTIO_Request *request, DISK *disk) {
+    VIRTIO_Device *device = (VIRTIO_Device *)disk->driverData;
+    if (device == NULL)
+        return NULL_ERROR;
+
+    submitRequest(device, request);
+    waitUntilCompleted(device, &request->completed);
+
+    return request->status;
+}
+
+// maps DISK_WRITE_... to what the request has to do
+static uint8_t writeRequestFlags(uint8_t flags) {
+    uint8_t requestFlags = 0;
+
+    if (flags & DISK_WRITE_BARRIER)
+        requestFlags |= VIRTIO_REQUEST_PRE_FLUSH;
+    if (flags & DISK_WRITE_FUA)
+        requestFlags |= VIRTIO_REQUEST_POST_FLUSH;
+
+    return requestFlags;
+}
+
+static int transferVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk, bool write, uint8_t requestFlags) {
+    VIRTIO_Request request = {
+        .write = write,
+        .flags = requestFlags,
+        .lba = lba,
+        .remainingSectors = 0,
+        .cursor = {.vector = vectors, .sectorOffset = 0},
+    };
+    for (uint32_t i = 0; i < vectorCount; ++i)
+        request.remainingSectors += vectors[i].sectorCount;
+
+    return runRequest(&request, disk);
+}
+
+int VIRTIO_ReadVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk) {
+    return transferVectored(lba, vectors, vectorCount, disk, false, 0);
+}
+
+// the data may stay in the host's cache, unless DISK_WRITE_FUA is passed
+int VIRTIO_WriteVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags, DISK *disk) {
+    return transferVectored(lba, vectors, vectorCount, disk, true, writeRequestFlags(flags));
+}
+
+int VIRTIO_Flush(DISK *disk) {
+    VIRTIO_Request request = {
+        .write = false,
+        .flags = VIRTIO_REQUEST_POST_FLUSH,
+        .remainingSectors = 0,
+    };
+
+    return runRequest(&request, disk);
+}
+
+// queues the command on the device and returns, the request lives in the command until it completes
+int VIRTIO_Submit(DISK_Command *command) {
+    VIRTIO_Device *device = (VIRTIO_Device *)command->disk->driverData;
+    if (device == NULL)
+        return NULL_ERROR;
+
+    VIRTIO_Request *request = (VIRTIO_Request *)command->driverStorage;
+    *request = (VIRTIO_Request){
+        .write = command->write,
+        .flags = command->write ? writeRequestFlags(command->flags) : 0,
+        .lba = command->lba,
+        .remainingSectors = command->sectorCount,
+        .cursor = {.vector = command->vectors, .sectorOffset = 0},
+        .command = command,
+    };
+
+    submitRequest(device, request);
+    return NO_ERROR;
+}
+
+void VIRTIO_Wait(DISK *disk, volatile bool *completed) {
+    VIRTIO_Device *device = (VIRTIO_Device *)disk->driverData;
+    if (device != NULL)
+        waitUntilCompleted(device, completed);
+}
+
+static void freeDevice(VIRTIO_Device *device) {
+    free(device->queueMemory);
+    free(device->commandBuffers);
+    free(device);
+}
+
+// resets the device, which stops it from using the queue, the bootloader has to do this before the kernel reuses that memory
+void VIRTIO_DeInitialize(DISK *disk) {
+    VIRTIO_Device *device = (VIRTIO_Device *)disk->driverData;
+    if (device == NULL)
+        return;
+
+    x86_OutByte(device->ioBase + VIRTIO_REGISTER_DEVICE_STATUS, 0);
+
+    if (g_Device == device)
+        g_Device = NULL;
+    freeDevice(device);
+    disk->driverData = NULL;
+}
+
+// sets up the queue and the command buffers, the features have already been negotiated
+static int initializeQueue(VIRTIO_Device *device, uint32_t features) {
+    x86_OutWord(device->ioBase + VIRTIO_REGISTER_QUEUE_SELECT, 0);
+    device->queueSize = x86_InWord(device->ioBase + VIRTIO_REGISTER_QUEUE_SIZE);
+    if (device->queueSize < VIRTIO_DESCRIPTORS_PER_COMMAND)
+        return VIRTIO_QUEUE_UNAVAILABLE_ERROR;
+
+    uint32_t bytes = queueBytes(device->queueSize);
+    device->queueMemory = mallocPageAligned(bytes);
+    device->commandBuffers = malloc(VIRTIO_MAX_COMMANDS * sizeof(VIRTIO_CommandBuffer));
+    if (device->queueMemory == NULL || device->commandBuffers == NULL)
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+    memset(device->queueMemory, 0, bytes);
+
+    device->descriptors = (VIRTIO_Descriptor *)device->queueMemory;
+    device->available = (VIRTIO_AvailableRing *)((uint8_t *)device->queueMemory + sizeof(VIRTIO_Descriptor) * device->queueSize);
+    device->used = (VIRTIO_UsedRing *)((uint8_t *)device->queueMemory + bytes - (sizeof(uint16_t) * 3 + sizeof(VIRTIO_UsedElement) * device->queueSize));
+    device->lastUsedIndex = 0;
+
+    device->commandCount = min(VIRTIO_MAX_COMMANDS, device->queueSize / VIRTIO_DESCRIPTORS_PER_COMMAND);
+    device->segmentsPerCommand = VIRTIO_MAX_SEGMENTS;
+    if (features & VIRTIO_BLOCK_FEATURE_SEGMENT_MAX) {
+        // the header and status descriptors don't count as segments
+        uint32_t segmentMax = x86_InDword(device->ioBase + VIRTIO_REGISTER_BLOCK_SEGMENT_MAX);
+        if (segmentMax > 0)
+            device->segmentsPerCommand = min(VIRTIO_MAX_SEGMENTS, segmentMax);
+    }
+
+    x86_OutDword(device->ioBase + VIRTIO_REGISTER_QUEUE_ADDRESS, (uint32_t)device->queueMemory / VIRTIO_QUEUE_ALIGNMENT);
+    return NO_ERROR;
+}
+
+// sets up the first virtio block device, returns PCI_DEVICE_NOT_FOUND_ERROR if there is none
+// !!! YOU ARE RESPONSIBLE FOR FREEING EVERY DISK IN `disksOutput` WITH `DISK_DeInitialize` !!!
+int VIRTIO_Initialize(DISK *disksOutput, uint8_t maxDisks, uint8_t *diskCountOutput) {
+    int status;
+    PCI_Device pciDevice;
+
+    *diskCountOutput = 0;
+    if ((status = PCI_FindDeviceById(VIRTIO_PCI_VENDOR, VIRTIO_PCI_DEVICE_BLOCK, &pciDevice)) != NO_ERROR)
+        return status;
+    if (maxDisks == 0)
+        return NO_ERROR;
+
+    uint32_t bar = PCI_GetBar(&pciDevice, VIRTIO_PCI_BAR);
+    if (!(bar & PCI_BAR_IO_SPACE))
+        return VIRTIO_UNSUPPORTED_ERROR;
+
+    PCI_EnableDevice(&pciDevice, PCI_COMMAND_IO_SPACE | PCI_COMMAND_BUS_MASTER);
+
+    VIRTIO_Device *device = calloc(1, sizeof(VIRTIO_Device));
+    if (device == NULL)
+        return FAILED_TO_ALLOCATE_MEMORY_ERROR;
+    device->ioBase = bar & ~PCI_BAR_IO_SPACE;
+    device->irq = pciDevice.interruptLine;
+
+    // reset, then tell the device we found it and know how to drive it
+    x86_OutByte(device->ioBase + VIRTIO_REGISTER_DEVICE_STATUS, 0);
+    x86_OutByte(device->ioBase + VIRTIO_REGISTER_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    x86_OutByte(device->ioBase + VIRTIO_REGISTER_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    uint32_t features = x86_InDword(device->ioBase + VIRTIO_REGISTER_DEVICE_FEATURES) & (VIRTIO_BLOCK_FEATURE_SEGMENT_MAX | VIRTIO_BLOCK_FEATURE_FLUSH);
+    x86_OutDword(device->ioBase + VIRTIO_REGISTER_GUEST_FEATURES, features);
+    device->features = features;
+    device->supportsFlush = features & VIRTIO_BLOCK_FEATURE_FLUSH;
+
+    // the capacity is always in 512 byte sectors
+    device->sectorCount = x86_InDword(device->ioBase + VIRTIO_REGISTER_BLOCK_CAPACITY) | ((uint64_t)x86_InDword(device->ioBase + VIRTIO_REGISTER_BLOCK_CAPACITY + 4) << 32);
+
+    if ((status = initializeQueue(device, features)) != NO_ERROR) {
+        x86_OutByte(device->ioBase + VIRTIO_REGISTER_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        freeDevice(device);
+        return status;
+    }
+
+    // interrupts can only be used if the irqs have been set up (they aren't in the bootloader)
+    const PICDriver *picDriver = i686_IRQ_GetDriver();
+    device->usingInterrupts = picDriver != NULL && device->irq < 16;
+    if (device->usingInterrupts) {
+        i686_IRQ_RegisterHandler(device->irq, irqHandler);
+        picDriver->unmask(device->irq);
+    } else {
+        device->available->flags = VIRTIO_AVAILABLE_NO_INTERRUPT;
+    }
+
+    x86_OutByte(device->ioBase + VIRTIO_REGISTER_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+    g_Device = device;
+
+    DISK *disk = &disksOutput[0];
+    disk->driver = VIRTIO_GetDriver();
+    disk->driverData = device;
+    disk->channel = 0;
+    disk->isMaster = true;
+    disk->cylinders = 0;
+    disk->sectors = 0;
+    disk->heads = 0;
+    disk->supports48BitLba = true;
+    disk->sectorsPerBlock = 1;
+    disk->ataData = NULL;
+    disk->stats = NULL;
+    disk->queue.commands = NULL;
+
+    *diskCountOutput = 1;
+    return NO_ERROR;
+}
+
+static const DISK_Driver g_VirtioDriver = {
+    .name = "virtio",
+    .readVectored = VIRTIO_ReadVectored,
+    .writeVectored = VIRTIO_WriteVectored,
+    .flush = VIRTIO_Flush,
+    .submit = VIRTIO_Submit,
+    .wait = VIRTIO_Wait,
+    .deinitialize = VIRTIO_DeInitialize,
+};
+
+const DISK_Driver *VIRTIO_GetDriver() {
+    return &g_VirtioDriver;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "disk.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+int VIRTIO_Initialize(DISK *disksOutput, uint8_t maxDisks, uint8_t *diskCountOutput);
+void VIRTIO_DeInitialize(DISK *disk);
+int VIRTIO_ReadVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, DISK *disk);
+int VIRTIO_WriteVectored(uint64_t lba, const DISK_IoVector *vectors, uint32_t vectorCount, uint8_t flags, DISK *disk);
+int VIRTIO_Flush(DISK *disk);
+int VIRTIO_Submit(DISK_Command *command);
+void VIRTIO_Wait(DISK *disk, volatile bool *completed);
+const DISK_Driver *VIRTIO_GetDriver();
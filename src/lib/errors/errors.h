@@ -21,6 +21,7 @@ Which functions don't need to return errors?
 #define DISK_WRITE_ERROR 0x103
 #define DISK_WRITE_RETRIES_EXHAUSTED_ERROR 0x104
 #define DISK_NOT_ENOUGH_SECTORS_WARNING 0x105
+#define DISK_BLOCKING_IN_IRQ_ERROR 0x106
 #define ATA_ERROR 0x110
 #define ATA_DRIVE_FAULT_ERROR 0x111
 #define ATA_LBA_TOO_LARGE_28BIT_ERROR 0x112
@@ -35,6 +36,15 @@ Which functions don't need to return errors?
 #define ATA_BAD_BLOCK_DETECTED_ERROR 0x11B
 #define ATA_DRIVE_DOESNT_EXIST 0x11C
 #define ATA_UNSUPPORTED_DRIVE 0x11D
+#define AHCI_ERROR 0x120
+#define AHCI_TASK_FILE_ERROR 0x121
+#define AHCI_HOST_BUS_ERROR 0x122
+#define AHCI_INTERFACE_ERROR 0x123
+#define AHCI_PORT_HUNG_ERROR 0x124
+#define VIRTIO_ERROR 0x128
+#define VIRTIO_IO_ERROR 0x129
+#define VIRTIO_UNSUPPORTED_ERROR 0x12A
+#define VIRTIO_QUEUE_UNAVAILABLE_ERROR 0x12B
 
 // filesystem errors
 #define FILESYSTEM_ERROR 0x200
@@ -59,6 +69,8 @@ Which functions don't need to return errors?
 #define FAILED_TO_DETECT_MEMORY_ERROR 0x408
 #define DMA_CHANNEL_IN_USE_ERROR 0x409
 #define DMA_SETUP_FAILED_ERROR 0x40A
+#define MTRR_NOT_SUPPORTED_ERROR 0x40B
+#define MTRR_NO_FREE_RANGE_ERROR 0x40C
 
 // elf errors
 #define ELF_ERROR 0x800
@@ -89,6 +101,8 @@ Which functions don't need to return errors?
 #define VBE_FAILED_TO_FIND_SUITABLE_MODE_ERROR 0x2005
 #define FONT_ERROR 0x2006
 #define FONT_NOT_FOUND_ERROR 0x2007
+#define GRAPHICS_UNSUPPORTED_PIXEL_FORMAT_ERROR 0x2008
+#define FONT_INVALID_FILE_ERROR 0x2009
 
 // periphiral errors (usb, ps2 etc...)
 #define PERIPHIRAL_ERROR 0x4000
@@ -96,6 +110,7 @@ Which functions don't need to return errors?
 #define PS2_SELF_TEST_FAILED 0x4002
 #define PS2_INTERFACE_TESTS_FAILED 0x4003
 #define NO_PIC_DRIVER_FOUND 0x4004
+#define PCI_DEVICE_NOT_FOUND_ERROR 0x4005
 
 // time errors
 #define TIME_ERROR 0x8000
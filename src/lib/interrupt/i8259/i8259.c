@@ -9,6 +9,8 @@
 
 #define PROBE_TEST_MASK 0x1337 // leet
 
+#define PIC_CASCADE_IRQ 2
+
 enum {
     PIC_ICW1_ICW4 = 0x01,
     PIC_ICW1_SINGLE = 0x02,
@@ -102,7 +104,13 @@ void i8259_Mask(int irq) {
 }
 
 void i8259_Unmask(int irq) {
-    i8259_SetMask(g_PicMask & ~(1 << irq));
+    picmask_t newMask = g_PicMask & ~(1 << irq);
+
+    // irqs on the second pic are delivered through the cascade line, so that needs to be unmasked as well
+    if (irq >= 8)
+        newMask &= ~(1 << PIC_CASCADE_IRQ);
+
+    i8259_SetMask(newMask);
 }
 
 // irr = in request register
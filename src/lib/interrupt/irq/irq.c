@@ -10,14 +10,46 @@
 
 IRQHandler g_IRQHandlers[16] = {NULL};
 static const PICDriver *g_Driver = NULL;
+static volatile uint8_t g_HandlerDepth = 0;
+static volatile IRQDeferredHandler g_DeferredHandlers[IRQ_MAX_DEFERRED_HANDLERS];
+static volatile bool g_RunningDeferredHandlers = false;
+
+// the deferred handlers run after the irq has been acknowledged, with interrupts enabled, so nothing is lost while they take their time
+// they only run when the irq didn't interrupt another handler or the deferred handlers themselves, so they never run twice at once
+// and since irqs only come in while interrupts are enabled, they never run in the middle of a section that disabled them
+static void runDeferredHandlers() {
+    if (g_HandlerDepth > 0 || g_RunningDeferredHandlers)
+        return;
+
+    g_RunningDeferredHandlers = true;
+    x86_EnableInterrupts();
+
+    for (uint8_t i = 0; i < IRQ_MAX_DEFERRED_HANDLERS; ++i) {
+        IRQDeferredHandler handler = g_DeferredHandlers[i];
+        if (handler != NULL)
+            handler();
+    }
+
+    x86_DisableInterrupts();
+    g_RunningDeferredHandlers = false;
+}
 
 void i686_IRQ_Handler(Registers *registers) {
     int irq = registers->interrupt - PIC_REMAP_OFFSET;
 
+    ++g_HandlerDepth;
     if (g_IRQHandlers[irq] != NULL)
         g_IRQHandlers[irq](registers);
+    --g_HandlerDepth;
 
     g_Driver->sendEndOfInterrupt(irq);
+
+    runDeferredHandlers();
+}
+
+// true while an irq handler is running, for work that should rather be done once it has returned
+bool i686_IRQ_InHandler() {
+    return g_HandlerDepth > 0;
 }
 
 int i686_IRQ_Initialize() {
@@ -42,6 +74,25 @@ int i686_IRQ_Initialize() {
     return NO_ERROR;
 }
 
+// every deferred handler runs after every irq, so each has to check itself whether it has anything to do
+// fails once IRQ_MAX_DEFERRED_HANDLERS are added
+int i686_IRQ_AddDeferredHandler(IRQDeferredHandler handler) {
+    for (uint8_t i = 0; i < IRQ_MAX_DEFERRED_HANDLERS; ++i) {
+        if (g_DeferredHandlers[i] == NULL) {
+            g_DeferredHandlers[i] = handler;
+            return NO_ERROR;
+        }
+    }
+
+    return OUT_OF_BOUNDS_ERROR;
+}
+
+void i686_IRQ_RemoveDeferredHandler(IRQDeferredHandler handler) {
+    for (uint8_t i = 0; i < IRQ_MAX_DEFERRED_HANDLERS; ++i)
+        if (g_DeferredHandlers[i] == handler)
+            g_DeferredHandlers[i] = NULL;
+}
+
 const PICDriver *i686_IRQ_GetDriver() {
     return g_Driver;
 }
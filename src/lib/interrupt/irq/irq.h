@@ -2,10 +2,18 @@
 
 #include <lib/interrupt/isr/isr.h>
 #include <lib/interrupt/pic/pic.h>
+#include <stdbool.h>
+
+#define IRQ_MAX_DEFERRED_HANDLERS 4
 
 typedef void (*IRQHandler)(Registers *registers);
+// called with interrupts enabled once an irq handler has returned, for work that is too slow for the handler itself
+typedef void (*IRQDeferredHandler)();
 
 int i686_IRQ_Initialize();
 void i686_IRQ_RegisterHandler(int irq, IRQHandler handler);
 void i686_IRQ_UnregisterHandler(int irq);
 const PICDriver *i686_IRQ_GetDriver();
+bool i686_IRQ_InHandler();
+int i686_IRQ_AddDeferredHandler(IRQDeferredHandler handler);
+void i686_IRQ_RemoveDeferredHandler(IRQDeferredHandler handler);
@@ -0,0 +1,130 @@
+#include "pci.h"
+#include <lib/errors/errors.h>
+#include <lib/x86/general.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// configuration mechanism #1
+#define PCI_PORT_CONFIG_ADDRESS 0xCF8
+#define PCI_PORT_CONFIG_DATA 0xCFC
+#define PCI_CONFIG_ENABLE 0x80000000
+
+#define PCI_MAX_BUSES 256
+#define PCI_MAX_DEVICES 32
+#define PCI_MAX_FUNCTIONS 8
+
+#define PCI_HEADER_TYPE_MULTIFUNCTION 0x80
+#define PCI_VENDOR_NONE 0xFFFF // nothing is plugged into the slot
+
+typedef bool (*DeviceMatcher)(const PCI_Device *device, uint32_t first, uint32_t second);
+
+static uint32_t configAddress(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
+    return PCI_CONFIG_ENABLE | ((uint32_t)bus << 16) | ((uint32_t)(device & 0x1F) << 11) | ((uint32_t)(function & 0x07) << 8) | (offset & 0xFC);
+}
+
+uint32_t PCI_ConfigReadDword(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
+    x86_OutDword(PCI_PORT_CONFIG_ADDRESS, configAddress(bus, device, function, offset));
+    return x86_InDword(PCI_PORT_CONFIG_DATA);
+}
+
+uint16_t PCI_ConfigReadWord(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
+    return PCI_ConfigReadDword(bus, device, function, offset) >> ((offset & 2) * 8);
+}
+
+uint8_t PCI_ConfigReadByte(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
+    return PCI_ConfigReadDword(bus, device, function, offset) >> ((offset & 3) * 8);
+}
+
+void PCI_ConfigWriteDword(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint32_t value) {
+    x86_OutDword(PCI_PORT_CONFIG_ADDRESS, configAddress(bus, device, function, offset));
+    x86_OutDword(PCI_PORT_CONFIG_DATA, value);
+}
+
+// the other half of the dword is read back first, so it isn't overwritten
+void PCI_ConfigWriteWord(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint16_t value) {
+    uint32_t dword = PCI_ConfigReadDword(bus, device, function, offset);
+    uint8_t shift = (offset & 2) * 8;
+
+    dword = (dword & ~(0xFFFF << shift)) | ((uint32_t)value << shift);
+    PCI_ConfigWriteDword(bus, device, function, offset, dword);
+}
+
+static void readDevice(uint8_t bus, uint8_t device, uint8_t function, PCI_Device *deviceOutput) {
+    uint32_t id = PCI_ConfigReadDword(bus, device, function, PCI_CONFIG_VENDOR_ID);
+    uint32_t class = PCI_ConfigReadDword(bus, device, function, PCI_CONFIG_REVISION_ID);
+
+    deviceOutput->bus = bus;
+    deviceOutput->device = device;
+    deviceOutput->function = function;
+    deviceOutput->vendorId = id & 0xFFFF;
+    deviceOutput->deviceId = id >> 16;
+    deviceOutput->progIf = (class >> 8) & 0xFF;
+    deviceOutput->subclass = (class >> 16) & 0xFF;
+    deviceOutput->classCode = class >> 24;
+    deviceOutput->interruptLine = PCI_ConfigReadByte(bus, device, function, PCI_CONFIG_INTERRUPT_LINE);
+}
+
+// brute force scan of every bus, returns the first device `matcher` accepts
+static int findDevice(DeviceMatcher matcher, uint32_t first, uint32_t second, PCI_Device *deviceOutput) {
+    PCI_Device device;
+
+    for (uint16_t bus = 0; bus < PCI_MAX_BUSES; ++bus) {
+        for (uint8_t slot = 0; slot < PCI_MAX_DEVICES; ++slot) {
+            if (PCI_ConfigReadWord(bus, slot, 0, PCI_CONFIG_VENDOR_ID) == PCI_VENDOR_NONE)
+                continue;
+
+            // only multifunction devices have anything past function 0
+            uint8_t functionCount = 1;
+            if (PCI_ConfigReadByte(bus, slot, 0, PCI_CONFIG_HEADER_TYPE) & PCI_HEADER_TYPE_MULTIFUNCTION)
+                functionCount = PCI_MAX_FUNCTIONS;
+
+            for (uint8_t function = 0; function < functionCount; ++function) {
+                if (PCI_ConfigReadWord(bus, slot, function, PCI_CONFIG_VENDOR_ID) == PCI_VENDOR_NONE)
+                    continue;
+
+                readDevice(bus, slot, function, &device);
+                if (!matcher(&device, first, second))
+                    continue;
+
+                *deviceOutput = device;
+                return NO_ERROR;
+            }
+        }
+    }
+
+    return PCI_DEVICE_NOT_FOUND_ERROR;
+}
+
+// `first` is the class code and subclass, `second` is the prog if
+static bool matchClass(const PCI_Device *device, uint32_t first, uint32_t second) {
+    return device->classCode == (first >> 8) && device->subclass == (first & 0xFF) && device->progIf == second;
+}
+
+static bool matchId(const PCI_Device *device, uint32_t first, uint32_t second) {
+    return device->vendorId == first && device->deviceId == second;
+}
+
+int PCI_FindDeviceByClass(uint8_t classCode, uint8_t subclass, uint8_t progIf, PCI_Device *deviceOutput) {
+    if (deviceOutput == NULL)
+        return NULL_ERROR;
+
+    return findDevice(matchClass, ((uint32_t)classCode << 8) | subclass, progIf, deviceOutput);
+}
+
+int PCI_FindDeviceById(uint16_t vendorId, uint16_t deviceId, PCI_Device *deviceOutput) {
+    if (deviceOutput == NULL)
+        return NULL_ERROR;
+
+    return findDevice(matchId, vendorId, deviceId, deviceOutput);
+}
+
+// returns the raw bar, mask off the low bits (PCI_BAR_IO_SPACE etc...) to get the address
+uint32_t PCI_GetBar(const PCI_Device *device, uint8_t index) {
+    return PCI_ConfigReadDword(device->bus, device->device, device->function, PCI_CONFIG_BAR0 + index * 4);
+}
+
+// sets `commandBits` (PCI_COMMAND_...) in the command register
+void PCI_EnableDevice(const PCI_Device *device, uint16_t commandBits) {
+    uint16_t command = PCI_ConfigReadWord(device->bus, device->device, device->function, PCI_CONFIG_COMMAND);
+    PCI_ConfigWriteWord(device->bus, device->device, device->function, PCI_CONFIG_COMMAND, command | commandBits);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// configuration space offsets
+#define PCI_CONFIG_VENDOR_ID 0x00
+#define PCI_CONFIG_DEVICE_ID 0x02
+#define PCI_CONFIG_COMMAND 0x04
+#define PCI_CONFIG_STATUS 0x06
+#define PCI_CONFIG_REVISION_ID 0x08
+#define PCI_CONFIG_PROG_IF 0x09
+#define PCI_CONFIG_SUBCLASS 0x0A
+#define PCI_CONFIG_CLASS 0x0B
+#define PCI_CONFIG_HEADER_TYPE 0x0E
+#define PCI_CONFIG_BAR0 0x10
+#define PCI_CONFIG_SUBSYSTEM_ID 0x2E
+#define PCI_CONFIG_INTERRUPT_LINE 0x3C
+
+// command register bits
+#define PCI_COMMAND_IO_SPACE 0x0001
+#define PCI_COMMAND_MEMORY_SPACE 0x0002
+#define PCI_COMMAND_BUS_MASTER 0x0004
+#define PCI_COMMAND_INTERRUPT_DISABLE 0x0400
+
+// bars with this bit set are in io space, otherwise they are in memory space
+#define PCI_BAR_IO_SPACE 0x1
+
+#define PCI_INTERRUPT_LINE_NONE 0xFF
+
+typedef struct {
+    uint8_t bus;
+    uint8_t device;
+    uint8_t function;
+    uint16_t vendorId;
+    uint16_t deviceId;
+    uint8_t classCode;
+    uint8_t subclass;
+    uint8_t progIf;
+    uint8_t interruptLine; // the pic irq the bios routed the device to, PCI_INTERRUPT_LINE_NONE if none
+} PCI_Device;
+
+uint32_t PCI_ConfigReadDword(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset);
+uint16_t PCI_ConfigReadWord(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset);
+uint8_t PCI_ConfigReadByte(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset);
+void PCI_ConfigWriteDword(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint32_t value);
+void PCI_ConfigWriteWord(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset, uint16_t value);
+
+int PCI_FindDeviceByClass(uint8_t classCode, uint8_t subclass, uint8_t progIf, PCI_Device *deviceOutput);
+int PCI_FindDeviceById(uint16_t vendorId, uint16_t deviceId, PCI_Device *deviceOutput);
+uint32_t PCI_GetBar(const PCI_Device *device, uint8_t index);
+void PCI_EnableDevice(const PCI_Device *device, uint16_t commandBits);
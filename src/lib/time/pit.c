@@ -1,6 +1,8 @@
 #include "pit.h"
+#include <lib/errors/errors.h>
 #include <lib/interrupt/irq/irq.h>
 #include <lib/x86/general.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define PIT_CHANNEL_0_PORT 0x40
@@ -13,6 +15,7 @@
 #define PIT_FREQUENZY_HZ 1193182
 
 volatile uint64_t pitTicks = 0;
+static volatile PIT_TickHandler g_TickHandlers[PIT_MAX_TICK_HANDLERS];
 
 /*
 Command for port 0x43:
@@ -61,6 +64,28 @@ uint64_t PIT_GetTimeMs() {
 
 void irq0Handler() {
     ++pitTicks;
+
+    for (uint8_t i = 0; i < PIT_MAX_TICK_HANDLERS; ++i)
+        if (g_TickHandlers[i] != NULL)
+            g_TickHandlers[i](pitTicks);
+}
+
+// every handler is called on every tick, fails once PIT_MAX_TICK_HANDLERS are added
+int PIT_AddTickHandler(PIT_TickHandler handler) {
+    for (uint8_t i = 0; i < PIT_MAX_TICK_HANDLERS; ++i) {
+        if (g_TickHandlers[i] == NULL) {
+            g_TickHandlers[i] = handler;
+            return NO_ERROR;
+        }
+    }
+
+    return OUT_OF_BOUNDS_ERROR;
+}
+
+void PIT_RemoveTickHandler(PIT_TickHandler handler) {
+    for (uint8_t i = 0; i < PIT_MAX_TICK_HANDLERS; ++i)
+        if (g_TickHandlers[i] == handler)
+            g_TickHandlers[i] = NULL;
 }
 
 void PIT_Initialize() {
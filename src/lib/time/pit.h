@@ -2,6 +2,13 @@
 
 #include <stdint.h>
 
+#define PIT_MAX_TICK_HANDLERS 4
+
+// called from the irq handler on every tick, so keep it short
+typedef void (*PIT_TickHandler)(uint64_t timeMs);
+
 void PIT_Initialize();
+int PIT_AddTickHandler(PIT_TickHandler handler);
+void PIT_RemoveTickHandler(PIT_TickHandler handler);
 void PIT_Delay(uint64_t milliseconds);
 uint64_t PIT_GetTimeMs();
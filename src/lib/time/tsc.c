@@ -0,0 +1,63 @@
+#include "tsc.h"
+#include <lib/x86/general.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PIT_CHANNEL_2_PORT 0x42
+#define PIT_COMMAND_PORT 0x43
+#define PIT_FREQUENZY_HZ 1193182
+
+// bit 0 gates channel 2 of the pit, bit 1 connects it to the speaker and bit 5 is its output
+#define SYSTEM_CONTROL_PORT 0x61
+#define SYSTEM_CONTROL_GATE_2 0x01
+#define SYSTEM_CONTROL_SPEAKER 0x02
+#define SYSTEM_CONTROL_OUTPUT_2 0x20
+
+#define TSC_CALIBRATION_MS 10
+#define TSC_CALIBRATION_MAX_READS 10000000 // in case channel 2 never counts down, this is far more than 10 ms of port reads
+
+static uint64_t g_CyclesPerMs = 0;
+static uint64_t g_StartCycles = 0;
+
+// counts tsc cycles while channel 2 of the pit counts down TSC_CALIBRATION_MS in mode 0 (interrupt on terminal count)
+// channel 2 only drives the speaker, and its output can be read from the system control port, so this doesn't need irq 0 or interrupts
+static uint64_t measureCyclesPerMs() {
+    uint8_t control = x86_InByte(SYSTEM_CONTROL_PORT);
+    x86_OutByte(SYSTEM_CONTROL_PORT, control & ~(SYSTEM_CONTROL_GATE_2 | SYSTEM_CONTROL_SPEAKER)); // hold the count while it's loaded
+
+    uint16_t count = PIT_FREQUENZY_HZ / 1000 * TSC_CALIBRATION_MS;
+    x86_OutByte(PIT_COMMAND_PORT, 0xB0); // channel 2, lobyte/hibyte, mode 0, see pit.c
+    x86_OutByte(PIT_CHANNEL_2_PORT, count & 0xFF);
+    x86_OutByte(PIT_CHANNEL_2_PORT, (count >> 8) & 0xFF);
+
+    bool interruptsEnabled = x86_SaveAndDisableInterrupts(); // an irq in between would only make the result larger
+    x86_OutByte(SYSTEM_CONTROL_PORT, (control & ~SYSTEM_CONTROL_SPEAKER) | SYSTEM_CONTROL_GATE_2);
+    uint64_t startCycles = x86_ReadTsc();
+
+    for (uint32_t i = 0; i < TSC_CALIBRATION_MAX_READS && !(x86_InByte(SYSTEM_CONTROL_PORT) & SYSTEM_CONTROL_OUTPUT_2); ++i)
+        ;
+
+    uint64_t cycles = x86_ReadTsc() - startCycles;
+    x86_RestoreInterrupts(interruptsEnabled);
+    x86_OutByte(SYSTEM_CONTROL_PORT, control);
+
+    return cycles / TSC_CALIBRATION_MS;
+}
+
+// busy waits for TSC_CALIBRATION_MS, TSC_GetTimeMs does this itself the first time it's called otherwise
+void TSC_Initialize() {
+    if (g_CyclesPerMs != 0)
+        return;
+
+    g_StartCycles = x86_ReadTsc();
+    uint64_t cyclesPerMs = measureCyclesPerMs();
+    g_CyclesPerMs = cyclesPerMs != 0 ? cyclesPerMs : 1;
+}
+
+// milliseconds since TSC_Initialize
+uint64_t TSC_GetTimeMs() {
+    if (g_CyclesPerMs == 0)
+        TSC_Initialize();
+
+    return (x86_ReadTsc() - g_StartCycles) / g_CyclesPerMs;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+// a millisecond clock that keeps counting with interrupts disabled, unlike PIT_GetTimeMs, which stops while irq 0 can't come in
+// timeouts that may run in an irq handler, or in a loop that has interrupts disabled, have to use this one
+void TSC_Initialize();
+uint64_t TSC_GetTimeMs();
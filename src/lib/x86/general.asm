@@ -28,6 +28,114 @@ x86_InWord:
     in ax, dx
     ret
 
+global x86_OutDword
+x86_OutDword:
+    mov dx, [esp + 4]
+    mov eax, [esp + 8]
+    out dx, eax
+    ret
+
+global x86_InDword
+x86_InDword:
+    mov dx, [esp + 4]
+    in eax, dx
+    ret
+
+; returns the time stamp counter in edx:eax, which is where a uint64_t is returned anyway
+global x86_ReadTsc
+x86_ReadTsc:
+    rdtsc
+    ret
+
+; fills `registersOutput` with eax, ebx, ecx and edx, in that order
+global x86_Cpuid
+x86_Cpuid:
+    push ebx
+    push edi
+    mov eax, [esp + 12] ; leaf
+    mov ecx, [esp + 16] ; subleaf
+    cpuid
+    mov edi, [esp + 20] ; registersOutput
+    mov [edi], eax
+    mov [edi + 4], ebx
+    mov [edi + 8], ecx
+    mov [edi + 12], edx
+    pop edi
+    pop ebx
+    ret
+
+; returns the msr in edx:eax, like x86_ReadTsc
+global x86_ReadMsr
+x86_ReadMsr:
+    mov ecx, [esp + 4]
+    rdmsr
+    ret
+
+global x86_WriteMsr
+x86_WriteMsr:
+    mov ecx, [esp + 4]
+    mov eax, [esp + 8]  ; low dword
+    mov edx, [esp + 12] ; high dword
+    wrmsr
+    ret
+
+; the caches have to be off while memory types change, this sets cr0.cd, clears cr0.nw and writes everything cached back
+global x86_DisableCaches
+x86_DisableCaches:
+    mov eax, cr0
+    or eax, 1 << 30
+    and eax, ~(1 << 29)
+    mov cr0, eax
+    wbinvd
+    ret
+
+global x86_EnableCaches
+x86_EnableCaches:
+    wbinvd
+    mov eax, cr0
+    and eax, ~(1 << 30)
+    mov cr0, eax
+    ret
+
+global x86_InWords
+x86_InWords:
+    push edi
+    mov dx, [esp + 8]   ; port
+    mov edi, [esp + 12] ; buffer
+    mov ecx, [esp + 16] ; word count
+    cld
+    rep insw
+    pop edi
+    ret
+
+global x86_OutBytes
+x86_OutBytes:
+    push esi
+    mov dx, [esp + 8]   ; port
+    mov esi, [esp + 12] ; buffer
+    mov ecx, [esp + 16] ; byte count
+    cld
+    rep outsb
+    pop esi
+    ret
+
+; not a plain `rep outsw`, some ata drives need a tiny delay (a jmp $+2) between each word written
+global x86_OutWords
+x86_OutWords:
+    push esi
+    mov dx, [esp + 8]   ; port
+    mov esi, [esp + 12] ; buffer
+    mov ecx, [esp + 16] ; word count
+    cld
+    jecxz .done
+.loop:
+    outsw
+    jmp $+2
+    loop .loop
+.done:
+    pop esi
+    ret
+
 global x86_Halt
 x86_Halt:
     cli
@@ -42,3 +150,37 @@ global x86_DisableInterrupts
 x86_DisableInterrupts:
     cli
     ret
+
+; sti only takes effect after the next instruction, so no interrupt can slip in between the sti and the hlt
+global x86_EnableInterruptsAndHalt
+x86_EnableInterruptsAndHalt:
+    sti
+    hlt
+    ret
+
+; lets in the interrupts that are pending, sti only takes effect after the nop, and then disables them again
+global x86_AllowInterrupts
+x86_AllowInterrupts:
+    sti
+    nop
+    cli
+    ret
+
+; returns whether interrupts were enabled before disabling them, pass it to x86_RestoreInterrupts
+global x86_SaveAndDisableInterrupts
+x86_SaveAndDisableInterrupts:
+    pushfd
+    pop eax
+    shr eax, 9 ; the interrupt flag
+    and eax, 1
+    cli
+    ret
+
+global x86_RestoreInterrupts
+x86_RestoreInterrupts:
+    mov al, [esp + 4]
+    test al, al
+    jz .done
+    sti
+.done:
+    ret
@@ -8,8 +8,23 @@ void ASMCALL x86_OutByte(uint16_t port, uint8_t value);
 uint8_t ASMCALL x86_InByte(uint16_t port);
 void ASMCALL x86_OutWord(uint16_t port, uint16_t value);
 uint16_t ASMCALL x86_InWord(uint16_t port);
+void ASMCALL x86_OutDword(uint16_t port, uint32_t value);
+uint32_t ASMCALL x86_InDword(uint16_t port);
+uint64_t ASMCALL x86_ReadTsc();
+void ASMCALL x86_Cpuid(uint32_t leaf, uint32_t subleaf, uint32_t registersOutput[4]);
+uint64_t ASMCALL x86_ReadMsr(uint32_t msr);
+void ASMCALL x86_WriteMsr(uint32_t msr, uint64_t value);
+void ASMCALL x86_DisableCaches();
+void ASMCALL x86_EnableCaches();
+void ASMCALL x86_InWords(uint16_t port, uint16_t *buffer, uint32_t count);
+void ASMCALL x86_OutWords(uint16_t port, const uint16_t *buffer, uint32_t count);
+void ASMCALL x86_OutBytes(uint16_t port, const uint8_t *buffer, uint32_t count);
 
 void ASMCALL x86_EnableInterrupts();
 void ASMCALL x86_DisableInterrupts();
+void ASMCALL x86_EnableInterruptsAndHalt();
+void ASMCALL x86_AllowInterrupts();
+bool ASMCALL x86_SaveAndDisableInterrupts();
+void ASMCALL x86_RestoreInterrupts(bool enabled);
 
 void ASMCALL x86_Halt();